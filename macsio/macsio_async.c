@@ -0,0 +1,479 @@
+/*
+Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+Produced at the Lawrence Livermore National Laboratory.
+Written by Mark C. Miller
+
+LLNL-CODE-676051. All rights reserved.
+
+This file is part of MACSio
+
+Please also read the LICENSE file at the top of the source code directory or
+folder hierarchy.
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License (as published by the Free Software
+Foundation) version 2, dated June 1991.
+
+This program is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the terms and conditions of the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <macsio_async.h>
+#include <macsio_ioacct.h>
+#include <macsio_log.h>
+#include <macsio_main.h>
+#include <macsio_timing.h>
+#include <macsio_utils.h>
+
+#include <json-cwx/json.h>
+
+/*!
+\addtogroup MACSIO_ASYNC
+@{
+*/
+
+/*! \brief State of the one dump that may be in flight */
+typedef struct _MACSIO_ASYNC_dump_t
+{
+    MACSIO_ASYNC_Mode_t mode;           /**< Thread or fork */
+    MACSIO_IFACE_Handle_t const *iface; /**< Plugin doing the dump */
+    int argi;                           /**< Argument index of first plugin argument */
+    int argc;                           /**< \c argc from main */
+    char **argv;                        /**< \c argv from main */
+    json_object *dump_obj;              /**< Snapshot of the main object being dumped */
+    int dumpNum;                        /**< Number of this dump */
+    double dumpTime;                    /**< Time of this dump */
+    double snapshotTime;                /**< Time taken to create the snapshot */
+    double drainStart;                  /**< Time writer started in plugin's dump function */
+    double drainEnd;                    /**< Time writer finished in plugin's dump function */
+    int threadStarted;                  /**< Indicates if writer thread is running */
+    pthread_t thread;                   /**< The writer thread */
+    pid_t pid;                          /**< The writer child process (fork mode) */
+    int pipeFd;                         /**< Read end of pipe from the child (fork mode) */
+    long parentFaults;                  /**< Parent's page fault count when child was forked */
+    long childFaults;                   /**< Page fault count of all reaped children when child was forked */
+} MACSIO_ASYNC_dump_t;
+
+static MACSIO_ASYNC_dump_t *inFlight = 0;
+static int forkedChild = 0;
+static json_object *forkedChildResult = 0;
+
+static int
+extarr_type_size(enum json_extarr_type etype)
+{
+    switch (etype)
+    {
+        case json_extarr_type_byt08: return 1;
+        case json_extarr_type_int32: return 4;
+        case json_extarr_type_int64: return 8;
+        case json_extarr_type_flt32: return 4;
+        case json_extarr_type_flt64: return 8;
+        default: break;
+    }
+    return 0;
+}
+
+/* Deep copy of a json object including its extarr buffers */
+static json_object *
+snapshot_object(json_object *obj)
+{
+    if (!obj) return 0;
+
+    switch (json_object_get_type(obj))
+    {
+        case json_type_object:
+        {
+            json_object *copy = json_object_new_object();
+            json_object_object_foreach(obj, key, val)
+                json_object_object_add(copy, key, snapshot_object(val));
+            return copy;
+        }
+        case json_type_array:
+        {
+            int i;
+            json_object *copy = json_object_new_array();
+            for (i = 0; i < json_object_array_length(obj); i++)
+                json_object_array_add(copy, snapshot_object(json_object_array_get_idx(obj, i)));
+            return copy;
+        }
+        case json_type_extarr:
+        {
+            int i, ndims = json_object_extarr_ndims(obj);
+            enum json_extarr_type etype = json_object_extarr_type(obj);
+            size_t nbytes = (size_t) json_object_extarr_nvals(obj) * extarr_type_size(etype);
+            int *dims = (int *) malloc(ndims * sizeof(int));
+            void *buf = malloc(nbytes);
+            json_object *copy;
+
+            for (i = 0; i < ndims; i++)
+                dims[i] = json_object_extarr_dim(obj, i);
+            memcpy(buf, json_object_extarr_data(obj), nbytes);
+            copy = json_object_new_extarr(buf, etype, ndims, dims, 0);
+            free(dims);
+            return copy;
+        }
+        case json_type_boolean: return json_object_new_boolean(json_object_get_boolean(obj));
+        case json_type_double:  return json_object_new_double(json_object_get_double(obj));
+        case json_type_int:     return json_object_new_int64(json_object_get_int64(obj));
+        case json_type_string:  return json_object_new_string(json_object_get_string(obj));
+        default: break;
+    }
+
+    return 0;
+}
+
+/* Main object the writer dumps. Its problem object is a snapshot. All other
+   members (e.g. clargs, parallel) are shared with the real main object and
+   are not modified while a dump is in flight. */
+static json_object *
+snapshot_main_object(json_object *main_obj)
+{
+    json_object *dump_obj = json_object_new_object();
+
+    json_object_object_foreach(main_obj, key, val)
+    {
+        if (!strcmp(key, "problem"))
+            json_object_object_add(dump_obj, key, snapshot_object(val));
+        else
+            json_object_object_add(dump_obj, key, json_object_get(val));
+    }
+
+    return dump_obj;
+}
+
+static void *
+writer_main(void *arg)
+{
+    MACSIO_ASYNC_dump_t *d = (MACSIO_ASYNC_dump_t *) arg;
+
+    d->drainStart = MT_Time();
+    MACSIO_IOACCT_BeginDump(d->dumpNum);
+    (*(d->iface->dumpFunc))(d->argi, d->argc, d->argv, d->dump_obj, d->dumpNum, d->dumpTime);
+    MACSIO_IOACCT_EndDump();
+    d->drainEnd = MT_Time();
+
+    return 0;
+}
+
+static long
+fault_count(int who)
+{
+    struct rusage ru;
+    if (getrusage(who, &ru)) return 0;
+    return ru.ru_minflt + ru.ru_majflt;
+}
+
+static int
+write_all(int fd, void const *buf, size_t n)
+{
+    char const *p = (char const *) buf;
+    while (n > 0)
+    {
+        ssize_t nw = write(fd, p, n);
+        if (nw < 0 && errno == EINTR) continue;
+        if (nw <= 0) return 1;
+        p += nw;
+        n -= nw;
+    }
+    return 0;
+}
+
+static int
+read_all(int fd, void *buf, size_t n)
+{
+    char *p = (char *) buf;
+    while (n > 0)
+    {
+        ssize_t nr = read(fd, p, n);
+        if (nr < 0 && errno == EINTR) continue;
+        if (nr <= 0) return 1;
+        p += nr;
+        n -= nr;
+    }
+    return 0;
+}
+
+/* Runs in the forked child. The child does the dump on its copy-on-write image of
+   the main object and then reports its write time, its I/O counts, the names of
+   the files it created (which only the child's file store knows about) and the
+   plugin's result back to the parent. */
+static void
+run_forked_child(MACSIO_ASYNC_dump_t *d, json_object *main_obj, int fd)
+{
+    int i, n = 0, len;
+    char const *result;
+    double t0, dt;
+    MACSIO_IOACCT_Counts_t counts;
+
+    forkedChild = 1;
+
+    t0 = MT_Time();
+    MACSIO_IOACCT_BeginDump(d->dumpNum);
+    (*(d->iface->dumpFunc))(d->argi, d->argc, d->argv, main_obj, d->dumpNum, d->dumpTime);
+    MACSIO_IOACCT_EndDump();
+    dt = MT_Time() - t0;
+
+    while (MACSIO_UTILS_GetOutputFile(d->dumpNum, n))
+        n++;
+    MACSIO_IOACCT_GetCounts(d->dumpNum, &counts);
+
+    write_all(fd, &t0, sizeof(t0));
+    write_all(fd, &dt, sizeof(dt));
+    write_all(fd, &counts, sizeof(counts));
+    write_all(fd, &n, sizeof(n));
+    for (i = 0; i < n; i++)
+    {
+        char const *name = MACSIO_UTILS_GetOutputFile(d->dumpNum, i);
+        int len = strlen(name);
+        write_all(fd, &len, sizeof(len));
+        write_all(fd, name, len);
+    }
+    result = forkedChildResult ? json_object_to_json_string_ext(forkedChildResult, JSON_C_TO_STRING_PLAIN) : "";
+    len = strlen(result);
+    write_all(fd, &len, sizeof(len));
+    write_all(fd, result, len);
+    close(fd);
+}
+
+static int
+start_fork_dump(MACSIO_ASYNC_dump_t *d, json_object *main_obj)
+{
+    int fds[2];
+    double t0;
+
+    if (pipe(fds))
+    {
+        MACSIO_LOG_MSG(Err, ("Unable to create pipe; doing dump %d synchronously", d->dumpNum));
+        return 1;
+    }
+
+    d->parentFaults = fault_count(RUSAGE_SELF);
+    d->childFaults = fault_count(RUSAGE_CHILDREN);
+
+    t0 = MT_Time();
+    d->pid = fork();
+    if (d->pid == 0)
+    {
+        close(fds[0]);
+        run_forked_child(d, main_obj, fds[1]);
+        _exit(0);
+    }
+    d->snapshotTime = MT_Time() - t0;
+
+    close(fds[1]);
+    if (d->pid < 0)
+    {
+        close(fds[0]);
+        MACSIO_LOG_MSG(Err, ("Unable to fork writer; doing dump %d synchronously", d->dumpNum));
+        return 1;
+    }
+    d->pipeFd = fds[0];
+
+    return 0;
+}
+
+/* Kill and reap a writer child whose dump is being abandoned */
+static void
+abandon_fork_dump(MACSIO_ASYNC_dump_t *d)
+{
+    int status;
+
+    kill(d->pid, SIGKILL);
+    while (waitpid(d->pid, &status, 0) < 0 && errno == EINTR);
+    close(d->pipeFd);
+}
+
+static void
+finish_fork_dump(MACSIO_ASYNC_dump_t *d)
+{
+    int i, n = 0, len = 0, status = 0;
+    double t0 = 0, dt = 0;
+    MACSIO_IOACCT_Counts_t counts;
+    json_object *result = 0;
+
+    if (read_all(d->pipeFd, &t0, sizeof(t0)) || read_all(d->pipeFd, &dt, sizeof(dt)) ||
+        read_all(d->pipeFd, &counts, sizeof(counts)) || read_all(d->pipeFd, &n, sizeof(n)))
+        n = 0;
+    else
+        MACSIO_IOACCT_AddCounts(d->dumpNum, &counts);
+    for (i = 0; i < n; i++)
+    {
+        int len;
+        char name[1024];
+        if (read_all(d->pipeFd, &len, sizeof(len)) || len >= (int) sizeof(name) ||
+            read_all(d->pipeFd, name, len))
+            break;
+        name[len] = '\0';
+        MACSIO_UTILS_RecordOutputFiles(d->dumpNum, name);
+    }
+    if (i == n && !read_all(d->pipeFd, &len, sizeof(len)) && len > 0)
+    {
+        char *buf = (char *) malloc(len + 1);
+        if (!read_all(d->pipeFd, buf, len))
+        {
+            buf[len] = '\0';
+            result = json_tokener_parse(buf);
+        }
+        free(buf);
+    }
+    close(d->pipeFd);
+
+    while (waitpid(d->pid, &status, 0) < 0 && errno == EINTR);
+    if (!WIFEXITED(status) || WEXITSTATUS(status))
+        MACSIO_LOG_MSG(Err, ("Writer child for dump %d failed", d->dumpNum));
+
+    /* Every processor finishes its dump here. So, the plugin may communicate. */
+    if (d->iface->forkedDumpFinishFunc)
+    {
+        MACSIO_IOACCT_BeginDump(d->dumpNum);
+        (*(d->iface->forkedDumpFinishFunc))(d->dump_obj, d->dumpNum, result);
+        MACSIO_IOACCT_EndDump();
+    }
+    json_object_put(result);
+
+    d->drainStart = t0;
+    d->drainEnd = t0 + dt;
+    d->parentFaults = fault_count(RUSAGE_SELF) - d->parentFaults;
+    d->childFaults = fault_count(RUSAGE_CHILDREN) - d->childFaults;
+}
+
+int
+MACSIO_ASYNC_StartDump(
+    MACSIO_ASYNC_Mode_t mode,
+    MACSIO_IFACE_Handle_t const *iface,
+    int argi,
+    int argc,
+    char **argv,
+    json_object *main_obj,
+    int dumpNum,
+    double dumpTime
+)
+{
+    MACSIO_ASYNC_dump_t *d;
+    double t0;
+    int err;
+
+    if (inFlight)
+    {
+        MACSIO_LOG_MSG(Warn, ("Dump %d still in flight; waiting for it", inFlight->dumpNum));
+        MACSIO_ASYNC_FinishDump(0);
+    }
+
+    d = (MACSIO_ASYNC_dump_t *) calloc(1, sizeof(MACSIO_ASYNC_dump_t));
+    d->mode = mode;
+    d->iface = iface;
+    d->argi = argi;
+    d->argc = argc;
+    d->argv = argv;
+    d->dumpNum = dumpNum;
+    d->dumpTime = dumpTime;
+
+    if (mode == MACSIO_ASYNC_FORK)
+    {
+        /* The child dumps its own image. The parent's is for forkedDumpFinishFunc. */
+        int failed, anyFailed;
+
+        /* The child dumps its own image. The parent's is for forkedDumpFinishFunc. */
+        inFlight = d;
+        d->dump_obj = json_object_get(main_obj);
+        failed = anyFailed = start_fork_dump(d, main_obj);
+
+        /* A synchronous dump communicates with the other processors all along while a
+           forked one does so only when finishing. So, if any processor could not fork,
+           all dump synchronously. */
+#ifdef HAVE_MPI
+        MPI_Allreduce(&failed, &anyFailed, 1, MPI_INT, MPI_MAX, MACSIO_MAIN_Comm);
+#endif
+        if (anyFailed)
+        {
+            if (!failed)
+                abandon_fork_dump(d);
+            if (MACSIO_MAIN_Rank == 0)
+                MACSIO_LOG_MSG(Warn, ("Not all processors could fork a writer; doing dump %d synchronously", dumpNum));
+            d->mode = MACSIO_ASYNC_SYNC;
+            writer_main(d);
+            return 1;
+        }
+        return 0;
+    }
+
+    t0 = MT_Time();
+    d->dump_obj = snapshot_main_object(main_obj);
+    d->snapshotTime = MT_Time() - t0;
+
+    inFlight = d;
+
+    err = pthread_create(&d->thread, 0, writer_main, d);
+    if (err)
+    {
+        errno = err;
+        MACSIO_LOG_MSG(Err, ("Unable to start writer thread; doing dump %d synchronously", dumpNum));
+        writer_main(d);
+        return 1;
+    }
+    d->threadStarted = 1;
+
+    return 0;
+}
+
+int
+MACSIO_ASYNC_FinishDump(MACSIO_ASYNC_DumpInfo_t *info)
+{
+    MACSIO_ASYNC_dump_t *d = inFlight;
+    double t0 = MT_Time();
+
+    if (!d) return 0;
+
+    if (d->mode == MACSIO_ASYNC_FORK)
+        finish_fork_dump(d);
+    else if (d->threadStarted)
+        pthread_join(d->thread, 0);
+
+    if (info)
+    {
+        info->dumpNum = d->dumpNum;
+        info->snapshotTime = d->snapshotTime;
+        info->drainStart = d->drainStart;
+        info->drainTime = d->drainEnd - d->drainStart;
+        info->waitTime = MT_Time() - t0;
+        info->parentFaults = d->mode == MACSIO_ASYNC_FORK ? d->parentFaults : 0;
+        info->childFaults = d->mode == MACSIO_ASYNC_FORK ? d->childFaults : 0;
+    }
+
+    json_object_put(d->dump_obj);
+    free(d);
+    inFlight = 0;
+
+    return 1;
+}
+
+void
+MACSIO_ASYNC_SetForkedChildResult(json_object *result)
+{
+    json_object_put(forkedChildResult);
+    forkedChildResult = result;
+}
+
+int
+MACSIO_ASYNC_IsForkedChild(void)
+{
+    return forkedChild;
+}
+
+/*!@}*/
@@ -0,0 +1,154 @@
+#ifndef _MACSIO_ASYNC_H
+#define _MACSIO_ASYNC_H
+/*
+Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+Produced at the Lawrence Livermore National Laboratory.
+Written by Mark C. Miller
+
+LLNL-CODE-676051. All rights reserved.
+
+This file is part of MACSio
+
+Please also read the LICENSE file at the top of the source code directory or
+folder hierarchy.
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License (as published by the Free Software
+Foundation) version 2, dated June 1991.
+
+This program is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the terms and conditions of the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include <macsio_iface.h>
+
+#include <json-cwx/json.h>
+
+/*!
+\defgroup MACSIO_ASYNC MACSIO_ASYNC
+\brief Asynchronous dumps overlapping compute and I/O
+
+In asynchronous dump mode, MACSio main does not block in a plugin's dump function.
+Instead, it takes a snapshot of the problem object (a deep copy including all of
+its extarr buffers) and hands the snapshot to a background writer thread which then
+calls the plugin's dump function while the main thread returns to the next compute
+phase. Only one dump may be in flight at any one time. Starting the next dump or
+finishing the dump loop waits for (drains) the dump in flight.
+
+The time the main thread is blocked (snapshot plus any wait for the previous dump to
+drain) is the visible cost of a dump. The time the writer spends in the plugin's dump
+function is the drain time. The difference between the drain time and the time the
+main thread spent waiting for the drain is I/O time that was hidden behind compute.
+
+Because the plugin's dump function runs in a different thread from MACSio main, this
+requires an MPI implementation supporting \c MPI_THREAD_MULTIPLE. In addition, the
+main thread must not issue collectives on \c MACSIO_MAIN_Comm while a dump is in
+flight. MACSio's level three compute work uses a communicator of its own for this reason.
+
+Alternatively, in fork mode, each processor \c fork()s a child process which calls the
+plugin's dump function on its copy-on-write image of the main object and then exits.
+The snapshot is then the cost of the \c fork() itself plus the copy-on-write page
+faults the parent subsequently takes as it modifies memory it shares with the child.
+Page fault counts of the parent (while the child is alive) and of the child are
+gathered with \c getrusage(). A child process cannot communicate with other processors.
+So, fork mode is available only with plugins that indicate their dump function needs no
+communication via the \c dumpFuncForkable member of their interface (e.g. miftmpl in
+file-per-processor mode). The names of the files the child creates are returned to the
+parent through a pipe. So is any result the plugin sets with
+MACSIO_ASYNC_SetForkedChildResult(), which the parent passes to the plugin's
+\c forkedDumpFinishFunc to complete the dump.
+
+@{
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief Dump modes */
+typedef enum _MACSIO_ASYNC_Mode_t
+{
+    MACSIO_ASYNC_SYNC = 0,  /**< Ordinary, blocking dumps */
+    MACSIO_ASYNC_THREAD,    /**< Dumps by a background writer thread */
+    MACSIO_ASYNC_FORK       /**< Dumps by a forked, copy-on-write child process */
+} MACSIO_ASYNC_Mode_t;
+
+/*! \brief Timing information of a completed asynchronous dump */
+typedef struct _MACSIO_ASYNC_DumpInfo_t
+{
+    int dumpNum;            /**< Number of the dump this information is for */
+    double snapshotTime;    /**< Time spent taking the snapshot of the problem object (the copy or the fork) */
+    double drainStart;      /**< Time (per MT_Time()) the writer entered the plugin's dump function */
+    double drainTime;       /**< Time the writer spent in the plugin's dump function */
+    double waitTime;        /**< Time the caller was blocked waiting for the drain to complete */
+    long parentFaults;      /**< Page faults taken by the caller while the dump was in flight (fork mode) */
+    long childFaults;       /**< Page faults taken by the child process (fork mode) */
+} MACSIO_ASYNC_DumpInfo_t;
+
+/*!
+\brief Start an asynchronous dump
+
+Takes a snapshot of \c main_obj's \c problem object and starts a background writer
+thread or child process to call the plugin's \c dumpFunc on it. If another dump is
+still in flight, it is first drained.
+
+\return Zero on success. Non-zero if the writer could not be started in which
+case the dump has been done synchronously before returning. In fork mode, this is
+collective on MACSIO_MAIN_Comm and if any processor could not fork, all processors
+do the dump synchronously.
+*/
+extern int
+MACSIO_ASYNC_StartDump(
+    MACSIO_ASYNC_Mode_t mode,           /**< [in] Either MACSIO_ASYNC_THREAD or MACSIO_ASYNC_FORK */
+    MACSIO_IFACE_Handle_t const *iface, /**< [in] Plugin interface to do the dump */
+    int argi,                           /**< [in] Argument index of first plugin argument */
+    int argc,                           /**< [in] \c argc from main */
+    char **argv,                        /**< [in] \c argv from main */
+    json_object *main_obj,              /**< [in] The main json object */
+    int dumpNum,                        /**< [in] Number of this dump */
+    double dumpTime                     /**< [in] Time of this dump */
+);
+
+/*!
+\brief Wait for the dump in flight, if any, to complete
+
+\return Non-zero if a dump was in flight (and \c info is populated), zero otherwise.
+*/
+extern int
+MACSIO_ASYNC_FinishDump(
+    MACSIO_ASYNC_DumpInfo_t *info /**< [out] Timing information of the completed dump */
+);
+
+/*!
+\brief Return a result from a forked child's dump to the parent
+
+A plugin's dump function running in a forked child calls this to have the parent pass
+\c result to the plugin's \c forkedDumpFinishFunc when the dump is finished. The result
+is sent as JSON text. So, it must not hold extarrs. Takes ownership of \c result.
+*/
+extern void
+MACSIO_ASYNC_SetForkedChildResult(
+    json_object *result /**< [in] Result to return to the parent */
+);
+
+/*!
+\brief Indicate if caller is running in a child process forked for a dump
+
+Plugins may use this to skip any parts of a dump that would require communication.
+*/
+extern int
+MACSIO_ASYNC_IsForkedChild(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/*!@}*/
+
+#endif /* #ifndef _MACSIO_ASYNC_H */
@@ -1357,6 +1357,26 @@ MACSIO_DATA_GenerateTimeZeroDumpObject(json_object *main_obj, int *rank_owning_c
 
 }
 
+json_object *
+MACSIO_DATA_GenerateTrickleObject(json_object *main_obj, int nbytes)
+{
+    json_object *trickle_obj = json_object_new_object();
+    int myrank = json_object_path_get_int(main_obj, "parallel/mpi_rank");
+    int i, nvals = nbytes / sizeof(double);
+    double *vals;
+
+    if (nvals < 1) nvals = 1;
+    vals = (double *) malloc(nvals * sizeof(double));
+    for (i = 0; i < nvals; i++)
+        vals[i] = (double) (MD_random_naive_rv() % 1000) / 1000.0;
+
+    json_object_object_add(trickle_obj, "Rank", json_object_new_int(myrank));
+    json_object_object_add(trickle_obj, "Data",
+        json_object_new_extarr(vals, json_extarr_type_flt64, 1, &nvals, 0));
+
+    return trickle_obj;
+}
+
 int MACSIO_DATA_GetRankOwningPart(json_object *main_obj, int chunkId)
 {
     int tmp = chunkId;
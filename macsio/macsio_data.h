@@ -197,6 +197,18 @@ MACSIO_DATA_GenerateTimeZeroDumpObject(
      int *rank_owning_chunkId /**< missing this info */
 );
 
+/*!
+\brief Generate the small, per-rank record written in each trickle dump
+
+The record holds the rank's id and a single array of doubles sized to
+approximately \c nbytes.
+*/
+extern struct json_object *
+MACSIO_DATA_GenerateTrickleObject(
+    struct json_object *main_obj, /**< The main JSON object */
+    int nbytes                    /**< Target size, in bytes, of the record's data */
+);
+
 /*!
 \brief Given a chunkId, return rank of owning task
 */
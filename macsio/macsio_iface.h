@@ -57,6 +57,33 @@ typedef void (*DumpFunc)(
     double dumpTime /**< [in] like "time" for the dump */
 );
 
+/*! \brief Small, frequent (trickle) dump (write) function specification
+
+Trickle dumps model the small time-history and diagnostic records applications
+append every few cycles in between the large (burst) dumps done by \c DumpFunc.
+*/
+typedef void (*TrickleFunc)(
+    int argi, /**< [in] index of argv at which to start processing args */
+    int argc, /**< [in] \c argc from main */
+    char **argv, /**< [in] \c argv from main */
+    json_object *main_obj, /**< [in] the main json data object */
+    json_object *trickle_obj, /**< [in] this rank's (small) record to be appended */
+    int trickleNum, /**< [in] index of this trickle dump starting from 0 */
+    double trickleTime /**< [in] like "time" for the trickle dump */
+);
+
+/*! \brief Completion of a dump done by a forked child process
+
+Called by the parent process on every processor, collectively, once the children
+forked for a dump have finished. It does the parts of the dump that need communication
+(e.g. writing a root file) with what the child returned via MACSIO_ASYNC_SetForkedChildResult().
+*/
+typedef void (*ForkedDumpFinishFunc)(
+    json_object *main_obj, /**< [in] the main json data object */
+    int dumpNum, /**< [in] number of the dump the child did */
+    json_object *child_result /**< [in] what the child returned (0 if nothing) */
+);
+
 /*! \brief Main mesh+field load (read) function specification */
 typedef void (*LoadFunc)(
     int argi, /**< [in] index of argv at which to start processing args */
@@ -93,6 +120,10 @@ typedef struct MACSIO_IFACE_Handle_t
     int                  slotUsed;                    /**< [Internal] indicate if this position in table is used */
     ProcessArgsFunc      processArgsFunc;             /**< Plugin's command-line argument processing callback */
     DumpFunc             dumpFunc;                    /**< Plugin's main dump (write) function callback */
+    TrickleFunc          trickleFunc;                 /**< Plugin's trickle dump (write) function callback (optional) */
+    int                  dumpFuncForkable;            /**< Non-zero if dumpFunc can run in a forked child process
+                                                           (e.g. it does not communicate) */
+    ForkedDumpFinishFunc forkedDumpFinishFunc;        /**< Plugin's callback to complete a forked child's dump (optional) */
     LoadFunc             loadFunc;                    /**< Plugin's main load (read) function callback */
     QueryFeaturesFunc    queryFeaturesFunc;           /**< Plugin's callback to query its feature set (not in use) */
     IdentifyFileFunc     identifyFileFunc;            /**< Plugin's callback to indicate if it thinks it owns a file */
@@ -107,6 +138,7 @@ of a static initiliztion of the plugin's local, static variables like so...
 static int register_this_plugin(void)
 {
     MACSIO_IFACE_Handle_t iface;
+    memset(&iface, 0, sizeof(iface));
     iface.name = "foobar";
     iface.ext = ".fb";
     .
@@ -0,0 +1,400 @@
+/*
+Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+Produced at the Lawrence Livermore National Laboratory.
+Written by Mark C. Miller
+
+LLNL-CODE-676051. All rights reserved.
+
+This file is part of MACSio
+
+Please also read the LICENSE file at the top of the source code directory or
+folder hierarchy.
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License (as published by the Free Software
+Foundation) version 2, dated June 1991.
+
+This program is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the terms and conditions of the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+/* The interposers define both the plain and the 64-bit variants of calls by name.
+   So, headers must not redirect the plain ones to the 64-bit ones. */
+#undef _FILE_OFFSET_BITS
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_IOACCT
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include <macsio_ioacct.h>
+#include <macsio_log.h>
+
+/*!
+\addtogroup MACSIO_IOACCT
+@{
+*/
+
+static MACSIO_IOACCT_Counts_t *dumpCounts = 0;
+static int numDumpCounts = 0;
+
+/* Dump the calling thread is doing, if any. Each dump is done by a single thread so
+   counts need no locking. */
+static __thread int currentDump = -1;
+
+static char const *opNames[MACSIO_IOACCT_NUM_OPS] =
+    {"open", "close", "write", "pwrite", "writev", "fwrite", "fsync", "stat"};
+
+void
+MACSIO_IOACCT_Init(int numDumps)
+{
+    free(dumpCounts);
+    dumpCounts = (MACSIO_IOACCT_Counts_t *) calloc(numDumps, sizeof(MACSIO_IOACCT_Counts_t));
+    numDumpCounts = dumpCounts ? numDumps : 0;
+}
+
+void
+MACSIO_IOACCT_Finalize(void)
+{
+    numDumpCounts = 0;
+    free(dumpCounts);
+    dumpCounts = 0;
+}
+
+int
+MACSIO_IOACCT_Enabled(void)
+{
+    return numDumpCounts > 0;
+}
+
+void
+MACSIO_IOACCT_BeginDump(int dumpNum)
+{
+    currentDump = dumpNum;
+}
+
+void
+MACSIO_IOACCT_EndDump(void)
+{
+    currentDump = -1;
+}
+
+void
+MACSIO_IOACCT_GetCounts(int dumpNum, MACSIO_IOACCT_Counts_t *counts)
+{
+    if (0 <= dumpNum && dumpNum < numDumpCounts)
+        *counts = dumpCounts[dumpNum];
+    else
+        memset(counts, 0, sizeof(*counts));
+}
+
+void
+MACSIO_IOACCT_AddCounts(int dumpNum, MACSIO_IOACCT_Counts_t const *counts)
+{
+    unsigned long long *dst, *src;
+    int i;
+
+    if (dumpNum < 0 || dumpNum >= numDumpCounts) return;
+
+    dst = (unsigned long long *) &dumpCounts[dumpNum];
+    src = (unsigned long long *) counts;
+    for (i = 0; i < (int) (sizeof(*counts) / sizeof(unsigned long long)); i++)
+        dst[i] += src[i];
+}
+
+char const *
+MACSIO_IOACCT_OpName(int op)
+{
+    if (op < 0 || op >= MACSIO_IOACCT_NUM_OPS) return "unknown";
+    return opNames[op];
+}
+
+/*!@}*/
+
+#ifdef HAVE_IOACCT
+
+/* Counts for the calling thread's dump or null if calls are not being counted. The
+   writes of log messages issued during a dump are not the dump's. */
+static MACSIO_IOACCT_Counts_t *
+thread_counts(void)
+{
+    int d = currentDump;
+    if (d < 0 || d >= numDumpCounts || MACSIO_LOG_InLogMsg()) return 0;
+    return &dumpCounts[d];
+}
+
+static unsigned long long
+now_nsecs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int
+request_bucket(size_t n)
+{
+    int b = 0;
+    while (n && b < MACSIO_IOACCT_NUM_BUCKETS-1)
+    {
+        n >>= 1;
+        b++;
+    }
+    return b;
+}
+
+static void
+count_call(MACSIO_IOACCT_Counts_t *c, int op, unsigned long long t0, ssize_t nbytes)
+{
+    c->ops[op]++;
+    c->nsecs[op] += now_nsecs() - t0;
+    if (nbytes < 0) return;
+    c->bytes[op] += nbytes;
+    c->reqSizes[request_bucket(nbytes)]++;
+}
+
+/* Look up the next definition of a function, i.e. the C library's */
+#define IOACCT_REAL(RET, NAME, ARGS) \
+    static RET (*real_ ## NAME) ARGS = 0; \
+    if (!real_ ## NAME) real_ ## NAME = (RET (*) ARGS) dlsym(RTLD_NEXT, #NAME)
+
+/* Body of an interposer of a call, CALL, that is counted as OP. BYTES is an
+   expression for the request size or -1 for a call that is not a write */
+#define IOACCT_COUNT(RET, OP, CALL, BYTES)                         \
+    MACSIO_IOACCT_Counts_t *c = thread_counts();                   \
+    unsigned long long t0;                                         \
+    RET retval;                                                    \
+    if (!c) return CALL;                                           \
+    t0 = now_nsecs();                                              \
+    retval = CALL;                                                 \
+    count_call(c, OP, t0, BYTES);                                  \
+    return retval
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int
+open(char const *path, int flags, ...)
+{
+    mode_t mode = 0;
+    IOACCT_REAL(int, open, (char const *, int, ...));
+    if (flags & O_CREAT)
+    {
+        va_list ap;
+        va_start(ap, flags);
+        mode = va_arg(ap, int);
+        va_end(ap);
+    }
+    IOACCT_COUNT(int, MACSIO_IOACCT_OPEN, real_open(path, flags, mode), -1);
+}
+
+int
+open64(char const *path, int flags, ...)
+{
+    mode_t mode = 0;
+    IOACCT_REAL(int, open64, (char const *, int, ...));
+    if (flags & O_CREAT)
+    {
+        va_list ap;
+        va_start(ap, flags);
+        mode = va_arg(ap, int);
+        va_end(ap);
+    }
+    IOACCT_COUNT(int, MACSIO_IOACCT_OPEN, real_open64(path, flags, mode), -1);
+}
+
+int
+openat(int dirfd, char const *path, int flags, ...)
+{
+    mode_t mode = 0;
+    IOACCT_REAL(int, openat, (int, char const *, int, ...));
+    if (flags & O_CREAT)
+    {
+        va_list ap;
+        va_start(ap, flags);
+        mode = va_arg(ap, int);
+        va_end(ap);
+    }
+    IOACCT_COUNT(int, MACSIO_IOACCT_OPEN, real_openat(dirfd, path, flags, mode), -1);
+}
+
+int
+openat64(int dirfd, char const *path, int flags, ...)
+{
+    mode_t mode = 0;
+    IOACCT_REAL(int, openat64, (int, char const *, int, ...));
+    if (flags & O_CREAT)
+    {
+        va_list ap;
+        va_start(ap, flags);
+        mode = va_arg(ap, int);
+        va_end(ap);
+    }
+    IOACCT_COUNT(int, MACSIO_IOACCT_OPEN, real_openat64(dirfd, path, flags, mode), -1);
+}
+
+int
+close(int fd)
+{
+    IOACCT_REAL(int, close, (int));
+    IOACCT_COUNT(int, MACSIO_IOACCT_CLOSE, real_close(fd), -1);
+}
+
+ssize_t
+write(int fd, void const *buf, size_t n)
+{
+    IOACCT_REAL(ssize_t, write, (int, void const *, size_t));
+    IOACCT_COUNT(ssize_t, MACSIO_IOACCT_WRITE, real_write(fd, buf, n), retval);
+}
+
+ssize_t
+pwrite(int fd, void const *buf, size_t n, off_t off)
+{
+    IOACCT_REAL(ssize_t, pwrite, (int, void const *, size_t, off_t));
+    IOACCT_COUNT(ssize_t, MACSIO_IOACCT_PWRITE, real_pwrite(fd, buf, n, off), retval);
+}
+
+ssize_t
+pwrite64(int fd, void const *buf, size_t n, off64_t off)
+{
+    IOACCT_REAL(ssize_t, pwrite64, (int, void const *, size_t, off64_t));
+    IOACCT_COUNT(ssize_t, MACSIO_IOACCT_PWRITE, real_pwrite64(fd, buf, n, off), retval);
+}
+
+ssize_t
+writev(int fd, struct iovec const *iov, int iovcnt)
+{
+    IOACCT_REAL(ssize_t, writev, (int, struct iovec const *, int));
+    IOACCT_COUNT(ssize_t, MACSIO_IOACCT_WRITEV, real_writev(fd, iov, iovcnt), retval);
+}
+
+int
+fsync(int fd)
+{
+    IOACCT_REAL(int, fsync, (int));
+    IOACCT_COUNT(int, MACSIO_IOACCT_FSYNC, real_fsync(fd), -1);
+}
+
+int
+fdatasync(int fd)
+{
+    IOACCT_REAL(int, fdatasync, (int));
+    IOACCT_COUNT(int, MACSIO_IOACCT_FSYNC, real_fdatasync(fd), -1);
+}
+
+int
+stat(char const *path, struct stat *buf)
+{
+    IOACCT_REAL(int, stat, (char const *, struct stat *));
+    IOACCT_COUNT(int, MACSIO_IOACCT_STAT, real_stat(path, buf), -1);
+}
+
+int
+stat64(char const *path, struct stat64 *buf)
+{
+    IOACCT_REAL(int, stat64, (char const *, struct stat64 *));
+    IOACCT_COUNT(int, MACSIO_IOACCT_STAT, real_stat64(path, buf), -1);
+}
+
+/* Before glibc 2.33, stat and stat64 are inlines calling these */
+int
+__xstat(int ver, char const *path, struct stat *buf)
+{
+    IOACCT_REAL(int, __xstat, (int, char const *, struct stat *));
+    IOACCT_COUNT(int, MACSIO_IOACCT_STAT, real___xstat(ver, path, buf), -1);
+}
+
+int
+__xstat64(int ver, char const *path, struct stat64 *buf)
+{
+    IOACCT_REAL(int, __xstat64, (int, char const *, struct stat64 *));
+    IOACCT_COUNT(int, MACSIO_IOACCT_STAT, real___xstat64(ver, path, buf), -1);
+}
+
+FILE *
+fopen(char const *path, char const *mode)
+{
+    IOACCT_REAL(FILE *, fopen, (char const *, char const *));
+    IOACCT_COUNT(FILE *, MACSIO_IOACCT_OPEN, real_fopen(path, mode), -1);
+}
+
+FILE *
+fopen64(char const *path, char const *mode)
+{
+    IOACCT_REAL(FILE *, fopen64, (char const *, char const *));
+    IOACCT_COUNT(FILE *, MACSIO_IOACCT_OPEN, real_fopen64(path, mode), -1);
+}
+
+int
+fclose(FILE *stream)
+{
+    IOACCT_REAL(int, fclose, (FILE *));
+    IOACCT_COUNT(int, MACSIO_IOACCT_CLOSE, real_fclose(stream), -1);
+}
+
+size_t
+fwrite(void const *buf, size_t size, size_t n, FILE *stream)
+{
+    IOACCT_REAL(size_t, fwrite, (void const *, size_t, size_t, FILE *));
+    IOACCT_COUNT(size_t, MACSIO_IOACCT_FWRITE, real_fwrite(buf, size, n, stream), (ssize_t) (retval * size));
+}
+
+int
+fputs(char const *str, FILE *stream)
+{
+    IOACCT_REAL(int, fputs, (char const *, FILE *));
+    IOACCT_COUNT(int, MACSIO_IOACCT_FWRITE, real_fputs(str, stream),
+        retval == EOF ? 0 : (ssize_t) strlen(str));
+}
+
+int
+fputc(int ch, FILE *stream)
+{
+    IOACCT_REAL(int, fputc, (int, FILE *));
+    IOACCT_COUNT(int, MACSIO_IOACCT_FWRITE, real_fputc(ch, stream), retval == EOF ? 0 : 1);
+}
+
+int
+vfprintf(FILE *stream, char const *fmt, va_list ap)
+{
+    IOACCT_REAL(int, vfprintf, (FILE *, char const *, va_list));
+    IOACCT_COUNT(int, MACSIO_IOACCT_FWRITE, real_vfprintf(stream, fmt, ap), retval < 0 ? 0 : retval);
+}
+
+/* The C library's fprintf does not call the interposed vfprintf */
+int
+fprintf(FILE *stream, char const *fmt, ...)
+{
+    va_list ap;
+    int retval;
+    va_start(ap, fmt);
+    retval = vfprintf(stream, fmt, ap);
+    va_end(ap);
+    return retval;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HAVE_IOACCT */
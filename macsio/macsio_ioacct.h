@@ -0,0 +1,152 @@
+#ifndef _MACSIO_IOACCT_H
+#define _MACSIO_IOACCT_H
+/*
+Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+Produced at the Lawrence Livermore National Laboratory.
+Written by Mark C. Miller
+
+LLNL-CODE-676051. All rights reserved.
+
+This file is part of MACSio
+
+Please also read the LICENSE file at the top of the source code directory or
+folder hierarchy.
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License (as published by the Free Software
+Foundation) version 2, dated June 1991.
+
+This program is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the terms and conditions of the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/*!
+\defgroup MACSIO_IOACCT MACSIO_IOACCT
+\brief System call level I/O accounting
+
+The size of the JSON problem object MACSio hands a plugin is not the volume of data the
+plugin's I/O library actually moves. Libraries add metadata, pad, rewrite superblocks and
+headers, buffer small requests (or not) and stat files. To expose this, MACSio defines its
+own versions of the \c open, \c openat, \c close, \c write, \c pwrite, \c writev, \c fsync and \c stat
+system call wrappers (and their 64-bit variants) and of the \c stdio calls that open, write
+and close streams. These interpose on the C library's versions for MACSio itself as well as
+for every shared library it is linked with (e.g. HDF5, Silo, MPI-IO). Each counts the calls
+made, the time spent in them and, for the write calls, the bytes written and a log2-bucketed
+histogram of request sizes and then calls through to the C library's version found with
+\c dlsym(RTLD_NEXT,...).
+
+Calls are attributed to the dump the calling thread is doing, as set by
+MACSIO_IOACCT_BeginDump(). Calls made outside of a dump are not counted. So, the cost of
+the accounting is negligible when it is not enabled. The writes of messages logged during
+a dump are not counted either.
+
+The C library writes buffered \c stdio output (e.g. \c fprintf by the miftmpl plugin)
+through its internal, non-interposable system call entry points. So, \c stdio writes are
+counted as they are made, as \c fwrite, and their request sizes are those of the calls, not
+of the buffer flushes. Statically linked I/O libraries are not seen. The interposers
+replace the C library's versions for the whole process. So, they are compiled in only when
+\c HAVE_IOACCT is defined (the \c ENABLE_IOACCT CMake option, off by default) and they go
+straight through to the C library's versions unless accounting is enabled.
+
+@{
+*/
+
+/*! \brief Number of request size histogram buckets
+
+Bucket 0 counts zero byte requests. Bucket i>0 counts requests of size [2^(i-1),2^i). The
+last bucket also counts all larger requests. */
+#define MACSIO_IOACCT_NUM_BUCKETS 32
+
+/*! \brief Requests smaller than this many bytes are \em small */
+#define MACSIO_IOACCT_SMALL_REQUEST 4096
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief Accounted system calls */
+typedef enum _MACSIO_IOACCT_Op_t
+{
+    MACSIO_IOACCT_OPEN = 0, /**< \c open, \c open64, \c openat, \c openat64, \c fopen, \c fopen64 */
+    MACSIO_IOACCT_CLOSE,    /**< \c close, \c fclose */
+    MACSIO_IOACCT_WRITE,    /**< \c write */
+    MACSIO_IOACCT_PWRITE,   /**< \c pwrite, \c pwrite64 */
+    MACSIO_IOACCT_WRITEV,   /**< \c writev */
+    MACSIO_IOACCT_FWRITE,   /**< \c fwrite, \c fputs, \c fputc, \c fprintf, \c vfprintf */
+    MACSIO_IOACCT_FSYNC,    /**< \c fsync, \c fdatasync */
+    MACSIO_IOACCT_STAT,     /**< \c stat, \c stat64 (and glibc's \c __xstat, \c __xstat64) */
+    MACSIO_IOACCT_NUM_OPS
+} MACSIO_IOACCT_Op_t;
+
+/*! \brief I/O counts of one dump on one task
+
+All members are \c unsigned \c long \c long so that counts may be reduced as an array. */
+typedef struct _MACSIO_IOACCT_Counts_t
+{
+    unsigned long long ops[MACSIO_IOACCT_NUM_OPS];      /**< Number of calls of each kind */
+    unsigned long long nsecs[MACSIO_IOACCT_NUM_OPS];    /**< Nanoseconds spent in calls of each kind */
+    unsigned long long bytes[MACSIO_IOACCT_NUM_OPS];    /**< Bytes written by calls of each kind */
+    unsigned long long reqSizes[MACSIO_IOACCT_NUM_BUCKETS]; /**< Histogram of write request sizes */
+} MACSIO_IOACCT_Counts_t;
+
+/*! \brief Enable accounting and allocate counts for a number of dumps */
+extern void
+MACSIO_IOACCT_Init(
+    int numDumps /**< [in] Number of dumps to account for */
+);
+
+/*! \brief Disable accounting and free all counts */
+extern void
+MACSIO_IOACCT_Finalize(void);
+
+/*! \brief Indicate if accounting is enabled */
+extern int
+MACSIO_IOACCT_Enabled(void);
+
+/*! \brief Attribute calling thread's I/O to a dump
+
+Called by whichever thread calls a plugin's dump function immediately before calling it. */
+extern void
+MACSIO_IOACCT_BeginDump(
+    int dumpNum /**< [in] Number of the dump the calling thread is about to do */
+);
+
+/*! \brief Stop attributing calling thread's I/O to a dump */
+extern void
+MACSIO_IOACCT_EndDump(void);
+
+/*! \brief Get this task's counts for a dump */
+extern void
+MACSIO_IOACCT_GetCounts(
+    int dumpNum,                   /**< [in] Number of the dump */
+    MACSIO_IOACCT_Counts_t *counts /**< [out] Counts of the dump */
+);
+
+/*! \brief Add to this task's counts for a dump
+
+Used to account for I/O done in another process (e.g. a forked writer) */
+extern void
+MACSIO_IOACCT_AddCounts(
+    int dumpNum,                         /**< [in] Number of the dump */
+    MACSIO_IOACCT_Counts_t const *counts /**< [in] Counts to add */
+);
+
+/*! \brief Get name of an accounted system call */
+extern char const *
+MACSIO_IOACCT_OpName(
+    int op /**< [in] One of MACSIO_IOACCT_Op_t */
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+/*!@}*/
+
+#endif /* #ifndef _MACSIO_IOACCT_H */
@@ -25,6 +25,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 */
 
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -55,6 +56,12 @@ MACSIO_LOG_LogHandle_t *MACSIO_LOG_MainLog = 0;
 MACSIO_LOG_LogHandle_t *MACSIO_LOG_StdErr = 0;
 #endif /*] DOXYGEN_IGNORE_THIS */
 
+/* Set while the calling thread writes a message to a log */
+static __thread int inLogMsg = 0;
+
+/* Serializes the claiming of log lines by threads (e.g. an async dump's writer) */
+static pthread_mutex_t logMutex = PTHREAD_MUTEX_INITIALIZER;
+
 typedef struct _log_flags_t
 {
     unsigned int was_logged : 1; /**< Indicates if a message was ever logged to the log */
@@ -91,22 +98,12 @@ MACSIO_LOG_MakeMsg(
     ...                 /**< [in] Optional, variable length set of arguments for format to be printed out. */
 )
 {
-//#warning MAKE THIS THREAD SAFE BY ALLOCATING THE RETURNED STRING OR USE A LARGE CIRCULAR BUFFER
-  static char error_buffer[1024];
-  static int error_buffer_ptr = 0;
-  size_t L,Lmax;
-  char   tmp[sizeof(error_buffer)];
+  /* Each thread has its own buffer. The message is used before the thread makes another. */
+  static __thread char error_buffer[1024];
   va_list ptr;
 
   va_start(ptr, format);
-
-  vsprintf(tmp, format, ptr);
-  L    = strlen(tmp);
-  Lmax = sizeof(error_buffer) - error_buffer_ptr - 1;
-  if (Lmax < L)
-     tmp[Lmax-1] = '\0';
-  strcpy(error_buffer + error_buffer_ptr,tmp);
-
+  vsnprintf(error_buffer, sizeof(error_buffer), format, ptr);
   va_end(ptr);
 
   return error_buffer;
@@ -191,7 +188,8 @@ MACSIO_LOG_LogInit(
 /*!
 \brief Issue a printf-style message to a log
 
-May be called independently by any processor in the communicator used to initialize the log.
+May be called independently by any processor in the communicator used to initialize the log
+and by any thread of a processor.
 */
 void
 MACSIO_LOG_LogMsg(
@@ -200,7 +198,7 @@ MACSIO_LOG_LogMsg(
     ...                          /**< [in] Optional, variable list of arguments for the format string. */
 )
 {
-    int i = 0;
+    int i = 0, line;
     int is_stderr = log->logfile == fileno(stderr);
     char *msg, *buf;
     va_list ptr;
@@ -235,6 +233,14 @@ MACSIO_LOG_LogMsg(
         buf[log->log_line_length-1] = '\n';
     }
 
+    pthread_mutex_lock(&logMutex);
+    line = log->current_line++;
+    if (log->current_line == log->lines_per_proc + (log->rank==0?log->extra_lines_proc0:0))
+        log->current_line = 1;
+    log->flags.was_logged = 1;
+    pthread_mutex_unlock(&logMutex);
+
+    inLogMsg = 1;
     if (is_stderr)
     {
         write(log->logfile, buf, sizeof(char) * strlen(buf));
@@ -243,15 +249,22 @@ MACSIO_LOG_LogMsg(
     else
     {
         int extra_lines = log->rank?log->extra_lines_proc0:0;
-        off_t seek_offset = (log->rank * log->lines_per_proc + log->current_line + extra_lines) * log->log_line_length;
+        off_t seek_offset = (log->rank * log->lines_per_proc + line + extra_lines) * log->log_line_length;
         pwrite(log->logfile, buf, sizeof(char) * log->log_line_length, seek_offset);
     }
+    inLogMsg = 0;
     free(buf);
+}
 
-    log->current_line++;
-    if (log->current_line == log->lines_per_proc + (log->rank==0?log->extra_lines_proc0:0))
-        log->current_line = 1;
-    log->flags.was_logged = 1;
+/*!
+\brief Indicate if the calling thread is writing a message to a log
+
+I/O accounting uses this to leave the log's own writes out of a dump's counts.
+*/
+int
+MACSIO_LOG_InLogMsg(void)
+{
+    return inLogMsg;
 }
 
 /*!
@@ -218,6 +218,7 @@ extern void MACSIO_LOG_LogMsgWithDetails(MACSIO_LOG_LogHandle_t const *log, char
     MACSIO_LOG_MsgSeverity_t sevVal, char const *sevStr,
     int sysErrno, int mpiErrno, char const *theFile, int theLine);
 extern void MACSIO_LOG_LogFinalize(MACSIO_LOG_LogHandle_t *log);
+extern int MACSIO_LOG_InLogMsg(void);
 
 #ifdef __cplusplus
 }
@@ -50,11 +50,15 @@ extern "C" {
 #endif
 #endif
 
+#include <macsio_async.h>
 #include <macsio_clargs.h>
 #include <macsio_data.h>
 #include <macsio_iface.h>
+#include <macsio_ioacct.h>
 #include <macsio_log.h>
 #include <macsio_main.h>
+#include <macsio_mif.h>
+#include <macsio_msf.h>
 #include <macsio_timing.h>
 #include <macsio_utils.h>
 #include <macsio_work.h>
@@ -85,6 +89,17 @@ int MACSIO_MAIN_Comm = 0;
 int MACSIO_MAIN_Size = 1;
 int MACSIO_MAIN_Rank = 0;
 
+#ifdef HAVE_MPI
+static int mpi_thread_level = MPI_THREAD_SINGLE;
+
+/* Per-dump reductions use their own communicator so that they never interfere
+   with a dump that may still be in flight on MACSIO_MAIN_Comm */
+static MPI_Comm dump_report_comm = MPI_COMM_NULL;
+#endif
+
+/* Number of slowest ranks to identify in per-dump reports */
+#define MACSIO_MAIN_NUM_SLOWEST 3
+
 static void handle_help_request_and_exit(int argi, int argc, char **argv)
 {
     int rank = 0, i, n, *ids=0;;
@@ -180,17 +195,81 @@ static json_object *ProcessCommandLine(int argc, char *argv[], int *plugin_argi)
         "--interface %s", "miftmpl",
             "Specify the name of the interface to be tested. Use keyword 'list'\n"
             "to print a list of all known interface names and then exit.",
+        "--sweep %s", MACSIO_CLARGS_NODEFAULT,
+            "Run a parameter sweep as a series of sub-experiments in one job. The\n"
+            "sweep is specified as a quoted, semicolon-separated list of\n"
+            "name=values items where name is the name of a main argument (without\n"
+            "the leading dashes) or 'plugin_args' and values is a comma-separated\n"
+            "list of values for it. The last (space-separated) part of any value\n"
+            "may be a range, lo:hi, lo:hi:+step or lo:hi:*factor, with optional size\n"
+            "modifier characters on lo and hi. A value of 'plugin_args' is appended\n"
+            "to the plugin arguments. Every combination of values is run, with the\n"
+            "problem regenerated and the timers cleared for each. Settings such as\n"
+            "--debug_level and --timer_clock are re-applied for each too. The log\n"
+            "args, --read_path and --interfaces cannot be swept. For example,\n"
+            "--sweep \"parallel_file_mode=MIF 8:64:*2,SIF;part_size=10K:1M:*10\"\n"
+            "A timings file is written for each sub-experiment with its number\n"
+            "appended to its name and a summary of all of them is reported in the log.",
+        "--interfaces %s", MACSIO_CLARGS_NODEFAULT,
+            "Specify a comma-separated list (no spaces) of interfaces to be tested\n"
+            "one after the other, on the same problem, in one job. This overrides\n"
+            "--interface. Plugin arguments for an interface follow a 'name:' token\n"
+            "after --plugin_args. If an interface is listed more than once, its\n"
+            "k-th token is for its k-th time in the list. A token for no interface\n"
+            "in the list is an error. Any plugin arguments before the first such\n"
+            "token are passed to every interface. For example,\n"
+            "--interfaces miftmpl,hdf5,hdf5 --plugin_args hdf5: hdf5: --compression gzip\n"
+            "A timings file is written for each interface with the interface's name\n"
+            "and position in the list appended to its name and a side-by-side\n"
+            "comparison of the interfaces is reported in the log.",
         "--parallel_file_mode %s %d", "MIF 4",
             "Specify the parallel file mode. There are several choices.\n"
             "Use 'MIF' for Multiple Independent File (Poor Man's) mode and then\n"
             "also specify the number of files. Or, use 'MIFFPP' for MIF mode and\n"
             "one file per processor or 'MIFOPT' for MIF mode and let the test\n"
-            "determine the optimum file count. Use 'SIF' for SIngle shared File\n"
+            "determine the optimum file count. Use 'MIFMEM' and a file count for\n"
+            "MIF mode where only the first processor of each group opens the file\n"
+            "and the others send it their data as in-memory file images (HDF5\n"
+            "plugin only). Use 'SIF' for SIngle shared File\n"
             "(Rich Man's) mode. If you also give a file count for SIF mode, then\n"
             "MACSio will perform a sort of hybrid combination of MIF and SIF modes.\n"
             "It will produce the specified number of files by grouping ranks in the\n"
             "the same way MIF does, but I/O within each group will be to a single,\n"
-            "shared file using SIF mode.",
+            "shared file using SIF mode (HDF5 and TyphonIO plugins only).",
+        "--mif_auto_probes %d", "5",
+            "Maximum number of trial dumps done to choose the file count in\n"
+            "MIFAUTO (or MIFOPT) parallel file mode. The trial file counts are\n"
+            "spaced geometrically between 1 and the number of processors. The\n"
+            "count chosen is the one at the maximum of a curve fitted to the\n"
+            "aggregate bandwidths of the trials.",
+        "--mif_max_concurrent %d", "0",
+            "Maximum number of MIF groups writing files at the same time. When\n"
+            "this is less than the file count, the groups are scheduled in waves.\n"
+            "For example, with 1024 files and a value of 128 here, there are 8\n"
+            "waves of 128 files being written concurrently. Group g does not begin\n"
+            "until group g-128 has finished. Zero means no limit.",
+        "--mif_group_layout %s", "contiguous",
+            "How MPI ranks are assigned to MIF groups. Options are 'contiguous'\n"
+            "(each group is a contiguous range of ranks), 'round_robin' (rank r\n"
+            "is in group r modulo the file count), 'node_packed' (a group's ranks\n"
+            "are on as few nodes as possible) and 'node_spread' (a group's ranks\n"
+            "are on different nodes so each node serves several files).",
+        "--mif_group_report", "",
+            "After each MIF dump, log the time each MIF group spent waiting for\n"
+            "the baton, creating/opening, writing, closing and handing off the\n"
+            "baton, summed over the group's tasks, and the min/avg/max over groups.",
+        "--msf_cb_aggregators %d", "0",
+            "Collective buffering in SIF mode with a file count for plugins that\n"
+            "write through MACSIO_MSF (e.g. miftmpl). Zero means each task writes its\n"
+            "own data. A positive value means MACSio gathers each group's data to\n"
+            "this many aggregator tasks per group, which issue large, aligned,\n"
+            "contiguous writes. A negative value means the MPI library's own\n"
+            "collective buffering is used via MPI_File_write_at_all.",
+        "--msf_cb_buffer_size %d", "16M",
+            "Bytes each collective buffering aggregator writes per round.",
+        "--msf_cb_align %d", "1M",
+            "Alignment in bytes (e.g. the file system stripe size) of the part of\n"
+            "the file each collective buffering aggregator writes.",
         "--avg_num_parts %f", "1",
             "The average number of mesh parts per MPI rank. Non-integral values\n"
             "are acceptable. For example, a value that is half-way between two\n"
@@ -271,6 +350,7 @@ static json_object *ProcessCommandLine(int argc, char *argv[], int *plugin_argi)
             "The maximum number of filesystem objects (e.g. files or subdirectories)\n"
             "that MACSio will create in any one subdirectory. This is typically\n"
             "relevant only in MIF mode because MIF mode can wind up generating many\n"
+            "files on each dump. If this option is not specified, MACSio\n"
             "will continue to create output files in the same directory until it has\n"
             "completed all dumps. Use a value of zero to force MACSio to put each\n"
             "dump in a separate directory but where the number of top-level directories\n"
@@ -284,7 +364,8 @@ static json_object *ProcessCommandLine(int argc, char *argv[], int *plugin_argi)
             "32 sub-dirs and each sub-dir containing 32 of the 1024 files for the\n"
             "dump. If more than 32 dumps are performed, then the dir-tree will really\n"
             "be 4 or more levels with the first 32 dumps' dir-trees going into the\n"
-            "first dir, etc.",
+            "first dir, etc. Files written by more than one dump, such as trickle\n"
+            "dump files, go in a dir-tree of their own in an all_dumps directory.",
 #ifdef HAVE_SCR
         "--exercise_scr", "",
             "Exercise the Scalable Checkpoint and Restart (SCR)\n"
@@ -304,6 +385,33 @@ static json_object *ProcessCommandLine(int argc, char *argv[], int *plugin_argi)
             "A rough lower bound on the number of seconds spent doing work between\n"
             "I/O phases. The type of work done is controlled by the --compute_work_intensity input\n"
             "and defaults to Level 1 (basic sleep).\n",
+        "--dump_mode %s", "sync",
+            "Specify how the main (burst) dumps are done. Use 'sync' to have\n"
+            "MACSio block in the plugin's dump function. Use 'thread' to have a\n"
+            "background writer thread do each dump from a snapshot of the problem\n"
+            "data while MACSio proceeds with the next compute phase. Thread mode\n"
+            "requires MPI_THREAD_MULTIPLE support from the MPI implementation. Use\n"
+            "'fork' to have each processor fork a child process to do each dump from\n"
+            "its copy-on-write image of the problem data. Fork mode is available\n"
+            "only with plugins whose dump needs no communication (e.g. miftmpl in\n"
+            "file-per-processor mode). Both modes are most meaningful with --compute_time.",
+        "--trickle_dump_interval %f", "0",
+            "Simulated time between the small, frequent (trickle) dumps done in\n"
+            "between the large (burst) dumps. When --compute_time is not given,\n"
+            "each cycle advances time by 1 so that a value of 0.25 will result in 4\n"
+            "trickle dumps for every burst dump. A value of zero, the default,\n"
+            "disables trickle dumps. Trickle dumps are supported only by plugins\n"
+            "that implement the trickle dump callback.",
+        "--trickle_dump_size %d", "1K",
+            "Number of bytes each processor writes in each trickle dump.",
+        "--io_accounting", "",
+            "Count the open, close, write, pwrite, writev, fsync and stat system\n"
+            "calls and the stdio fopen, fwrite, fprintf and fclose calls each\n"
+            "processor makes in each dump, including those made by the plugin's\n"
+            "I/O library, along with the time spent in them, the bytes written and\n"
+            "a histogram of write request sizes. Per-dump totals, the write\n"
+            "amplification and the fraction of small requests are then reported\n"
+            "in the log. Requires MACSio built with ENABLE_IOACCT.",
         "--debug_level %d", "0",
             "Set debugging level (1, 2 or 3) of log files. Higher numbers mean\n"
             "more frequent and detailed output. A value of zero, the default,\n"
@@ -323,6 +431,12 @@ static json_object *ProcessCommandLine(int argc, char *argv[], int *plugin_argi)
         "--timings_file_name %s", "macsio-timings.log",
             "Specify the name of the timings file. Passing an empty string, \"\"\n"
             "will disable the creation of a timings file.",
+        "--timer_clock %s", "auto",
+            "Clock timers read. Options are 'monotonic_raw' (clock_gettime with\n"
+            "CLOCK_MONOTONIC_RAW), 'mpi_wtime', 'gettimeofday', 'tsc' (the x86 time\n"
+            "stamp counter, calibrated at startup, if the processor's TSC is invariant)\n"
+            "and 'auto'. 'auto' selects 'monotonic_raw' where available. An unavailable\n"
+            "clock falls back to 'auto'. The clock used is recorded in the timings file.",
         MACSIO_CLARGS_ARG_GROUP_END(Log File Options),
         "--alignment %d", MACSIO_CLARGS_NODEFAULT,
             "Not currently documented",
@@ -380,23 +494,32 @@ static json_object *ProcessCommandLine(int argc, char *argv[], int *plugin_argi)
 static void
 write_timings_file(char const *filename)
 {
-    char **timer_strs = 0, **rtimer_strs = 0;
-    int i, ntimers, maxlen, rntimers = 0, rmaxlen = 0, rdata[3], rdata_out[3];
+    char **timer_strs = 0, **rtimer_strs = 0, **rtree_strs = 0;
+    int i, ntimers, maxlen, rntimers = 0, rmaxlen = 0, rntree = 0, rtreemaxlen = 0;
+    int rdata[3], rdata_out[3];
     MACSIO_LOG_LogHandle_t *timing_log;
 
     MACSIO_TIMING_DumpTimersToStrings(MACSIO_TIMING_ALL_GROUPS, &timer_strs, &ntimers, &maxlen);
     MACSIO_TIMING_ReduceTimers(MACSIO_MAIN_Comm, 0);
     if (MACSIO_MAIN_Rank == 0)
+    {
         MACSIO_TIMING_DumpReducedTimersToStrings(MACSIO_TIMING_ALL_GROUPS, &rtimer_strs, &rntimers, &rmaxlen);
+        MACSIO_TIMING_DumpReducedCallTreeToStrings(&rtree_strs, &rntree, &rtreemaxlen);
+        if (rtreemaxlen > rmaxlen) rmaxlen = rtreemaxlen;
+    }
     rdata[0] = maxlen > rmaxlen ? maxlen : rmaxlen;
     rdata[1] = ntimers;
-    rdata[2] = rntimers;
+    rdata[2] = rntimers + rntree + 1;
 #ifdef HAVE_MPI
     MPI_Allreduce(rdata, rdata_out, 3, MPI_INT, MPI_MAX, MACSIO_MAIN_Comm);
 #endif
 
     /* add 32 chars to line len for log leader */
-    timing_log = MACSIO_LOG_LogInit(MACSIO_MAIN_Comm, filename, rdata_out[0]+32, rdata_out[1], rdata_out[2]+1);
+    timing_log = MACSIO_LOG_LogInit(MACSIO_MAIN_Comm, filename, rdata_out[0]+32, rdata_out[1], rdata_out[2]+2);
+
+    if (MACSIO_MAIN_Rank == 0)
+        MACSIO_LOG_LogMsg(timing_log, "Timer clock: %s, resolution %g seconds",
+            MACSIO_TIMING_GetClockName(), MACSIO_TIMING_GetClockResolution());
 
     /* dump this processor's timers */
     for (i = 0; i < ntimers; i++)
@@ -419,19 +542,408 @@ write_timings_file(char const *filename)
             free(rtimer_strs[i]);
         }
         free(rtimer_strs);
+
+        MACSIO_LOG_LogMsg(timing_log, "Reduced Call Tree (INCL/EXCL are per rank means)...");
+
+        for (i = 0; i < rntree; i++)
+        {
+            MACSIO_LOG_MSGL(timing_log, Info, (rtree_strs[i]));
+            free(rtree_strs[i]);
+        }
+        free(rtree_strs);
     }
 
     MACSIO_LOG_LogFinalize(timing_log);
 }
 
+typedef struct _rank_time_t
+{
+    double dt;
+    int rank;
+} rank_time_t;
+
+static int
+compare_rank_times(void const *a, void const *b)
+{
+    double dta = ((rank_time_t const *) a)->dt;
+    double dtb = ((rank_time_t const *) b)->dt;
+    if (dta < dtb) return -1;
+    if (dta > dtb) return 1;
+    return 0;
+}
+
+/* nearest-rank percentile of n sorted times */
+static double
+percentile(rank_time_t const *sorted, int n, double p)
+{
+    int i = (int) ceil(p * n) - 1;
+    if (i < 0) i = 0;
+    if (i >= n) i = n - 1;
+    return sorted[i].dt;
+}
+
+/* Reduce the per-rank timing of a dump to the true aggregate bandwidth (global bytes
+   over the time from the first rank's start to the last rank's finish) and the
+   distribution of per-rank dump times including the ids of the slowest ranks.
+   Also sums the sizes of the files of the dump which each task has stat'd.
+   Collective. Returns the dump's total file size on all tasks. Like 'Last finisher -
+   First starter' below, this relies on MACSIO_TIMING_SyncClock() having aligned
+   MT_Time() across ranks. */
+static unsigned long long
+report_dump(int dumpNum, unsigned long long nbytes, unsigned long long stat_bytes,
+    double start, double timer_dt)
+{
+    char nbytes_str[32], seconds_str[32], bandwidth_str[32];
+    char min_str[32], med_str[32], p95_str[32], max_str[32];
+    char slowest_str[MACSIO_MAIN_NUM_SLOWEST*48] = "";
+    unsigned long long bytes[2] = {nbytes, stat_bytes};
+    unsigned long long global_bytes[2] = {nbytes, stat_bytes};
+    double finish = start + timer_dt;
+    double first_start = start, last_finish = finish;
+    rank_time_t my_time = {timer_dt, MACSIO_MAIN_Rank};
+    rank_time_t *all_times = 0;
+    int i, n = MACSIO_MAIN_Size;
+
+    if (MACSIO_MAIN_Rank == 0)
+        all_times = (rank_time_t *) malloc(n * sizeof(rank_time_t));
+
+#ifdef HAVE_MPI
+    MPI_Allreduce(bytes, global_bytes, 2, MPI_UNSIGNED_LONG_LONG, MPI_SUM, dump_report_comm);
+    {
+        /* min of start is max of -start so both ends are reduced at once */
+        double ends[2] = {-start, finish}, global_ends[2] = {-start, finish};
+        MPI_Reduce(ends, global_ends, 2, MPI_DOUBLE, MPI_MAX, 0, dump_report_comm);
+        first_start = -global_ends[0];
+        last_finish = global_ends[1];
+    }
+    MPI_Gather(&my_time, sizeof(my_time), MPI_BYTE, all_times, sizeof(my_time), MPI_BYTE, 0, dump_report_comm);
+#else
+    all_times[0] = my_time;
+#endif
+
+    if (MACSIO_MAIN_Rank != 0)
+        return global_bytes[1];
+
+    qsort(all_times, n, sizeof(rank_time_t), compare_rank_times);
+    for (i = 0; i < MACSIO_MAIN_NUM_SLOWEST && i < n; i++)
+    {
+        char tmp[48];
+        snprintf(tmp, sizeof(tmp), "%s%d (%s)", i ? ", " : "", all_times[n-1-i].rank,
+            MU_PrSecs(all_times[n-1-i].dt, 0, seconds_str, sizeof(seconds_str)));
+        strncat(slowest_str, tmp, sizeof(slowest_str) - strlen(slowest_str) - 1);
+    }
+
+    MACSIO_LOG_MSG(Info, ("Dump %02d Aggregate BW: %s/%s = %s", dumpNum,
+        MU_PrByts(global_bytes[0], 0, nbytes_str, sizeof(nbytes_str)),
+        MU_PrSecs(last_finish - first_start, 0, seconds_str, sizeof(seconds_str)),
+        MU_PrBW(global_bytes[0], last_finish - first_start, 0, bandwidth_str, sizeof(bandwidth_str))));
+    MACSIO_LOG_MSG(Info, ("Dump %02d Aggregate Stat BW: %s/%s = %s", dumpNum,
+        MU_PrByts(global_bytes[1], 0, nbytes_str, sizeof(nbytes_str)),
+        MU_PrSecs(last_finish - first_start, 0, seconds_str, sizeof(seconds_str)),
+        MU_PrBW(global_bytes[1], last_finish - first_start, 0, bandwidth_str, sizeof(bandwidth_str))));
+    MACSIO_LOG_MSG(Info, ("Dump %02d Rank times: min %s, median %s, p95 %s, max %s; slowest ranks %s", dumpNum,
+        MU_PrSecs(all_times[0].dt, 0, min_str, sizeof(min_str)),
+        MU_PrSecs(percentile(all_times, n, 0.50), 0, med_str, sizeof(med_str)),
+        MU_PrSecs(percentile(all_times, n, 0.95), 0, p95_str, sizeof(p95_str)),
+        MU_PrSecs(all_times[n-1].dt, 0, max_str, sizeof(max_str)),
+        slowest_str));
+
+    free(all_times);
+
+    return global_bytes[1];
+}
+
+/* Reduce the system call level I/O counts of a dump and report the true volume
+   of data written, the write amplification relative to both the JSON object
+   bytes and the dump's total file size and the fraction of small requests.
+   Collective. */
+static void
+report_dump_io(int dumpNum, unsigned long long nbytes, unsigned long long file_bytes)
+{
+    char bytes_str[32], seconds_str[32], hist_str[MACSIO_IOACCT_NUM_BUCKETS*24] = "";
+    MACSIO_IOACCT_Counts_t counts, global_counts;
+    unsigned long long buf[sizeof(counts)/sizeof(unsigned long long)+1];
+    unsigned long long global_buf[sizeof(counts)/sizeof(unsigned long long)+1];
+    unsigned long long written = 0, requests = 0, small = 0, nsecs = 0;
+    int i, n = sizeof(counts)/sizeof(unsigned long long);
+
+    MACSIO_IOACCT_GetCounts(dumpNum, &counts);
+
+    for (i = MACSIO_IOACCT_WRITE; i <= MACSIO_IOACCT_FWRITE; i++)
+        written += counts.bytes[i];
+    for (i = 0; i < MACSIO_IOACCT_NUM_OPS; i++)
+        nsecs += counts.nsecs[i];
+    MACSIO_LOG_MSG(Info, ("Dump %02d I/O: %s in %llu write, %llu open, %llu stat calls; %s in I/O calls", dumpNum,
+        MU_PrByts(written, 0, bytes_str, sizeof(bytes_str)),
+        counts.ops[MACSIO_IOACCT_WRITE] + counts.ops[MACSIO_IOACCT_PWRITE] + counts.ops[MACSIO_IOACCT_WRITEV] +
+            counts.ops[MACSIO_IOACCT_FWRITE],
+        counts.ops[MACSIO_IOACCT_OPEN], counts.ops[MACSIO_IOACCT_STAT],
+        MU_PrSecs(nsecs * 1e-9, 0, seconds_str, sizeof(seconds_str))));
+
+    memcpy(buf, &counts, sizeof(counts));
+    buf[n] = nbytes;
+#ifdef HAVE_MPI
+    MPI_Reduce(buf, global_buf, n+1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, dump_report_comm);
+#else
+    memcpy(global_buf, buf, sizeof(buf));
+#endif
+
+    if (MACSIO_MAIN_Rank != 0)
+        return;
+
+    memcpy(&global_counts, global_buf, sizeof(global_counts));
+    written = 0;
+    for (i = MACSIO_IOACCT_WRITE; i <= MACSIO_IOACCT_FWRITE; i++)
+    {
+        written += global_counts.bytes[i];
+        requests += global_counts.ops[i];
+    }
+    for (i = 0; i < MACSIO_IOACCT_NUM_BUCKETS && (i == 0 || 1ULL<<(i-1) < MACSIO_IOACCT_SMALL_REQUEST); i++)
+        small += global_counts.reqSizes[i];
+
+    MACSIO_LOG_MSG(Info, ("Dump %02d Aggregate I/O: %s written in %llu requests; "
+        "write amplification %.3f of JSON bytes, %.3f of file bytes; %.1f%% of requests < %d bytes", dumpNum,
+        MU_PrByts(written, 0, bytes_str, sizeof(bytes_str)), requests,
+        global_buf[n] ? (double) written / global_buf[n] : 0.0,
+        file_bytes ? (double) written / file_bytes : 0.0,
+        requests ? 100.0 * small / requests : 0.0, MACSIO_IOACCT_SMALL_REQUEST));
+
+    for (i = 0; i < MACSIO_IOACCT_NUM_OPS; i++)
+    {
+        if (!global_counts.ops[i]) continue;
+        MACSIO_LOG_MSG(Info, ("Dump %02d Aggregate I/O: %-6s %llu calls, %s, %s",
+            dumpNum, MACSIO_IOACCT_OpName(i), global_counts.ops[i],
+            MU_PrByts(global_counts.bytes[i], 0, bytes_str, sizeof(bytes_str)),
+            MU_PrSecs(global_counts.nsecs[i] * 1e-9, 0, seconds_str, sizeof(seconds_str))));
+    }
+
+    for (i = 0; i < MACSIO_IOACCT_NUM_BUCKETS; i++)
+    {
+        char tmp[24];
+        if (!global_counts.reqSizes[i]) continue;
+        snprintf(tmp, sizeof(tmp), " <2^%d:%llu", i, global_counts.reqSizes[i]);
+        strncat(hist_str, tmp, sizeof(hist_str) - strlen(hist_str) - 1);
+    }
+    if (requests)
+        MACSIO_LOG_MSG(Info, ("Dump %02d Aggregate I/O request sizes:%s", dumpNum, hist_str));
+}
+
+/* Collective. Called outside of the dump timers so that the stat'ing of files
+   is not included in them. Returns the dump's total file size. */
+static unsigned long long
+log_dump_bw(int dumpNum, unsigned long long nbytes, double start, double timer_dt)
+{
+    char nbytes_str[32], seconds_str[32], bandwidth_str[32];
+    unsigned long long file_bytes;
+
+    /* log dump timing */ // THE VOLUME OF DATA WRITTEN TO FILE =/= SIZE OF JSON PROBLEM OBJECT
+    MACSIO_LOG_MSG(Info, ("Dump %02d BW: %s/%s = %s", dumpNum,
+            MU_PrByts(nbytes, 0, nbytes_str, sizeof(nbytes_str)),
+            MU_PrSecs(timer_dt, 0, seconds_str, sizeof(seconds_str)),
+            MU_PrBW(nbytes, timer_dt, 0, bandwidth_str, sizeof(bandwidth_str))));
+
+    file_bytes = report_dump(dumpNum, nbytes, MACSIO_UTILS_StatFiles(dumpNum), start, timer_dt);
+
+    if (MACSIO_IOACCT_Enabled())
+        report_dump_io(dumpNum, nbytes, file_bytes);
+
+    return file_bytes;
+}
+
+/* Account for an asynchronous dump that has drained. The drain time is recorded
+   in the 'heavy dump drain' timer. The visible time is already in 'heavy dump'. */
+static unsigned long long
+log_async_dump(MACSIO_ASYNC_DumpInfo_t const *info, unsigned long long nbytes,
+    MACSIO_TIMING_GroupMask_t gmask, double *drainTime, double *hiddenTime)
+{
+    char snap_str[32], drain_str[32], wait_str[32], hidden_str[32];
+    double hidden_dt = info->drainTime - info->waitTime;
+
+    if (hidden_dt < 0) hidden_dt = 0;
+
+    MT_RecordTimer("heavy dump drain", gmask, info->dumpNum, info->drainTime);
+
+    MACSIO_LOG_MSG(Info, ("Dump %02d async: snapshot %s, drain %s, waited %s, hidden %s", info->dumpNum,
+            MU_PrSecs(info->snapshotTime, 0, snap_str, sizeof(snap_str)),
+            MU_PrSecs(info->drainTime, 0, drain_str, sizeof(drain_str)),
+            MU_PrSecs(info->waitTime, 0, wait_str, sizeof(wait_str)),
+            MU_PrSecs(hidden_dt, 0, hidden_str, sizeof(hidden_str))));
+    if (info->parentFaults || info->childFaults)
+        MACSIO_LOG_MSG(Info, ("Dump %02d fork: page faults parent %ld, child %ld", info->dumpNum,
+            info->parentFaults, info->childFaults));
+    *drainTime += info->drainTime;
+    *hiddenTime += hidden_dt;
+
+    return log_dump_bw(info->dumpNum, nbytes, info->drainStart, info->drainTime);
+}
+
+/* MACSIO_MIF group layout named by --mif_group_layout */
 static int
-main_write(int argi, int argc, char **argv, json_object *main_obj)
+mif_group_layout(char const *name)
+{
+    if (!strcmp(name, "contiguous"))  return MACSIO_MIF_LAYOUT_CONTIGUOUS;
+    if (!strcmp(name, "round_robin")) return MACSIO_MIF_LAYOUT_ROUND_ROBIN;
+    if (!strcmp(name, "node_packed")) return MACSIO_MIF_LAYOUT_NODE_PACKED;
+    if (!strcmp(name, "node_spread")) return MACSIO_MIF_LAYOUT_NODE_SPREAD;
+    MACSIO_LOG_MSG(Die, ("Unknown MIF group layout \"%s\"", name));
+    return MACSIO_MIF_LAYOUT_CONTIGUOUS;
+}
+
+/* Parallel file mode name whether or not it was given with a file count */
+static char const *
+parallel_file_mode_name(json_object *main_obj)
+{
+    json_object *parfmode_obj = json_object_path_get_array(main_obj, "clargs/parallel_file_mode");
+    if (parfmode_obj)
+        return json_object_get_string(json_object_array_get_idx(parfmode_obj, 0));
+    return json_object_path_get_string(main_obj, "clargs/parallel_file_mode");
+}
+
+/* Replace the parallel file mode with MIF mode and the given file count */
+static void
+set_mif_file_count(json_object *main_obj, int numFiles)
+{
+    json_object *parfmode_obj = json_object_new_array();
+    json_object_array_add(parfmode_obj, json_object_new_string("MIF"));
+    json_object_array_add(parfmode_obj, json_object_new_int(numFiles));
+    json_object_object_add(json_object_path_get_object(main_obj, "clargs"), "parallel_file_mode", parfmode_obj);
+}
+
+/* Least squares fit of y = a*x^2 + b*x + c. Returns non-zero if the fit is singular. */
+static int
+fit_quadratic(double const *x, double const *y, int n, double *a, double *b, double *c)
+{
+    double s[5] = {0, 0, 0, 0, 0}, t[3] = {0, 0, 0}, det;
+    int i, k;
+
+    for (i = 0; i < n; i++)
+    {
+        double xp = 1;
+        for (k = 0; k < 5; k++)
+        {
+            s[k] += xp;
+            if (k < 3) t[k] += xp * y[i];
+            xp *= x[i];
+        }
+    }
+
+    /* Cramer's rule on the normal equations */
+    det = s[4]*(s[2]*s[0] - s[1]*s[1]) - s[3]*(s[3]*s[0] - s[1]*s[2]) + s[2]*(s[3]*s[1] - s[2]*s[2]);
+    if (fabs(det) < DBL_EPSILON)
+        return 1;
+    *a = (t[2]*(s[2]*s[0] - s[1]*s[1]) - s[3]*(t[1]*s[0] - s[1]*t[0]) + s[2]*(t[1]*s[1] - s[2]*t[0])) / det;
+    *b = (s[4]*(t[1]*s[0] - t[0]*s[1]) - t[2]*(s[3]*s[0] - s[1]*s[2]) + s[2]*(s[3]*t[0] - t[1]*s[2])) / det;
+    *c = (s[4]*(s[2]*t[0] - s[1]*t[1]) - s[3]*(s[3]*t[0] - t[1]*s[2]) + t[2]*(s[3]*s[1] - s[2]*s[2])) / det;
+    return 0;
+}
+
+/* Choose the MIF file count by trial for MIFAUTO/MIFOPT mode. Does one trial dump at
+   each of up to nprobes file counts spaced geometrically between 1 and the number of
+   tasks, fits a quadratic in log2(file count) to the aggregate bandwidths and returns
+   the count at the fit's maximum. If the fit has no maximum, returns the count of the
+   best trial. Trials are numbered from first_probe_dump so that their files do not
+   collide with those of the real dumps and their files are removed. Collective. */
+static int
+autotune_mif_file_count(MACSIO_IFACE_Handle_t const *iface, int argi, int argc, char **argv,
+    json_object *main_obj, int first_probe_dump, int nprobes, unsigned long long problem_nbytes,
+    MACSIO_TIMING_GroupMask_t gmask)
+{
+    char nbytes_str[32], seconds_str[32], bandwidth_str[32];
+    int *counts = (int *) malloc(nprobes * sizeof(int));
+    double *xs = (double *) malloc(nprobes * sizeof(double));
+    double *bws = (double *) malloc(nprobes * sizeof(double));
+    unsigned long long global_nbytes = problem_nbytes;
+    int i, n = 0, best = 0, numFiles;
+    double a, b, c;
+
+#ifdef HAVE_MPI
+    MPI_Allreduce(&problem_nbytes, &global_nbytes, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, dump_report_comm);
+#endif
+
+    for (i = 0; i < nprobes; i++)
+    {
+        int count = nprobes > 1 ? (int) (pow(MACSIO_MAIN_Size, (double) i / (nprobes-1)) + 0.5) : MACSIO_MAIN_Size;
+        if (n && count == counts[n-1]) continue;
+        counts[n++] = count;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        MACSIO_TIMING_TimerId_t tid;
+        double dt, max_dt;
+
+        set_mif_file_count(main_obj, counts[i]);
+#ifdef HAVE_MPI
+        MPI_Barrier(dump_report_comm);
+#endif
+        tid = MT_StartTimer("mif auto probe", gmask, i);
+        (*(iface->dumpFunc))(argi, argc, argv, main_obj, first_probe_dump+i, 0.0);
+#ifdef HAVE_MPI
+        mpi_errno = 0;
+#endif
+        errno = 0;
+        dt = max_dt = MT_StopTimer(tid);
+#ifdef HAVE_MPI
+        MPI_Allreduce(&dt, &max_dt, 1, MPI_DOUBLE, MPI_MAX, dump_report_comm);
+#endif
+        MACSIO_UTILS_RemoveFiles(first_probe_dump+i);
+
+        xs[i] = log2((double) counts[i]);
+        bws[i] = max_dt > 0 ? global_nbytes / max_dt : 0;
+        if (bws[i] > bws[best]) best = i;
+
+        MACSIO_LOG_MSG(Info, ("MIF auto probe %d: %d files, %s/%s = %s", i, counts[i],
+            MU_PrByts(global_nbytes, 0, nbytes_str, sizeof(nbytes_str)),
+            MU_PrSecs(max_dt, 0, seconds_str, sizeof(seconds_str)),
+            MU_PrBW(global_nbytes, max_dt, 0, bandwidth_str, sizeof(bandwidth_str))));
+    }
+
+    numFiles = counts[best];
+    if (n >= 3 && !fit_quadratic(xs, bws, n, &a, &b, &c) && a < 0)
+    {
+        double x = -b / (2*a);
+        if (x < xs[0]) x = xs[0];
+        if (x > xs[n-1]) x = xs[n-1];
+        numFiles = (int) (pow(2, x) + 0.5);
+        MACSIO_LOG_MSG(Info, ("MIF auto fit: BW = %g*x^2 + %g*x + %g where x = log2(files); "
+            "maximum %s at %d files", a, b, c,
+            MU_PrBW(a*x*x + b*x + c, 1.0, 0, bandwidth_str, sizeof(bandwidth_str)), numFiles));
+    }
+    else if (n >= 3)
+    {
+        MACSIO_LOG_MSG(Info, ("MIF auto fit has no maximum; using best probe"));
+    }
+    MACSIO_LOG_MSG(Info, ("MIF auto: chose %d files", numFiles));
+
+    free(counts);
+    free(xs);
+    free(bws);
+
+    return numFiles;
+}
+
+/* Summary of a main_write run used to compare interfaces. Byte counts
+   and wall time are valid only on rank 0. */
+typedef struct _main_write_result_t
+{
+    char interface[MACSIO_IFACE_MAX_NAME];
+    char label[256];               /* Set by caller to identify the run in reports */
+    int dumpCount;
+    unsigned long long dumpBytes;  /* JSON object bytes dumped by all tasks */
+    unsigned long long fileBytes;  /* Total size of all files of all dumps */
+    double dumpTime;               /* This task's total dump time */
+    double wallTime;               /* Last finisher - first starter */
+    double summedBW;               /* Sum over tasks of each task's BW */
+} main_write_result_t;
+
+static int
+main_write(int argi, int argc, char **argv, json_object *main_obj, main_write_result_t *result)
 {
     int rank = 0, dumpNum = 0, dumpCount = 0;
     unsigned long long problem_nbytes, dumpBytes = 0, summedBytes = 0;
     char nbytes_str[32], seconds_str[32], bandwidth_str[32];
     double dumpTime = 0;
-    double timer_dt;
+    double timer_dt = 0;
     double bandwidth, summedBandwidth;
     MACSIO_TIMING_GroupMask_t main_wr_grp = MACSIO_TIMING_GroupMask("main_write");
     double dump_loop_start, dump_loop_end;
@@ -439,8 +951,38 @@ main_write(int argi, int argc, char **argv, json_object *main_obj)
     int exercise_scr = JsonGetInt(main_obj, "clargs/exercise_scr");
     int work_intensity = JsonGetInt(main_obj, "clargs/compute_work_intensity");
     double work_dt = json_object_path_get_double(main_obj, "clargs/compute_time");
+    double trickle_dt = json_object_path_get_double(main_obj, "clargs/trickle_dump_interval");
+    int trickleNum = 0;
+    unsigned long long trickle_nbytes = 0, trickleBytes = 0;
+    double trickleTime = 0;
+    json_object *trickle_obj = 0;
+    MACSIO_TIMING_GroupMask_t main_tr_grp = MACSIO_TIMING_GroupMask("main_trickle");
+    MACSIO_ASYNC_Mode_t dump_mode = MACSIO_ASYNC_SYNC;
+    MACSIO_ASYNC_DumpInfo_t async_info;
+    int async_pending = 0;
+    unsigned long long async_nbytes = 0;
+    double asyncVisibleTime = 0, asyncDrainTime = 0, asyncHiddenTime = 0;
 
     /* Sanity check args */
+    if (!strcmp(json_object_path_get_string(main_obj, "clargs/dump_mode"), "thread"))
+        dump_mode = MACSIO_ASYNC_THREAD;
+    else if (!strcmp(json_object_path_get_string(main_obj, "clargs/dump_mode"), "fork"))
+        dump_mode = MACSIO_ASYNC_FORK;
+    else if (strcmp(json_object_path_get_string(main_obj, "clargs/dump_mode"), "sync"))
+        MACSIO_LOG_MSG(Warn, ("Unrecognized --dump_mode \"%s\"; using sync",
+            json_object_path_get_string(main_obj, "clargs/dump_mode")));
+#ifdef HAVE_MPI
+    if (dump_mode == MACSIO_ASYNC_THREAD && mpi_thread_level < MPI_THREAD_MULTIPLE)
+    {
+        MACSIO_LOG_MSG(Warn, ("MPI does not provide MPI_THREAD_MULTIPLE; using sync dump mode"));
+        dump_mode = MACSIO_ASYNC_SYNC;
+    }
+#endif
+    if (dump_mode != MACSIO_ASYNC_SYNC && exercise_scr)
+    {
+        MACSIO_LOG_MSG(Warn, ("Cannot exercise SCR with asynchronous dumps; using sync dump mode"));
+        dump_mode = MACSIO_ASYNC_SYNC;
+    }
 
     MACSIO_DATA_MakeRandomTable(100, 10000);
 
@@ -473,7 +1015,111 @@ main_write(int argi, int argc, char **argv, json_object *main_obj)
     dumpTime = 0.0;
     int total_dumps = json_object_path_get_int(main_obj, "clargs/num_dumps");
 
-    MACSIO_UTILS_CreateFileStore(total_dumps, 1);
+    /* The file count for MIFAUTO/MIFOPT is chosen by trial dumps numbered after the real ones */
+    int mif_auto_probes = 0;
+    json_object *parfmode_obj = 0;
+    if (!strcmp(parallel_file_mode_name(main_obj), "MIFAUTO") || !strcmp(parallel_file_mode_name(main_obj), "MIFOPT"))
+    {
+        mif_auto_probes = MU_MAX(JsonGetInt(main_obj, "clargs/mif_auto_probes"), 1);
+        parfmode_obj = json_object_get(json_object_path_get_any(main_obj, "clargs/parallel_file_mode"));
+    }
+
+    MACSIO_MIF_MaxConcurrentFiles = JsonGetInt(main_obj, "clargs/mif_max_concurrent");
+    MACSIO_MIF_GroupLayout = mif_group_layout(JsonGetStr(main_obj, "clargs/mif_group_layout"));
+    MACSIO_MIF_GroupReport = JsonGetInt(main_obj, "clargs/mif_group_report");
+    MACSIO_MSF_CbAggregators = JsonGetInt(main_obj, "clargs/msf_cb_aggregators");
+    MACSIO_MSF_CbBufferSize = JsonGetInt(main_obj, "clargs/msf_cb_buffer_size");
+    MACSIO_MSF_CbAlignment = JsonGetInt(main_obj, "clargs/msf_cb_align");
+
+    MACSIO_UTILS_CreateFileStore(total_dumps + mif_auto_probes, 1);
+    if (JsonGetInt(main_obj, "clargs/io_accounting"))
+    {
+#ifdef HAVE_IOACCT
+        MACSIO_IOACCT_Init(total_dumps);
+#else
+        MACSIO_LOG_MSG(Warn, ("MACSio was built without ENABLE_IOACCT; ignoring --io_accounting"));
+#endif
+    }
+    unsigned long long *dump_file_bytes = (unsigned long long *) calloc(total_dumps, sizeof(unsigned long long));
+
+#ifdef HAVE_MPI
+    MPI_Comm_dup(MACSIO_MAIN_Comm, &dump_report_comm);
+#endif
+
+    const MACSIO_IFACE_Handle_t *iface = MACSIO_IFACE_GetByName(
+        json_object_path_get_string(main_obj, "clargs/interface"));
+
+    if (!strcmp(json_object_path_get_string(main_obj, "clargs/fileext"),"")){
+        json_object_path_set_string(main_obj, "clargs/fileext", iface->ext);
+    }
+
+    if (dump_mode == MACSIO_ASYNC_FORK && !iface->dumpFuncForkable)
+    {
+        MACSIO_LOG_MSG(Warn, ("Interface \"%s\" cannot dump from a forked child; using sync dump mode", iface->name));
+        dump_mode = MACSIO_ASYNC_SYNC;
+    }
+
+    /* A forked child writes one file per task and cannot communicate. Group throttling
+       passes batons between groups, a group report gathers to rank 0 and computing a
+       group layout is collective. A layout only orders baton passing within groups anyway. */
+    if (dump_mode == MACSIO_ASYNC_FORK)
+    {
+        if (0 < MACSIO_MIF_MaxConcurrentFiles && MACSIO_MIF_MaxConcurrentFiles < MACSIO_MAIN_Size)
+        {
+            MACSIO_LOG_MSG(Warn, ("Cannot throttle dumps from forked children; ignoring --mif_max_concurrent"));
+            MACSIO_MIF_MaxConcurrentFiles = 0;
+        }
+        if (MACSIO_MIF_GroupReport)
+        {
+            MACSIO_LOG_MSG(Warn, ("Cannot report groups of dumps from forked children; ignoring --mif_group_report"));
+            MACSIO_MIF_GroupReport = 0;
+        }
+        MACSIO_MIF_GroupLayout = MACSIO_MIF_LAYOUT_CONTIGUOUS;
+    }
+
+    if (mif_auto_probes && dump_mode == MACSIO_ASYNC_FORK)
+    {
+        MACSIO_LOG_MSG(Info, ("Using one file per task for dumps from forked children"));
+        set_mif_file_count(main_obj, MACSIO_MAIN_Size);
+    }
+    else if (mif_auto_probes)
+    {
+        set_mif_file_count(main_obj, autotune_mif_file_count(iface, argi, argc, argv, main_obj,
+            total_dumps, mif_auto_probes, problem_nbytes, main_wr_grp));
+    }
+
+    /* A forked child cannot pass batons. Catch this before forking rather than in a
+       child, which cannot abort the job. */
+    if (dump_mode == MACSIO_ASYNC_FORK)
+    {
+        int numFiles;
+        if (MACSIO_MIF_ParallelFileMode(main_obj, &numFiles) != MACSIO_MIF_MODE_MIF ||
+            numFiles != MACSIO_MAIN_Size)
+            MACSIO_LOG_MSG(Die, ("Dumps from forked children need file-per-processor mode "
+                "(e.g. --parallel_file_mode MIFMAX)"));
+    }
+
+    /* Async dumps must find the group layout and group report communicators cached;
+       creating them is collective on MACSIO_MAIN_Comm, which the main thread goes on
+       using during the dumps */
+    if (dump_mode != MACSIO_ASYNC_SYNC)
+    {
+        int numFiles;
+        if (MACSIO_MIF_ParallelFileMode(main_obj, &numFiles) != MACSIO_MIF_MODE_SIF)
+            MACSIO_MIF_PrepareLayout(numFiles, MACSIO_MAIN_Comm);
+    }
+
+    if (trickle_dt > 0 && !iface->trickleFunc)
+    {
+        MACSIO_LOG_MSG(Warn, ("Interface \"%s\" does not support trickle dumps; disabling them", iface->name));
+        trickle_dt = 0;
+    }
+    else if (trickle_dt > 0)
+    {
+        trickle_obj = MACSIO_DATA_GenerateTrickleObject(main_obj,
+            json_object_path_get_int(main_obj, "clargs/trickle_dump_size"));
+        trickle_nbytes = (unsigned long long) json_object_object_nbytes(trickle_obj, JSON_C_FALSE);
+    }
 
     double t;
     double maxT;
@@ -493,6 +1139,7 @@ main_write(int argi, int argc, char **argv, json_object *main_obj)
     dt = work_dt;
     maxT = total_dumps*dt;
     tNextBurstDump = dt;
+    tNextTrickleDump = trickle_dt;
     dumpNum = 0;
     t = 0;
 ////#warning THIS LOOP CURRENTLY JUST DOES A DUMP AFTER EVERY COMPUTE UP TO THE TOTAL NUMBER OF DUMPS. 
@@ -504,83 +1151,125 @@ main_write(int argi, int argc, char **argv, json_object *main_obj)
 
         if (t >= tNextBurstDump || !doWork){
             int scr_need_checkpoint_flag = 1;
-            MACSIO_TIMING_TimerId_t heavy_dump_tid;
+            MACSIO_TIMING_TimerId_t heavy_dump_tid = MACSIO_TIMING_INVALID_TIMER;
 #ifdef HAVE_SCR
             if (exercise_scr)
             SCR_Need_checkpoint(&scr_need_checkpoint_flag);
 #endif
 
-            const MACSIO_IFACE_Handle_t *iface = MACSIO_IFACE_GetByName(
-                json_object_path_get_string(main_obj, "clargs/interface"));
-
-            if (!strcmp(json_object_path_get_string(main_obj, "clargs/fileext"),"")){
-                json_object_path_set_string(main_obj, "clargs/fileext", iface->ext);
+            if (dump_mode != MACSIO_ASYNC_SYNC)
+            {
+                /* Visible cost of an async dump is draining the previous one plus the snapshot */
+                heavy_dump_tid = MT_StartTimer("heavy dump", main_wr_grp, dumpNum);
+                if (async_pending)
+                    MACSIO_ASYNC_FinishDump(&async_info);
+                MACSIO_ASYNC_StartDump(dump_mode, iface, argi, argc, argv, main_obj, dumpNum, dumpTime);
+                timer_dt = MT_StopTimer(heavy_dump_tid);
+                asyncVisibleTime += timer_dt;
+
+                if (async_pending)
+                {
+                    dump_file_bytes[async_info.dumpNum] =
+                        log_async_dump(&async_info, async_nbytes, main_wr_grp, &asyncDrainTime, &asyncHiddenTime);
+                    dumpTime += async_info.drainTime;
+                    dumpBytes += async_nbytes;
+                    dumpCount += 1;
+                }
+                async_pending = 1;
+                async_nbytes = problem_nbytes;
             }
-
-            /* log dump start */
-            if (!exercise_scr || scr_need_checkpoint_flag){                
+            else
+            {
+                /* log dump start */
+                if (!exercise_scr || scr_need_checkpoint_flag){
 #ifdef HAVE_SCR
-                int scr_valid = 0;
-                if (exercise_scr)
-                    SCR_Start_checkpoint();
+                    int scr_valid = 0;
+                    if (exercise_scr)
+                        SCR_Start_checkpoint();
 #endif
 
-                /* Start dump timer */
-                heavy_dump_tid = MT_StartTimer("heavy dump", main_wr_grp, dumpNum);
+                    /* Start dump timer */
+                    heavy_dump_tid = MT_StartTimer("heavy dump", main_wr_grp, dumpNum);
 ////#warning REPLACE DUMPN AND DUMPT WITH A STATE TUPLE
-                /* do the dump */
-                //MACSIO_BurstDump(dt);
+                    /* do the dump */
+                    //MACSIO_BurstDump(dt);
 
-                
-                (*(iface->dumpFunc))(argi, argc, argv, main_obj, dumpNum, dumpTime);
+                    MACSIO_IOACCT_BeginDump(dumpNum);
+                    (*(iface->dumpFunc))(argi, argc, argv, main_obj, dumpNum, dumpTime);
+                    MACSIO_IOACCT_EndDump();
 #ifdef HAVE_MPI
-                mpi_errno = 0;
+                    mpi_errno = 0;
 #endif
-                errno = 0;
+                    errno = 0;
 
-                timer_dt = MT_StopTimer(heavy_dump_tid);
+                    timer_dt = MT_StopTimer(heavy_dump_tid);
 
 #ifdef HAVE_SCR
-                if (exercise_scr)
-                    SCR_Complete_checkpoint(scr_valid);
+                    if (exercise_scr)
+                        SCR_Complete_checkpoint(scr_valid);
 #endif
+
+                    /* SCR_Need_checkpoint gives all tasks the same answer. So, they all
+                       agree on whether to do this collective report. */
+                    dumpTime += timer_dt;
+                    dumpBytes += problem_nbytes;
+                    dumpCount += 1;
+
+                    dump_file_bytes[dumpNum] = log_dump_bw(dumpNum, problem_nbytes,
+                        MACSIO_TIMING_GetTimerDatum(heavy_dump_tid, "start_time"), timer_dt);
+                }
             }
 
-            /* stop timer */
-            dumpTime += timer_dt;
-            dumpBytes += problem_nbytes;
-            dumpCount += 1;
-
-            /* log dump timing */ // THE VOLUME OF DATA WRITTEN TO FILE =/= SIZE OF JSON PROBLEM OBJECT
-            MACSIO_LOG_MSG(Info, ("Dump %02d BW: %s/%s = %s", dumpNum,
-                    MU_PrByts(problem_nbytes, 0, nbytes_str, sizeof(nbytes_str)),
-                    MU_PrSecs(timer_dt, 0, seconds_str, sizeof(seconds_str)),
-                    MU_PrBW(problem_nbytes, timer_dt, 0, bandwidth_str, sizeof(bandwidth_str))));
-            unsigned long long stat_bytes = MACSIO_UTILS_StatFiles(dumpNum);
-            MACSIO_LOG_MSG(Info, ("Dump %02d Stat BW: %s/%s = %s", dumpNum,
-                    MU_PrByts(stat_bytes, 0, nbytes_str, sizeof(nbytes_str)),
-                    MU_PrSecs(timer_dt, 0, seconds_str, sizeof(seconds_str)),
-                    MU_PrBW(stat_bytes, timer_dt, 0, bandwidth_str, sizeof(bandwidth_str))));
-    
             dumpNum++;
             tNextBurstDump += dt;
 
-            if (factor > 1.0){
-                unsigned long long prev_bytes = MACSIO_UTILS_StatFiles(dumpNum-1);
+            /* An async dump's files are incomplete until it drains. So, in that
+               case, growth is based on the most recent dump that has drained. */
+            int growth_dump = dump_mode != MACSIO_ASYNC_SYNC ? (dumpNum > 1 ? dumpNum-2 : -1) : dumpNum-1;
+            if (factor > 1.0 && growth_dump >= 0){
+                /* this task's share of the previous dump's total file size */
+                unsigned long long prev_bytes = dump_file_bytes[growth_dump] / MACSIO_MAIN_Size;
                 int growth_bytes = (prev_bytes*factor) - prev_bytes;
                 if (growth_bytes > 0)
                     MACSIO_DATA_EvolveDataset(main_obj, &dataset_evolved, factor, growth_bytes);
             }
         } /* end of burst dump loop */
 
-        if (t >= tNextTrickleDump){
-        /* MACSIO_TrickleDump(dt); */
+        /* Do all the trickle dumps that came due since the last cycle */
+        while (trickle_dt > 0 && t >= tNextTrickleDump){
+            MACSIO_TIMING_TimerId_t trickle_dump_tid;
+
+            trickle_dump_tid = MT_StartTimer("trickle dump", main_tr_grp, trickleNum);
+
+            (*(iface->trickleFunc))(argi, argc, argv, main_obj, trickle_obj, trickleNum, tNextTrickleDump);
+#ifdef HAVE_MPI
+            mpi_errno = 0;
+#endif
+            errno = 0;
+
+            trickleTime += MT_StopTimer(trickle_dump_tid);
+            trickleBytes += trickle_nbytes;
+            trickleNum++;
+            tNextTrickleDump += trickle_dt;
         } /*end of trickle dump loop */
 
         /* Increase the timestep if we aren't using the work routine to do so */
         if (!doWork) t++;
     } /* end of timetep loop */
 
+    /* Drain the last asynchronous dump */
+    if (async_pending)
+    {
+        MACSIO_TIMING_TimerId_t drain_tid = MT_StartTimer("heavy dump final drain", main_wr_grp, dumpNum-1);
+        MACSIO_ASYNC_FinishDump(&async_info);
+        asyncVisibleTime += MT_StopTimer(drain_tid);
+        dump_file_bytes[async_info.dumpNum] =
+            log_async_dump(&async_info, async_nbytes, main_wr_grp, &asyncDrainTime, &asyncHiddenTime);
+        dumpTime += async_info.drainTime;
+        dumpBytes += async_nbytes;
+        dumpCount += 1;
+    }
+
     dump_loop_end = MT_Time();
 
     MACSIO_LOG_MSG(Info, ("Overall BW: %s/%s = %s",
@@ -588,6 +1277,25 @@ main_write(int argi, int argc, char **argv, json_object *main_obj)
         MU_PrSecs(dumpTime, 0, seconds_str, sizeof(seconds_str)),
         MU_PrBW(dumpBytes, dumpTime, 0, bandwidth_str, sizeof(bandwidth_str))));
 
+    if (dump_mode != MACSIO_ASYNC_SYNC)
+    {
+        char visible_str[32], hidden_str[32];
+        MACSIO_LOG_MSG(Info, ("Async dumps: visible %s, drain %s, hidden %s (%.1f%% of drain)",
+            MU_PrSecs(asyncVisibleTime, 0, visible_str, sizeof(visible_str)),
+            MU_PrSecs(asyncDrainTime, 0, seconds_str, sizeof(seconds_str)),
+            MU_PrSecs(asyncHiddenTime, 0, hidden_str, sizeof(hidden_str)),
+            asyncDrainTime > 0 ? 100.0 * asyncHiddenTime / asyncDrainTime : 0.0));
+    }
+    if (trickleNum)
+    {
+        MACSIO_LOG_MSG(Info, ("Trickle BW (%d dumps): %s/%s = %s", trickleNum,
+            MU_PrByts(trickleBytes, 0, nbytes_str, sizeof(nbytes_str)),
+            MU_PrSecs(trickleTime, 0, seconds_str, sizeof(seconds_str)),
+            MU_PrBW(trickleBytes, trickleTime, 0, bandwidth_str, sizeof(bandwidth_str))));
+    }
+    if (trickle_obj)
+        json_object_put(trickle_obj);
+
     bandwidth = dumpBytes / dumpTime;
     summedBandwidth = bandwidth;
     min_dump_loop_start = dump_loop_start;
@@ -609,11 +1317,41 @@ main_write(int argi, int argc, char **argv, json_object *main_obj)
             MU_PrByts(summedBytes, 0, nbytes_str, sizeof(nbytes_str)),
             MU_PrSecs(max_dump_loop_end - min_dump_loop_start, 0, seconds_str, sizeof(seconds_str)),
             MU_PrBW(summedBytes, max_dump_loop_end - min_dump_loop_start, 0, bandwidth_str, sizeof(bandwidth_str))));
+
+        /* file sizes were already reduced dump by dump; no need to stat them again */
+        unsigned long long file_bytes = 0;
+        for (int j=0; j<total_dumps; j++)
+            file_bytes += dump_file_bytes[j];
+        MACSIO_LOG_MSG(Info, ("Total File Bytes: %s; Last finisher - First starter = %s; BW = %s",
+            MU_PrByts(file_bytes, 0, nbytes_str, sizeof(nbytes_str)),
+            MU_PrSecs(max_dump_loop_end - min_dump_loop_start, 0, seconds_str, sizeof(seconds_str)),
+            MU_PrBW(file_bytes, max_dump_loop_end - min_dump_loop_start, 0, bandwidth_str, sizeof(bandwidth_str))));
+
+        if (result)
+        {
+            result->dumpBytes = summedBytes;
+            result->fileBytes = file_bytes;
+            result->wallTime = max_dump_loop_end - min_dump_loop_start;
+            result->summedBW = summedBandwidth;
+        }
     }
-    for (int j=0; j<total_dumps; j++){
-        MACSIO_UTILS_StatFiles(j);
+    if (result)
+    {
+        strncpy(result->interface, iface->name, sizeof(result->interface)-1);
+        result->dumpCount = dumpCount;
+        result->dumpTime = dumpTime;
     }
+    free(dump_file_bytes);
     MACSIO_UTILS_CleanupFileStore();
+    MACSIO_IOACCT_Finalize();
+
+    /* restore MIFAUTO/MIFOPT for any subsequent runs (e.g. of other interfaces) */
+    if (parfmode_obj)
+        json_object_object_add(json_object_path_get_object(main_obj, "clargs"), "parallel_file_mode", parfmode_obj);
+
+#ifdef HAVE_MPI
+    MPI_Comm_free(&dump_report_comm);
+#endif
 
     return (0);
 }
@@ -696,6 +1434,465 @@ static void FinalizeDefaultPRNGs()
     MACSIO_DATA_FinalizeDefaultPRNGs();
 }
 
+/* Log a side-by-side comparison of several main_write runs (e.g. of different
+   interfaces or of the sub-experiments of a sweep). Collective. */
+static void
+report_write_results(char const *title, main_write_result_t const *results, int n)
+{
+    double *times = (double *) malloc(3 * n * sizeof(double));
+    double *min_times = times, *max_times = times + n, *sum_times = times + 2*n;
+    int i;
+
+    for (i = 0; i < n; i++)
+        min_times[i] = max_times[i] = sum_times[i] = results[i].dumpTime;
+#ifdef HAVE_MPI
+    if (MACSIO_MAIN_Rank == 0)
+    {
+        MPI_Reduce(MPI_IN_PLACE, min_times, n, MPI_DOUBLE, MPI_MIN, 0, MACSIO_MAIN_Comm);
+        MPI_Reduce(MPI_IN_PLACE, max_times, n, MPI_DOUBLE, MPI_MAX, 0, MACSIO_MAIN_Comm);
+        MPI_Reduce(MPI_IN_PLACE, sum_times, n, MPI_DOUBLE, MPI_SUM, 0, MACSIO_MAIN_Comm);
+    }
+    else
+    {
+        MPI_Reduce(min_times, 0, n, MPI_DOUBLE, MPI_MIN, 0, MACSIO_MAIN_Comm);
+        MPI_Reduce(max_times, 0, n, MPI_DOUBLE, MPI_MAX, 0, MACSIO_MAIN_Comm);
+        MPI_Reduce(sum_times, 0, n, MPI_DOUBLE, MPI_SUM, 0, MACSIO_MAIN_Comm);
+    }
+#endif
+
+    if (MACSIO_MAIN_Rank == 0)
+    {
+        MACSIO_LOG_MSG(Info, ("%s (%d tasks):", title, MACSIO_MAIN_Size));
+        for (i = 0; i < n; i++)
+        {
+            char json_str[32], file_str[32], bw_str[32], fbw_str[32], sbw_str[32];
+            char min_str[32], avg_str[32], max_str[32];
+
+            MACSIO_LOG_MSG(Info, ("%2d %s: dumps %d, JSON %s, files %s, BW %s, file BW %s, summed BW %s, "
+                "dump time min %s, avg %s, max %s", i, results[i].label, results[i].dumpCount,
+                MU_PrByts(results[i].dumpBytes, 0, json_str, sizeof(json_str)),
+                MU_PrByts(results[i].fileBytes, 0, file_str, sizeof(file_str)),
+                MU_PrBW(results[i].dumpBytes, results[i].wallTime, 0, bw_str, sizeof(bw_str)),
+                MU_PrBW(results[i].fileBytes, results[i].wallTime, 0, fbw_str, sizeof(fbw_str)),
+                MU_PrBW(results[i].summedBW, 1.0, 0, sbw_str, sizeof(sbw_str)),
+                MU_PrSecs(min_times[i], 0, min_str, sizeof(min_str)),
+                MU_PrSecs(sum_times[i] / MACSIO_MAIN_Size, 0, avg_str, sizeof(avg_str)),
+                MU_PrSecs(max_times[i], 0, max_str, sizeof(max_str))));
+        }
+    }
+
+    free(times);
+}
+
+/* Write the timers of one of several main_write runs to a timings file of their
+   own, named by inserting a suffix before the extension of the timings file name,
+   and then clear them. Collective. */
+static void
+write_run_timings_file(json_object *main_obj, char const *suffix, MACSIO_TIMING_GroupMask_t main_grp)
+{
+    char const *timings_file_name = JsonGetStr(main_obj, "clargs/timings_file_name");
+
+    if (strlen(timings_file_name))
+    {
+        char filename[256];
+        char const *dot = strrchr(timings_file_name, '.');
+        int baselen = dot ? (int) (dot - timings_file_name) : (int) strlen(timings_file_name);
+
+        snprintf(filename, sizeof(filename), "%.*s-%s%s", baselen, timings_file_name,
+            suffix, dot ? dot : "");
+        write_timings_file(filename);
+    }
+    MACSIO_TIMING_ClearTimers(MACSIO_TIMING_ALL_GROUPS & ~main_grp);
+}
+
+/* Is argument a token introducing plugin args of an interface (e.g. 'hdf5:') */
+static int
+is_interface_args_token(char const *arg)
+{
+    int len = strlen(arg);
+    return len > 1 && arg[len-1] == ':' && (int) strspn(arg,
+        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_") == len-1;
+}
+
+/* Write to each interface in the --interfaces list in turn. Each interface gets
+   the main args plus the plugin args common to all interfaces and its own plugin args.
+   Its own args are matched to it by name. The k-th group of an interface listed more
+   than once goes to its k-th occurrence in the list.
+   The PRNGs are re-initialized before each one so that each sees the same problem.
+   Each interface's timers go to their own timings file and are then cleared. */
+static void
+main_compare_interfaces(int argi, int argc, char **argv, json_object *main_obj,
+    MACSIO_TIMING_GroupMask_t main_grp)
+{
+    char *names = strdup(JsonGetStr(main_obj, "clargs/interfaces"));
+    char *fileext = strdup(JsonGetStr(main_obj, "clargs/fileext"));
+    char suffix[MACSIO_IFACE_MAX_NAME+8];
+    char **ifaces = (char **) malloc((strlen(names)+1) * sizeof(char*));
+    char **sub_argv = (char **) malloc((argc+1) * sizeof(char*));
+    int *seg_beg, *seg_end;
+    int i, j, k, n = 0, cur = -1, common_end = argc;
+    char *tok;
+    main_write_result_t *results;
+
+    for (tok = strtok(names, ","); tok; tok = strtok(0, ","))
+    {
+        if (!MACSIO_IFACE_GetByName(tok))
+            MACSIO_LOG_MSG(Die, ("Unknown interface \"%s\" in --interfaces", tok));
+        ifaces[n++] = tok;
+    }
+    if (!n)
+        MACSIO_LOG_MSG(Die, ("No interfaces in --interfaces"));
+
+    /* find each interface's segment of the plugin args */
+    seg_beg = (int *) calloc(2*n, sizeof(int));
+    seg_end = seg_beg + n;
+    for (j = argi; j < argc; j++)
+    {
+        int len = strlen(argv[j]) - 1;
+
+        if (!is_interface_args_token(argv[j])) continue;
+
+        /* the first interface of that name without args yet */
+        for (k = 0; k < n; k++)
+        {
+            if (!seg_beg[k] && (int) strlen(ifaces[k]) == len && !strncmp(argv[j], ifaces[k], len))
+                break;
+        }
+        if (k == n)
+            MACSIO_LOG_MSG(Die, ("Plugin args \"%s\" are for no interface (or for more of it) "
+                "in --interfaces", argv[j]));
+
+        if (cur < 0)
+            common_end = j;
+        else
+            seg_end[cur] = j;
+        seg_beg[k] = j+1;
+        cur = k;
+    }
+    if (cur >= 0)
+        seg_end[cur] = argc;
+
+    results = (main_write_result_t *) calloc(n, sizeof(main_write_result_t));
+    for (i = 0; i < n; i++)
+    {
+        int sub_argc = 0;
+
+        MACSIO_LOG_MSG(Info, ("Interface %d of %d: \"%s\"", i+1, n, ifaces[i]));
+
+        for (j = 0; j < common_end; j++)
+            sub_argv[sub_argc++] = argv[j];
+        for (j = seg_beg[i]; j < seg_end[i]; j++)
+            sub_argv[sub_argc++] = argv[j];
+        sub_argv[sub_argc] = 0;
+
+        json_object_path_set_string(main_obj, "clargs/interface", ifaces[i]);
+        json_object_path_set_string(main_obj, "clargs/fileext", fileext);
+
+        FinalizeDefaultPRNGs();
+        InitializeDefaultPRNGs();
+
+        main_write(argi, sub_argc, sub_argv, main_obj, &results[i]);
+        strncpy(results[i].label, ifaces[i], sizeof(results[i].label)-1);
+
+        snprintf(suffix, sizeof(suffix), "%02d-%s", i, ifaces[i]);
+        write_run_timings_file(main_obj, suffix, main_grp);
+    }
+
+    report_write_results("Interface comparison on the same problem", results, n);
+
+    free(results);
+    free(seg_beg);
+    free(sub_argv);
+    free(ifaces);
+    free(fileext);
+    free(names);
+}
+
+/* Maximum number of parameters in a --sweep */
+#define MACSIO_MAIN_MAX_SWEEP_PARAMS 16
+
+typedef struct _sweep_param_t
+{
+    char const *name; /* name of main arg (without dashes) or "plugin_args" */
+    int nvals;
+    char **vals;
+} sweep_param_t;
+
+/* Main args used once per run, not per sub-experiment, which therefore cannot be swept */
+static char const *const unsweepable_args[] = {"sweep", "interfaces", "read_path",
+    "log_file_name", "log_line_length", "log_line_cnt"};
+
+/* A number in a sweep range with an optional size modifier character */
+static double
+sweep_number(char const *str)
+{
+    char *end;
+    double val = strtod(str, &end);
+    double base = strcmp(MACSIO_UTILS_UnitsPrefixSystem, "decimal") ? 1024 : 1000;
+
+    switch (*end)
+    {
+        case 'k': case 'K': return val * base;
+        case 'm': case 'M': return val * base * base;
+        case 'g': case 'G': return val * base * base * base;
+    }
+    return val;
+}
+
+static void
+add_sweep_value(sweep_param_t *param, char const *val)
+{
+    param->vals = (char **) realloc(param->vals, (param->nvals+1) * sizeof(char*));
+    param->vals[param->nvals++] = strdup(val);
+}
+
+/* Add one value of a sweep param expanding its last space-separated part if it is a range */
+static void
+expand_sweep_value(sweep_param_t *param, char const *val)
+{
+    char const *last = strrchr(val, ' ');
+    char const *range = last ? last+1 : val;
+    char const *c1 = strchr(range, ':'), *c2;
+    int prefix_len = range - val, geometric = 0, i;
+    double lo, hi, step = 1, x;
+
+    if (!c1 || !strcmp(param->name, "plugin_args"))
+    {
+        add_sweep_value(param, val);
+        return;
+    }
+
+    lo = sweep_number(range);
+    hi = sweep_number(c1+1);
+    if ((c2 = strchr(c1+1, ':')))
+    {
+        geometric = c2[1] == '*';
+        step = atof(c2[1] == '*' || c2[1] == '+' ? c2+2 : c2+1);
+    }
+    if (geometric ? (step <= 1 || lo <= 0) : step <= 0)
+        MACSIO_LOG_MSG(Die, ("Invalid sweep range \"%s\" for \"%s\"", val, param->name));
+
+    for (x = lo, i = 0; x <= hi * (1 + 1e-9); x = geometric ? x * step : lo + (++i) * step)
+    {
+        char tmp[256];
+        if (x == floor(x))
+            snprintf(tmp, sizeof(tmp), "%.*s%.0f", prefix_len, val, x);
+        else
+            snprintf(tmp, sizeof(tmp), "%.*s%g", prefix_len, val, x);
+        add_sweep_value(param, tmp);
+    }
+}
+
+/* Is this argv entry the name of a main arg being swept (or --sweep itself) */
+static int
+is_swept_arg(char const *arg, sweep_param_t const *params, int nparams)
+{
+    int i;
+    if (strncmp(arg, "--", 2)) return 0;
+    if (!strcmp(arg+2, "sweep")) return 1;
+    for (i = 0; i < nparams; i++)
+        if (!strcmp(arg+2, params[i].name)) return 1;
+    return 0;
+}
+
+/* Append space-separated tokens of a value to an argv */
+static void
+append_sweep_tokens(char *val, char **sub_argv, int *sub_argc)
+{
+    char *tok;
+    for (tok = strtok(val, " "); tok; tok = strtok(0, " "))
+        sub_argv[(*sub_argc)++] = tok;
+}
+
+/* Apply the clargs that set global state of MACSIO's packages rather than being read
+   by each dump. Called for the command-line and again for each sub-experiment of a
+   sweep. The clock is switched, and agreed on across tasks, only when another is asked
+   for. Collective on MACSIO_MAIN_Comm. */
+static void
+apply_global_clargs(json_object *clargs_obj)
+{
+    static char clock_name[64];
+    char const *clk = JsonGetStr(clargs_obj, "timer_clock");
+
+    strncpy(MACSIO_UTILS_UnitsPrefixSystem, JsonGetStr(clargs_obj, "units_prefix_system"),
+        sizeof(MACSIO_UTILS_UnitsPrefixSystem));
+
+////#warning THESE INITIALIZATIONS SHOULD BE IN MACSIO_LOG
+    MACSIO_LOG_DebugLevel = JsonGetInt(clargs_obj, "debug_level");
+
+    if (strcmp(clk, clock_name))
+    {
+        if (MACSIO_TIMING_SetClock(clk))
+            MACSIO_LOG_MSG(Warn, ("Timer clock \"%s\" is not available. Using \"%s\"",
+                clk, MACSIO_TIMING_GetClockName()));
+
+        /* Dump reports compare start and finish times of different tasks */
+        MACSIO_TIMING_SyncClock(MACSIO_MAIN_Comm);
+        snprintf(clock_name, sizeof(clock_name), "%s", clk);
+    }
+}
+
+/* Run every combination of the values of the --sweep params as a sub-experiment.
+   Each sub-experiment's command-line is the original one with the args being swept
+   replaced and is processed anew into the clargs of the main object. Global settings
+   such as --debug_level and --timer_clock are re-applied from them. The problem is
+   regenerated (by main_write) from re-initialized PRNGs and timers are written to a
+   timings file of the sub-experiment's own and then cleared. */
+static void
+main_sweep(int argi, int argc, char **argv, json_object *main_obj,
+    MACSIO_TIMING_GroupMask_t main_grp)
+{
+    json_object *clargs_obj = json_object_get(json_object_path_get_object(main_obj, "clargs"));
+    char *spec = strdup(JsonGetStr(main_obj, "clargs/sweep"));
+    char *specp = spec, *item;
+    sweep_param_t params[MACSIO_MAIN_MAX_SWEEP_PARAMS];
+    int i, j, k, nparams = 0, nexps = 1, main_end = argc, max_sub_argc = argc + 2;
+    main_write_result_t *results;
+
+    if (strcmp(JsonGetStr(main_obj, "clargs/interfaces"), "null"))
+        MACSIO_LOG_MSG(Die, ("--sweep and --interfaces cannot be combined; sweep 'interface' instead"));
+
+    memset(params, 0, sizeof(params));
+    while ((item = strsep(&specp, ";")))
+    {
+        char *vals = strchr(item, '='), *val;
+
+        if (!strlen(item)) continue;
+        if (!vals || nparams == MACSIO_MAIN_MAX_SWEEP_PARAMS)
+            MACSIO_LOG_MSG(Die, ("Invalid or too many (>%d) --sweep items at \"%s\"",
+                MACSIO_MAIN_MAX_SWEEP_PARAMS, item));
+        *vals++ = '\0';
+        for (j = 0; j < (int) (sizeof(unsweepable_args)/sizeof(unsweepable_args[0])); j++)
+        {
+            if (!strcmp(item, unsweepable_args[j]))
+                MACSIO_LOG_MSG(Die, ("\"%s\" cannot be swept", item));
+        }
+        params[nparams].name = item;
+        while ((val = strsep(&vals, ",")))
+            expand_sweep_value(&params[nparams], val);
+        for (j = 0; j < params[nparams].nvals; j++)
+            max_sub_argc += strlen(params[nparams].vals[j]) + 2;
+        nexps *= params[nparams].nvals;
+        nparams++;
+    }
+    if (!nparams)
+        MACSIO_LOG_MSG(Die, ("Empty --sweep"));
+
+    /* main args end where plugin args begin */
+    if (argi > 0 && argi <= argc && !strcmp(argv[argi-1], "--plugin_args"))
+        main_end = argi-1;
+
+    MACSIO_LOG_MSG(Info, ("Sweep of %d parameters in %d sub-experiments", nparams, nexps));
+
+    results = (main_write_result_t *) calloc(nexps, sizeof(main_write_result_t));
+    for (i = 0; i < nexps; i++)
+    {
+        char **sub_argv = (char **) malloc((max_sub_argc+1) * sizeof(char*));
+        char *vals[MACSIO_MAIN_MAX_SWEEP_PARAMS];
+        char dashes[MACSIO_MAIN_MAX_SWEEP_PARAMS][64];
+        int sub_argc = 0, sub_argi, rem = i;
+        char suffix[32];
+
+        /* the i-th combination of values with the last param varying fastest */
+        for (k = nparams-1; k >= 0; k--)
+        {
+            vals[k] = strdup(params[k].vals[rem % params[k].nvals]);
+            rem /= params[k].nvals;
+        }
+
+        for (k = 0; k < nparams; k++)
+        {
+            int len = strlen(results[i].label);
+            snprintf(results[i].label+len, sizeof(results[i].label)-len, "%s%s=%s",
+                k ? ", " : "", params[k].name, vals[k]);
+        }
+        MACSIO_LOG_MSG(Info, ("Sweep sub-experiment %d of %d: %s", i+1, nexps, results[i].label));
+
+        /* the original main args less any being swept, then the swept ones */
+        sub_argv[sub_argc++] = argv[0];
+        for (j = 1; j < main_end; j++)
+        {
+            if (is_swept_arg(argv[j], params, nparams))
+            {
+                while (j+1 < main_end && strncmp(argv[j+1], "--", 2)) j++;
+                continue;
+            }
+            sub_argv[sub_argc++] = argv[j];
+        }
+        for (k = 0; k < nparams; k++)
+        {
+            if (!strcmp(params[k].name, "plugin_args")) continue;
+            snprintf(dashes[k], sizeof(dashes[k]), "--%s", params[k].name);
+            sub_argv[sub_argc++] = dashes[k];
+            append_sweep_tokens(vals[k], sub_argv, &sub_argc);
+        }
+
+        /* then the original plugin args and any swept ones */
+        sub_argv[sub_argc++] = (char *) "--plugin_args";
+        for (j = main_end+1; j < argc; j++)
+            sub_argv[sub_argc++] = argv[j];
+        for (k = 0; k < nparams; k++)
+        {
+            if (strcmp(params[k].name, "plugin_args")) continue;
+            append_sweep_tokens(vals[k], sub_argv, &sub_argc);
+        }
+        sub_argv[sub_argc] = 0;
+
+        json_object_object_add(main_obj, "clargs", ProcessCommandLine(sub_argc, sub_argv, &sub_argi));
+        apply_global_clargs(json_object_path_get_object(main_obj, "clargs"));
+
+        FinalizeDefaultPRNGs();
+        InitializeDefaultPRNGs();
+
+        main_write(sub_argi, sub_argc, sub_argv, main_obj, &results[i]);
+
+        snprintf(suffix, sizeof(suffix), "sweep-%04d", i);
+        write_run_timings_file(main_obj, suffix, main_grp);
+
+        for (k = 0; k < nparams; k++)
+            free(vals[k]);
+        free(sub_argv);
+    }
+
+    report_write_results("Sweep summary", results, nexps);
+
+    /* restore the original clargs */
+    json_object_object_add(main_obj, "clargs", clargs_obj);
+    apply_global_clargs(clargs_obj);
+
+    free(results);
+    for (k = 0; k < nparams; k++)
+    {
+        for (j = 0; j < params[k].nvals; j++)
+            free(params[k].vals[j]);
+        free(params[k].vals);
+    }
+    free(spec);
+}
+
+/* Could any run of this command-line do threaded dumps, either by --dump_mode or by
+   a --sweep item of dump_mode (e.g. "dump_mode=sync,thread")? Scans raw argv because
+   MPI thread support must be requested before the args can be processed. */
+static int
+thread_dumps_requested(int argc, char **argv)
+{
+    int i;
+
+    for (i = 0; i < argc-1; i++)
+    {
+        if (!strcmp("--dump_mode", argv[i]) && !strcmp("thread", argv[i+1]))
+            return 1;
+        if (!strcmp("--sweep", argv[i]))
+        {
+            char const *item = strstr(argv[i+1], "dump_mode=");
+            char const *thread = item ? strstr(item, "thread") : 0;
+            if (thread && thread < item + strcspn(item, ";"))
+                return 1;
+        }
+    }
+    return 0;
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -704,7 +1901,7 @@ main(int argc, char *argv[])
     json_object *clargs_obj = 0;
     MACSIO_TIMING_GroupMask_t main_grp;
     MACSIO_TIMING_TimerId_t main_tid;
-    int i, argi, exercise_scr = 0;
+    int i, argi, exercise_scr = 0, dump_mode_thread = 0;
     double currtime;
     unsigned ucurrtim;
 
@@ -712,6 +1909,9 @@ main(int argc, char *argv[])
     for (i = 0; i < argc && !exercise_scr; i++)
         exercise_scr = !strcmp("exercise_scr", argv[i]);
 
+    /* quick pre-scan for threaded dumps which need MPI thread support */
+    dump_mode_thread = thread_dumps_requested(argc, argv);
+
 #ifdef HAVE_CALIPER
 #ifdef HAVE_MPI
     /* Ensures Caliper's MPI runtime lib is loaded */
@@ -722,7 +1922,10 @@ main(int argc, char *argv[])
 
 ////#warning SHOULD WE BE USING MPI-3 API
 #ifdef HAVE_MPI
-    MPI_Init(&argc, &argv);
+    if (dump_mode_thread)
+        MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &mpi_thread_level);
+    else
+        MPI_Init(&argc, &argv);
 #ifdef HAVE_SCR
 ////#warning SANITY CHECK WITH MIFFPP
     if (exercise_scr)
@@ -750,17 +1953,13 @@ main(int argc, char *argv[])
     clargs_obj = ProcessCommandLine(argc, argv, &argi);
     json_object_object_add(main_obj, "clargs", clargs_obj);
 
-    strncpy(MACSIO_UTILS_UnitsPrefixSystem, JsonGetStr(clargs_obj, "units_prefix_system"),
-        sizeof(MACSIO_UTILS_UnitsPrefixSystem));
-
     MACSIO_LOG_MainLog = MACSIO_LOG_LogInit(MACSIO_MAIN_Comm,
         JsonGetStr(clargs_obj, "log_file_name"),
         JsonGetInt(clargs_obj, "log_line_length"),
         JsonGetInt(clargs_obj, "log_line_cnt/0"),
         JsonGetInt(clargs_obj, "log_line_cnt/1"));
 
-////#warning THESE INITIALIZATIONS SHOULD BE IN MACSIO_LOG
-    MACSIO_LOG_DebugLevel = JsonGetInt(clargs_obj, "debug_level");
+    apply_global_clargs(clargs_obj);
 
     /* Setup parallel information */
     json_object_object_add(parallel_obj, "mpi_size", json_object_new_int(MACSIO_MAIN_Size));
@@ -774,8 +1973,12 @@ main(int argc, char *argv[])
     /* Do a read or write test */
     if (strcmp(JsonGetStr(clargs_obj, "read_path"),"null"))
         main_read(argi, argc, argv, main_obj);
+    else if (strcmp(JsonGetStr(clargs_obj, "sweep"),"null"))
+        main_sweep(argi, argc, argv, main_obj, main_grp);
+    else if (strcmp(JsonGetStr(clargs_obj, "interfaces"),"null"))
+        main_compare_interfaces(argi, argc, argv, main_obj, main_grp);
     else
-        main_write(argi, argc, argv, main_obj);
+        main_write(argi, argc, argv, main_obj, 0);
 
     /* stop total timer */
     MT_StopTimer(main_tid);
@@ -807,7 +2010,11 @@ main(int argc, char *argv[])
 #ifdef HAVE_MPI
     {   int result;
         if ((MPI_Initialized(&result) == MPI_SUCCESS) && result)
+        {
+            /* This frees everything cached on it (e.g. MIF/MSF group communicators) */
+            MPI_Comm_free(&MACSIO_MAIN_Comm);
             MPI_Finalize();
+        }
     }
 #endif
 
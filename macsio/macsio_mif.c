@@ -24,7 +24,9 @@ this program; if not, write to the Free Software Foundation, Inc., 59 Temple
 Place, Suite 330, Boston, MA 02111-1307 USA
 */
 
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifdef HAVE_SCR
 #ifdef __cplusplus
@@ -36,12 +38,38 @@ extern "C" {
 #endif
 #endif
 
+#include <macsio_log.h>
 #include <macsio_mif.h>
+#include <macsio_timing.h>
+#include <macsio_utils.h>
 
 #define MACSIO_MIF_BATON_OK  0
 #define MACSIO_MIF_BATON_ERR 1
-#define MACSIO_MIF_MIFMAX -1
-#define MACSIO_MIF_MIFAUTO -2
+
+/* Phases of a processor's turn with its group's file */
+#define MIF_PHASE_WAIT    0
+#define MIF_PHASE_OPEN    1
+#define MIF_PHASE_WRITE   2
+#define MIF_PHASE_CLOSE   3
+#define MIF_PHASE_HANDOFF 4
+#define MIF_NUM_PHASES    5
+
+/* Value of a timer id when the timer is not running */
+#define MIF_NO_TIMER ((MACSIO_TIMING_TimerId_t) -1)
+
+static char const *phaseNames[MIF_NUM_PHASES] = {"wait", "open", "write", "close", "handoff"};
+
+/* The order of a communicator's ranks for a group layout and file count. It is cached
+   on the communicator as an attribute so that it is computed once rather than once
+   per dump. It is shared by the attribute and every live baton using it. */
+typedef struct _mif_layout_t
+{
+    int layout;                 /* One of MACSIO_MIF_groupLayout_t */
+    int numGroups;              /* File count */
+    int refs;                   /* Number of references */
+    int *rankOfPos;             /* Rank at each position of the group layout order */
+    int *posOfRank;             /* Position of each rank in the group layout order */
+} mif_layout_t;
 
 /*! \struct _MACSIO_MIF_baton_t */
 typedef struct _MACSIO_MIF_baton_t
@@ -62,6 +90,17 @@ typedef struct _MACSIO_MIF_baton_t
     int rankInGroup;            /**< Rank of this processor within its group */
     int procBeforeMe;           /**< Rank of processor before this processor in the group */
     int procAfterMe;            /**< Rank of processor after this processor in the group */
+    int procBeforeMyGroup;      /**< Rank of last processor of the group this processor's group waits on */
+    int procAfterMyGroup;       /**< Rank of first processor of the group waiting on this processor's group */
+    mif_layout_t *layout;       /**< Group layout order (0 if contiguous) */
+    int *rankOfPos;             /**< Rank at each position of the group layout order (0 if contiguous) */
+    int *posOfRank;             /**< Position of each rank in the group layout order (0 if contiguous) */
+#ifdef HAVE_MPI
+    MPI_Request batonReq;       /**< Posted receive of the baton (MPI_REQUEST_NULL if none) */
+    MPI_Request groupBatonReq;  /**< Posted receive of the previous wave's baton (MPI_REQUEST_NULL if none) */
+    int batonVal;               /**< Buffer of the posted receive of the baton */
+    int groupBatonVal;          /**< Buffer of the posted receive of the previous wave's baton */
+#endif
     mutable int mifErr;         /**< MIF error value */
     mutable int mpiErr;         /**< MPI error value */
     int mpiTag;                 /**< MPI message tag used for all messages here */
@@ -69,11 +108,469 @@ typedef struct _MACSIO_MIF_baton_t
     MACSIO_MIF_OpenCB openCb;   /**< Open file callback */
     MACSIO_MIF_CloseCB closeCb; /**< Close file callback */
     void *clientData;           /**< Client data to be passed around in calls */
+    MACSIO_TIMING_GroupMask_t timerGroup; /**< Timer group of all MIF timers */
+    mutable MACSIO_TIMING_TimerId_t writeTid; /**< Timer of plugin's work between acquire and handoff */
+    mutable double phaseTime[MIF_NUM_PHASES]; /**< Time this processor spent in each phase */
+    struct _MACSIO_MIF_baton_t *nextLive; /**< Next baton in the list of live batons */
 } MACSIO_MIF_baton_t;
 
-//#warning ENSURE DIFFERENT INSTANCES USE DIFFERENT MPI TAGS
-//#warning ADD A THROTTLE OPTION HERE FOR TOT FILES VS CONCURRENT FILES
-//#warning FOR AUTO MODE, MUST HAVE A CALL TO QUERY FILE COUNT
+int MACSIO_MIF_MaxConcurrentFiles = 0;
+int MACSIO_MIF_GroupLayout = MACSIO_MIF_LAYOUT_CONTIGUOUS;
+int MACSIO_MIF_GroupReport = 0;
+
+/* Names of the streams tags have been allocated to. The tag of a stream is
+   MACSIO_MIF_TAG_BASE plus its index here. Streams are those of plugins and live
+   as long as the process, so their tags are never released. */
+#define MIF_MAX_STREAMS 64
+#define MIF_MAX_STREAM_NAME 64
+static char streamNames[MIF_MAX_STREAMS][MIF_MAX_STREAM_NAME];
+static int numStreams = 0;
+
+/* Batons between MACSIO_MIF_Init and MACSIO_MIF_Finish. Batons may be created
+   by a dump's writer thread and the main thread at the same time. */
+static MACSIO_MIF_baton_t *liveBatons = 0;
+static pthread_mutex_t mifMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Position of the first processor of a group in the group layout order */
+static int
+first_pos_of_group(int group, int groupSize, int numGroupsWithExtraProc, int commSplit)
+{
+    if (group < numGroupsWithExtraProc)
+        return group * (groupSize + 1);
+    return commSplit + (group - numGroupsWithExtraProc) * groupSize;
+}
+
+/* Rank at a position of the group layout order */
+static int
+rank_of_pos(int const *rankOfPos, int pos)
+{
+    return rankOfPos ? rankOfPos[pos] : pos;
+}
+
+#ifdef HAVE_MPI
+/* Sort key of a rank in the group layout order */
+typedef struct _layout_key_t
+{
+    int major;
+    int minor;
+    int rank;
+} layout_key_t;
+
+static int
+compare_layout_keys(void const *a, void const *b)
+{
+    layout_key_t const *ka = (layout_key_t const *) a;
+    layout_key_t const *kb = (layout_key_t const *) b;
+    if (ka->major != kb->major) return ka->major < kb->major ? -1 : 1;
+    if (ka->minor != kb->minor) return ka->minor < kb->minor ? -1 : 1;
+    return ka->rank < kb->rank ? -1 : ka->rank > kb->rank;
+}
+
+/* Order the ranks of a communicator for a group layout. Groups are then assigned
+   contiguous ranges of positions in this order, just as they are assigned contiguous
+   ranges of ranks in the contiguous layout. Collective on mpiComm. */
+static void
+make_group_layout(
+    int layout,
+    MPI_Comm mpiComm,
+    int commSize,
+    int rankInComm,
+    int numGroups,
+    int **rankOfPos,
+    int **posOfRank
+)
+{
+    int i, nodeInfo[2] = {rankInComm, 0}; /* node id and rank within node */
+    int *allNodeInfo = 0;
+    layout_key_t *keys = (layout_key_t *) malloc(commSize * sizeof(layout_key_t));
+
+    if (layout == MACSIO_MIF_LAYOUT_NODE_PACKED || layout == MACSIO_MIF_LAYOUT_NODE_SPREAD)
+    {
+        /* A node is identified by the lowest rank on it */
+        MPI_Comm nodeComm;
+        MPI_Comm_split_type(mpiComm, MPI_COMM_TYPE_SHARED, rankInComm, MPI_INFO_NULL, &nodeComm);
+        MPI_Comm_rank(nodeComm, &nodeInfo[1]);
+        MPI_Allreduce(&rankInComm, &nodeInfo[0], 1, MPI_INT, MPI_MIN, nodeComm);
+        MPI_Comm_free(&nodeComm);
+        allNodeInfo = (int *) malloc(2 * commSize * sizeof(int));
+        MPI_Allgather(nodeInfo, 2, MPI_INT, allNodeInfo, 2, MPI_INT, mpiComm);
+    }
+
+    for (i = 0; i < commSize; i++)
+    {
+        keys[i].rank = i;
+        switch (layout)
+        {
+            case MACSIO_MIF_LAYOUT_ROUND_ROBIN:
+                keys[i].major = i % numGroups;
+                keys[i].minor = i;
+                break;
+            case MACSIO_MIF_LAYOUT_NODE_PACKED:
+                keys[i].major = allNodeInfo[2*i];
+                keys[i].minor = i;
+                break;
+            case MACSIO_MIF_LAYOUT_NODE_SPREAD:
+                keys[i].major = allNodeInfo[2*i+1];
+                keys[i].minor = allNodeInfo[2*i];
+                break;
+            default:
+                keys[i].major = 0;
+                keys[i].minor = i;
+                break;
+        }
+    }
+    qsort(keys, commSize, sizeof(layout_key_t), compare_layout_keys);
+
+    *rankOfPos = (int *) malloc(commSize * sizeof(int));
+    *posOfRank = (int *) malloc(commSize * sizeof(int));
+    for (i = 0; i < commSize; i++)
+    {
+        (*rankOfPos)[i] = keys[i].rank;
+        (*posOfRank)[keys[i].rank] = i;
+    }
+
+    free(keys);
+    free(allNodeInfo);
+}
+#endif
+
+static pthread_mutex_t layoutMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t layoutBuilt = PTHREAD_COND_INITIALIZER;
+static int layoutBuilding = 0;
+
+static void
+release_layout(
+    mif_layout_t *layout
+)
+{
+    int refs;
+
+    if (!layout) return;
+    pthread_mutex_lock(&layoutMutex);
+    refs = --layout->refs;
+    pthread_mutex_unlock(&layoutMutex);
+    if (refs > 0) return;
+
+    free(layout->rankOfPos);
+    free(layout->posOfRank);
+    free(layout);
+}
+
+#ifdef HAVE_MPI
+static int layoutKeyval = MPI_KEYVAL_INVALID;
+
+/* Attribute delete callback, called when the communicator is freed or its layout replaced */
+static int
+delete_layout_attr(MPI_Comm comm, int keyval, void *attr, void *extra)
+{
+    release_layout((mif_layout_t *) attr);
+    return MPI_SUCCESS;
+}
+
+/* Get a reference to the group layout of a communicator for a file count, computing
+   it if it is not cached or was computed for another layout or file count. Collective
+   on mpiComm when it computes. Only one thread computes at a time; any other thread
+   needing a layout meanwhile waits for it and then re-checks the cache. */
+static mif_layout_t *
+get_layout(
+    int layout,
+    MPI_Comm mpiComm,
+    int commSize,
+    int rankInComm,
+    int numGroups
+)
+{
+    mif_layout_t *ret = 0;
+    int found = 0;
+    MACSIO_TIMING_TimerId_t tid;
+
+    pthread_mutex_lock(&layoutMutex);
+    while (layoutBuilding)
+        pthread_cond_wait(&layoutBuilt, &layoutMutex);
+    if (layoutKeyval == MPI_KEYVAL_INVALID)
+        MPI_Comm_create_keyval(MPI_COMM_NULL_COPY_FN, delete_layout_attr, &layoutKeyval, 0);
+    MPI_Comm_get_attr(mpiComm, layoutKeyval, &ret, &found);
+    if (found && ret->layout == layout && ret->numGroups == numGroups)
+    {
+        ret->refs++;
+        pthread_mutex_unlock(&layoutMutex);
+        return ret;
+    }
+    layoutBuilding = 1;
+    pthread_mutex_unlock(&layoutMutex);
+
+    tid = MT_StartTimer("MIF setup", MACSIO_TIMING_GroupMask("MIF"), MACSIO_TIMING_ITER_AUTO);
+
+    ret = (mif_layout_t *) malloc(sizeof(mif_layout_t));
+    ret->layout = layout;
+    ret->numGroups = numGroups;
+    ret->refs = 2; /* The attribute's and the caller's */
+    make_group_layout(layout, mpiComm, commSize, rankInComm, numGroups,
+        &ret->rankOfPos, &ret->posOfRank);
+
+    /* This releases any layout for another file count */
+    MPI_Comm_set_attr(mpiComm, layoutKeyval, ret);
+
+    MT_StopTimer(tid);
+
+    pthread_mutex_lock(&layoutMutex);
+    layoutBuilding = 0;
+    pthread_cond_broadcast(&layoutBuilt);
+    pthread_mutex_unlock(&layoutMutex);
+
+    return ret;
+}
+
+/* Communicators on which batons report their groups, one per stream, dup'd from the
+   batons' communicator and cached on it as an attribute. Reporting on the stream's own
+   communicator keeps, e.g., the main thread's trickle dump report from matching the
+   collectives of a burst dump on a writer thread. */
+typedef struct _mif_report_comms_t
+{
+    MPI_Comm comms[MIF_MAX_STREAMS];
+} mif_report_comms_t;
+
+static int reportKeyval = MPI_KEYVAL_INVALID;
+
+static int
+delete_report_attr(MPI_Comm comm, int keyval, void *attr, void *extra)
+{
+    mif_report_comms_t *rc = (mif_report_comms_t *) attr;
+    int i;
+
+    for (i = 0; i < MIF_MAX_STREAMS; i++)
+    {
+        if (rc->comms[i] != MPI_COMM_NULL)
+            MPI_Comm_free(&rc->comms[i]);
+    }
+    free(rc);
+    return MPI_SUCCESS;
+}
+
+/* Get the report communicator of the stream with a given tag, dup'ing it if it is not
+   cached. Collective on mpiComm when it dups. */
+static MPI_Comm
+get_report_comm(
+    MPI_Comm mpiComm,
+    int mpiTag
+)
+{
+    mif_report_comms_t *rc = 0;
+    int i, found = 0, stream = mpiTag - MACSIO_MIF_TAG_BASE;
+    MPI_Comm ret;
+
+    if (stream < 0 || stream >= MIF_MAX_STREAMS)
+        return mpiComm;
+
+    pthread_mutex_lock(&mifMutex);
+    if (reportKeyval == MPI_KEYVAL_INVALID)
+        MPI_Comm_create_keyval(MPI_COMM_NULL_COPY_FN, delete_report_attr, &reportKeyval, 0);
+    MPI_Comm_get_attr(mpiComm, reportKeyval, &rc, &found);
+    if (!found)
+    {
+        rc = (mif_report_comms_t *) malloc(sizeof(mif_report_comms_t));
+        for (i = 0; i < MIF_MAX_STREAMS; i++)
+            rc->comms[i] = MPI_COMM_NULL;
+        MPI_Comm_set_attr(mpiComm, reportKeyval, rc);
+    }
+    ret = rc->comms[stream];
+    pthread_mutex_unlock(&mifMutex);
+
+    /* No other baton of the stream can be live on mpiComm meanwhile */
+    if (ret == MPI_COMM_NULL)
+    {
+        MPI_Comm_dup(mpiComm, &ret);
+        pthread_mutex_lock(&mifMutex);
+        rc->comms[stream] = ret;
+        pthread_mutex_unlock(&mifMutex);
+    }
+
+    return ret;
+}
+#endif
+
+/* Number of groups for a file count given to MACSIO_MIF_Init */
+static int
+group_count(int numFiles, int commSize)
+{
+    if (numFiles == MACSIO_MIF_MIFMAX)
+        return commSize;
+    else if (numFiles == MACSIO_MIF_MIFAUTO || numFiles <= 0)
+        return MACSIO_MIF_DefaultFileCount(commSize);
+    return numFiles;
+}
+
+void
+MACSIO_MIF_PrepareLayout(
+    int numFiles,
+#ifdef HAVE_MPI
+    MPI_Comm mpiComm
+#else
+    int      mpiComm
+#endif
+)
+{
+#ifdef HAVE_MPI
+    int commSize, rankInComm, i, n;
+
+    if (MACSIO_MIF_GroupLayout != MACSIO_MIF_LAYOUT_CONTIGUOUS)
+    {
+        MPI_Comm_size(mpiComm, &commSize);
+        MPI_Comm_rank(mpiComm, &rankInComm);
+        release_layout(get_layout(MACSIO_MIF_GroupLayout, mpiComm, commSize, rankInComm,
+            group_count(numFiles, commSize)));
+    }
+
+    if (MACSIO_MIF_GroupReport)
+    {
+        pthread_mutex_lock(&mifMutex);
+        n = numStreams;
+        pthread_mutex_unlock(&mifMutex);
+        for (i = 0; i < n; i++)
+            get_report_comm(mpiComm, MACSIO_MIF_TAG_BASE + i);
+    }
+#endif
+}
+
+int
+MACSIO_MIF_AllocTag(
+    char const *name
+)
+{
+    int i;
+
+    pthread_mutex_lock(&mifMutex);
+    for (i = 0; i < numStreams; i++)
+    {
+        if (!strcmp(streamNames[i], name))
+            break;
+    }
+    if (i == numStreams)
+    {
+        if (numStreams == MIF_MAX_STREAMS)
+        {
+            pthread_mutex_unlock(&mifMutex);
+            MACSIO_LOG_MSG(Die, ("Unable to allocate MPI tag for \"%s\"; all %d tags in use",
+                name, MIF_MAX_STREAMS));
+            return -1;
+        }
+        if (strlen(name) >= MIF_MAX_STREAM_NAME)
+        {
+            pthread_mutex_unlock(&mifMutex);
+            MACSIO_LOG_MSG(Die, ("MIF stream name \"%s\" too long", name));
+            return -1;
+        }
+        strcpy(streamNames[numStreams++], name);
+    }
+    pthread_mutex_unlock(&mifMutex);
+
+    return MACSIO_MIF_TAG_BASE + i;
+}
+
+/* Add a baton to the live batons. Two live batons using the same tag on the same
+   communicator would receive each other's messages. */
+static void
+add_live_baton(
+    MACSIO_MIF_baton_t *bat
+)
+{
+    MACSIO_MIF_baton_t *b;
+
+    pthread_mutex_lock(&mifMutex);
+    for (b = liveBatons; b; b = b->nextLive)
+    {
+        if (b->mpiTag == bat->mpiTag && b->mpiComm == bat->mpiComm)
+        {
+            pthread_mutex_unlock(&mifMutex);
+            MACSIO_LOG_MSG(Die, ("MIF tag %d is already in use by another baton on the same communicator",
+                bat->mpiTag));
+            return;
+        }
+    }
+    bat->nextLive = liveBatons;
+    liveBatons = bat;
+    pthread_mutex_unlock(&mifMutex);
+}
+
+static void
+remove_live_baton(
+    MACSIO_MIF_baton_t const *bat
+)
+{
+    MACSIO_MIF_baton_t **b;
+
+    pthread_mutex_lock(&mifMutex);
+    for (b = &liveBatons; *b; b = &(*b)->nextLive)
+    {
+        if (*b == bat)
+        {
+            *b = bat->nextLive;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mifMutex);
+}
+
+int
+MACSIO_MIF_DefaultFileCount(int commSize)
+{
+    int numFiles;
+
+    if (commSize <= 32)
+        numFiles = 32;
+    else if (commSize <= 8192)
+        numFiles = 64;
+    else if (commSize <= 65536)
+        numFiles = 128;
+    else
+        numFiles = 256;
+
+    return numFiles < commSize ? numFiles : commSize;
+}
+
+int
+MACSIO_MIF_ParallelFileMode(
+    json_object *main_obj,
+    int *numFiles
+)
+{
+    int commSize = json_object_path_get_int(main_obj, "parallel/mpi_size");
+    json_object *parfmode_obj = json_object_path_get_array(main_obj, "clargs/parallel_file_mode");
+    char const *modestr;
+
+    /* The mode is given either with a file count or by name alone */
+    if (parfmode_obj)
+    {
+        modestr = json_object_get_string(json_object_array_get_idx(parfmode_obj, 0));
+        *numFiles = json_object_get_int(json_object_array_get_idx(parfmode_obj, 1));
+    }
+    else
+    {
+        modestr = json_object_path_get_string(main_obj, "clargs/parallel_file_mode");
+        *numFiles = 0;
+    }
+
+    if (!strcmp(modestr, "SIF"))
+    {
+        if (*numFiles < 1) *numFiles = 1;
+        return MACSIO_MIF_MODE_SIF;
+    }
+
+    if (strcmp(modestr, "MIF") && strcmp(modestr, "MIFMAX") && strcmp(modestr, "MIFFPP") &&
+        strcmp(modestr, "MIFAUTO") && strcmp(modestr, "MIFOPT") && strcmp(modestr, "MIFMEM"))
+        MACSIO_LOG_MSG(Die, ("Unknown parallel file mode \"%s\"", modestr));
+
+    if (!strcmp(modestr, "MIFMAX") || !strcmp(modestr, "MIFFPP"))
+        *numFiles = commSize;
+    else if (*numFiles <= 0) /* MIFAUTO, MIFOPT */
+    {
+        /* main normally replaces these with a measured count before a plugin gets here */
+        *numFiles = MACSIO_MIF_DefaultFileCount(commSize);
+    }
+
+    return strcmp(modestr, "MIFMEM") ? MACSIO_MIF_MODE_MIF : MACSIO_MIF_MODE_MIFMEM;
+}
+
 MACSIO_MIF_baton_t *
 MACSIO_MIF_Init(
     int numFiles,
@@ -91,42 +588,78 @@ MACSIO_MIF_Init(
 )
 {
     int numGroups = numFiles;
-    int commSize=1, rankInComm=0;
+    int commSize=1, rankInComm=0, posInComm;
+    int *rankOfPos = 0, *posOfRank = 0;
+    mif_layout_t *layout = 0;
     int groupSize, numGroupsWithExtraProc, commSplit,
-        groupRank, rankInGroup, procBeforeMe, procAfterMe;
+        groupRank, rankInGroup, procBeforeMe, procAfterMe,
+        maxConcurrent, procBeforeMyGroup, procAfterMyGroup;
     MACSIO_MIF_baton_t *ret = 0;
 
     procBeforeMe = -1;
     procAfterMe = -1;
+    procBeforeMyGroup = -1;
+    procAfterMyGroup = -1;
 
 #ifdef HAVE_MPI
     MPI_Comm_size(mpiComm, &commSize);
     MPI_Comm_rank(mpiComm, &rankInComm);
 #endif
 
+    numGroups = group_count(numFiles, commSize);
+
     groupSize              = commSize / numGroups;
     numGroupsWithExtraProc = commSize % numGroups;
     commSplit = numGroupsWithExtraProc * (groupSize + 1);
 
-    if (rankInComm < commSplit)
+    /* Groups are contiguous ranges of positions in the layout order. In the
+       contiguous layout, a processor's position is its rank. */
+    posInComm = rankInComm;
+#ifdef HAVE_MPI
+    if (MACSIO_MIF_GroupLayout != MACSIO_MIF_LAYOUT_CONTIGUOUS)
+    {
+        layout = get_layout(MACSIO_MIF_GroupLayout, mpiComm, commSize, rankInComm, numGroups);
+        rankOfPos = layout->rankOfPos;
+        posOfRank = layout->posOfRank;
+        posInComm = posOfRank[rankInComm];
+    }
+#endif
+
+    if (posInComm < commSplit)
     {
-        groupRank = rankInComm / (groupSize + 1);
-        rankInGroup = rankInComm % (groupSize + 1);
+        groupRank = posInComm / (groupSize + 1);
+        rankInGroup = posInComm % (groupSize + 1);
         if (rankInGroup < groupSize)
-            procAfterMe = rankInComm + 1;
+            procAfterMe = rank_of_pos(rankOfPos, posInComm + 1);
     }
     else
     {
-        groupRank = numGroupsWithExtraProc + (rankInComm - commSplit) / groupSize; 
-        rankInGroup = (rankInComm - commSplit) % groupSize;
+        groupRank = numGroupsWithExtraProc + (posInComm - commSplit) / groupSize; 
+        rankInGroup = (posInComm - commSplit) % groupSize;
         if (rankInGroup < groupSize - 1)
-            procAfterMe = rankInComm + 1;
+            procAfterMe = rank_of_pos(rankOfPos, posInComm + 1);
     }
     if (rankInGroup > 0)
-        procBeforeMe = rankInComm - 1;
+        procBeforeMe = rank_of_pos(rankOfPos, posInComm - 1);
+
+    /* Throttle the groups into waves of at most maxConcurrent groups. Group g's file is
+       not created until group g-maxConcurrent's file is closed by its last processor. */
+    maxConcurrent = MACSIO_MIF_MaxConcurrentFiles;
+    if (0 < maxConcurrent && maxConcurrent < numGroups)
+    {
+        if (rankInGroup == 0 && groupRank >= maxConcurrent)
+            procBeforeMyGroup = rank_of_pos(rankOfPos, first_pos_of_group(groupRank - maxConcurrent + 1,
+                groupSize, numGroupsWithExtraProc, commSplit) - 1);
+        if (procAfterMe == -1 && groupRank + maxConcurrent < numGroups)
+            procAfterMyGroup = rank_of_pos(rankOfPos, first_pos_of_group(groupRank + maxConcurrent,
+                groupSize, numGroupsWithExtraProc, commSplit));
+    }
 
     if (createCb == 0 || openCb == 0 || closeCb == 0)
+    {
+        release_layout(layout);
         return 0;
+    }
 
     ret = (MACSIO_MIF_baton_t *) malloc(sizeof(MACSIO_MIF_baton_t));
     ret->ioFlags = ioFlags;
@@ -140,9 +673,16 @@ MACSIO_MIF_Init(
     ret->rankInGroup = rankInGroup;
     ret->procBeforeMe = procBeforeMe;
     ret->procAfterMe = procAfterMe;
+    ret->procBeforeMyGroup = procBeforeMyGroup;
+    ret->procAfterMyGroup = procAfterMyGroup;
+    ret->layout = layout;
+    ret->rankOfPos = rankOfPos;
+    ret->posOfRank = posOfRank;
     ret->mifErr = MACSIO_MIF_BATON_OK;
 #ifdef HAVE_MPI
     ret->mpiErr = MPI_SUCCESS;
+    ret->batonReq = MPI_REQUEST_NULL;
+    ret->groupBatonReq = MPI_REQUEST_NULL;
 #else
     ret->mpiErr = 0;
 #endif
@@ -152,103 +692,217 @@ MACSIO_MIF_Init(
     ret->openCb = openCb;
     ret->closeCb = closeCb;
     ret->clientData = clientData;
+    ret->timerGroup = MACSIO_TIMING_GroupMask("MIF");
+    ret->writeTid = MIF_NO_TIMER;
+    memset(ret->phaseTime, 0, sizeof(ret->phaseTime));
+    add_live_baton(ret);
 
     return ret;
 }
 
+/* Gather each processor's phase times to rank 0 of the baton's communicator and log
+   the sums over each group's processors. The gather is on the stream's report
+   communicator. */
+static void
+report_groups(
+    MACSIO_MIF_baton_t const *bat
+)
+{
+#ifdef HAVE_MPI
+    int i, p, n = MIF_NUM_PHASES + 1;
+    double mine[MIF_NUM_PHASES + 1], *all = 0, *groupTimes;
+
+    mine[0] = (double) bat->groupRank;
+    for (p = 0; p < MIF_NUM_PHASES; p++)
+        mine[p+1] = bat->phaseTime[p];
+
+    if (bat->rankInComm == 0)
+        all = (double *) malloc(bat->commSize * n * sizeof(double));
+    MPI_Gather(mine, n, MPI_DOUBLE, all, n, MPI_DOUBLE, 0, get_report_comm(bat->mpiComm, bat->mpiTag));
+    if (bat->rankInComm != 0)
+        return;
+
+    groupTimes = (double *) calloc(bat->numGroups * MIF_NUM_PHASES, sizeof(double));
+    for (i = 0; i < bat->commSize; i++)
+    {
+        int g = (int) all[i*n];
+        for (p = 0; p < MIF_NUM_PHASES; p++)
+            groupTimes[g*MIF_NUM_PHASES+p] += all[i*n+p+1];
+    }
+
+    MACSIO_LOG_MSG(Info, ("MIF phase times summed over each group's %d or %d tasks, over %d groups",
+        bat->groupSize, bat->groupSize + (bat->numGroupsWithExtraProc ? 1 : 0), bat->numGroups));
+    for (p = 0; p < MIF_NUM_PHASES; p++)
+    {
+        double tmin = groupTimes[p], tmax = groupTimes[p], tsum = 0;
+        int gmax = 0;
+        for (i = 0; i < bat->numGroups; i++)
+        {
+            double t = groupTimes[i*MIF_NUM_PHASES+p];
+            tsum += t;
+            if (t < tmin) tmin = t;
+            if (t > tmax)
+            {
+                tmax = t;
+                gmax = i;
+            }
+        }
+        MACSIO_LOG_MSG(Info, ("MIF %-7s min=%10.5f avg=%10.5f max=%10.5f (group %d)",
+            phaseNames[p], tmin, tsum / bat->numGroups, tmax, gmax));
+    }
+
+    /* Too many to be useful individually beyond a modest group count */
+    if (bat->numGroups <= 64)
+    {
+        for (i = 0; i < bat->numGroups; i++)
+        {
+            double const *t = &groupTimes[i*MIF_NUM_PHASES];
+            MACSIO_LOG_MSG(Info, ("MIF group %05d: wait=%10.5f open=%10.5f write=%10.5f "
+                "close=%10.5f handoff=%10.5f", i, t[MIF_PHASE_WAIT], t[MIF_PHASE_OPEN],
+                t[MIF_PHASE_WRITE], t[MIF_PHASE_CLOSE], t[MIF_PHASE_HANDOFF]));
+        }
+    }
+
+    free(groupTimes);
+    free(all);
+#endif
+}
+
 void
 MACSIO_MIF_Finish(
     MACSIO_MIF_baton_t *bat
 )
 {
+    if (MACSIO_MIF_GroupReport)
+        report_groups(bat);
+
+#ifdef HAVE_MPI
+    /* Retire any receives posted but never waited on */
+    if (bat->batonReq != MPI_REQUEST_NULL)
+    {
+        MPI_Cancel(&bat->batonReq);
+        MPI_Wait(&bat->batonReq, MPI_STATUS_IGNORE);
+    }
+    if (bat->groupBatonReq != MPI_REQUEST_NULL)
+    {
+        MPI_Cancel(&bat->groupBatonReq);
+        MPI_Wait(&bat->groupBatonReq, MPI_STATUS_IGNORE);
+    }
+#endif
+    remove_live_baton(bat);
+    release_layout(bat->layout);
     free(bat);
 }
 
-void *
-MACSIO_MIF_WaitForBaton(
-    MACSIO_MIF_baton_t *Bat,
-    char const *fname,
-    char const *nsname
+void
+MACSIO_MIF_PostBaton(
+    MACSIO_MIF_baton_t *Bat
 )
 {
-    if (Bat->procBeforeMe != -1)
-    {
-        int mpi_err;
 #ifdef HAVE_MPI
-        MPI_Status mpi_stat;
-        int baton;
-        mpi_err = MPI_Recv(&baton, 1, MPI_INT, Bat->procBeforeMe,
-                           Bat->mpiTag, Bat->mpiComm, &mpi_stat);
-        if (mpi_err == MPI_SUCCESS && baton != MACSIO_MIF_BATON_ERR)
-#else
-        if (1)
+    if (Bat->procBeforeMyGroup != -1 && Bat->groupBatonReq == MPI_REQUEST_NULL)
+        MPI_Irecv(&Bat->groupBatonVal, 1, MPI_INT, Bat->procBeforeMyGroup,
+                  Bat->mpiTag, Bat->mpiComm, &Bat->groupBatonReq);
+    if (Bat->procBeforeMe != -1 && Bat->batonReq == MPI_REQUEST_NULL)
+        MPI_Irecv(&Bat->batonVal, 1, MPI_INT, Bat->procBeforeMe,
+                  Bat->mpiTag, Bat->mpiComm, &Bat->batonReq);
 #endif
+}
+
+/* Receive the baton(s) this processor must have before accessing the group's file */
+static int
+receive_baton(
+    MACSIO_MIF_baton_t *Bat
+)
+{
+#ifdef HAVE_MPI
+    MPI_Status mpi_stat;
+    int baton = MACSIO_MIF_BATON_OK, mpi_err = MPI_SUCCESS;
+
+    if (Bat->procBeforeMyGroup != -1)
+    {
+        if (Bat->groupBatonReq != MPI_REQUEST_NULL)
+            mpi_err = MPI_Wait(&Bat->groupBatonReq, &mpi_stat);
+        else
+            mpi_err = MPI_Recv(&baton, 1, MPI_INT, Bat->procBeforeMyGroup,
+                               Bat->mpiTag, Bat->mpiComm, &mpi_stat);
+        baton = MACSIO_MIF_BATON_OK; /* errors in other groups are not ours */
+    }
+
+    if (mpi_err == MPI_SUCCESS && Bat->procBeforeMe != -1)
+    {
+        if (Bat->batonReq != MPI_REQUEST_NULL)
         {
-            if (Bat->ioFlags.use_scr)
-            {
-#ifdef HAVE_SCR
-                char scr_filename[SCR_MAX_FILENAME];
-                if (SCR_Route_file(fname, scr_filename) == SCR_SUCCESS)
-                    return Bat->openCb(scr_filename, nsname, Bat->ioFlags, Bat->clientData);
-                else
-                    return Bat->openCb(fname, nsname, Bat->ioFlags, Bat->clientData);
-#else
-                return Bat->openCb(fname, nsname, Bat->ioFlags, Bat->clientData);
-#endif
-            }
-            else
-            {
-                return Bat->openCb(fname, nsname, Bat->ioFlags, Bat->clientData);
-            }
+            mpi_err = MPI_Wait(&Bat->batonReq, &mpi_stat);
+            baton = Bat->batonVal;
         }
         else
         {
-            Bat->mifErr = MACSIO_MIF_BATON_ERR;
-            Bat->mpiErr = mpi_err;
-            return 0;
+            mpi_err = MPI_Recv(&baton, 1, MPI_INT, Bat->procBeforeMe,
+                               Bat->mpiTag, Bat->mpiComm, &mpi_stat);
         }
     }
-    else
+
+    if (mpi_err != MPI_SUCCESS || baton == MACSIO_MIF_BATON_ERR)
     {
-        if (Bat->ioFlags.do_wr)
-        {
-            if (Bat->ioFlags.use_scr)
-            {
-#ifdef HAVE_SCR
-                char scr_filename[SCR_MAX_FILENAME];
-                if (SCR_Route_file(fname, scr_filename) == SCR_SUCCESS)
-                    return Bat->createCb(scr_filename, nsname, Bat->clientData);
-                else
-                    return Bat->createCb(fname, nsname, Bat->clientData);
-#else
-                return Bat->createCb(fname, nsname, Bat->clientData);
+        Bat->mifErr = MACSIO_MIF_BATON_ERR;
+        Bat->mpiErr = mpi_err;
+        return 0;
+    }
 #endif
-            }
-            else
-            {
-                return Bat->createCb(fname, nsname, Bat->clientData);
-            }
-        }
-        else
-        {
-            if (Bat->ioFlags.use_scr)
-            {
+    return 1;
+}
+
+/* Create (first processor of a group when writing) or open the group's file */
+static void *
+open_file(
+    MACSIO_MIF_baton_t const *Bat,
+    char const *fname,
+    char const *nsname
+)
+{
+    int create = Bat->procBeforeMe == -1 && Bat->ioFlags.do_wr;
+
 #ifdef HAVE_SCR
-                char scr_filename[SCR_MAX_FILENAME];
-                if (SCR_Route_file(fname, scr_filename) == SCR_SUCCESS)
-                    return Bat->openCb(scr_filename, nsname, Bat->ioFlags, Bat->clientData);
-                else
-                    return Bat->openCb(fname, nsname, Bat->ioFlags, Bat->clientData);
-#else
-                return Bat->openCb(fname, nsname, Bat->ioFlags, Bat->clientData);
+    char scr_filename[SCR_MAX_FILENAME];
+    if (Bat->ioFlags.use_scr && SCR_Route_file(fname, scr_filename) == SCR_SUCCESS)
+        fname = scr_filename;
 #endif
-            }
-            else
-            {
-                return Bat->openCb(fname, nsname, Bat->ioFlags, Bat->clientData);
-            }
-        }
+
+    if (create)
+        return Bat->createCb(fname, nsname, Bat->clientData);
+    return Bat->openCb(fname, nsname, Bat->ioFlags, Bat->clientData);
+}
+
+void *
+MACSIO_MIF_WaitForBaton(
+    MACSIO_MIF_baton_t *Bat,
+    char const *fname,
+    char const *nsname
+)
+{
+    MACSIO_TIMING_TimerId_t tid;
+    void *file;
+
+    tid = MT_StartTimer("MIF baton wait", Bat->timerGroup, MACSIO_TIMING_ITER_AUTO);
+    if (!receive_baton(Bat))
+    {
+        Bat->phaseTime[MIF_PHASE_WAIT] += MT_StopTimer(tid);
+        return 0;
     }
+    Bat->phaseTime[MIF_PHASE_WAIT] += MT_StopTimer(tid);
+
+    if (Bat->procBeforeMe == -1 && Bat->ioFlags.do_wr)
+        tid = MT_StartTimer("MIF create", Bat->timerGroup, MACSIO_TIMING_ITER_AUTO);
+    else
+        tid = MT_StartTimer("MIF open", Bat->timerGroup, MACSIO_TIMING_ITER_AUTO);
+    file = open_file(Bat, fname, nsname);
+    Bat->phaseTime[MIF_PHASE_OPEN] += MT_StopTimer(tid);
+
+    /* Plugin's work on the file lasts until it hands off the baton */
+    Bat->writeTid = MT_StartTimer("MIF write", Bat->timerGroup, MACSIO_TIMING_ITER_AUTO);
+
+    return file;
 }
 
 int
@@ -257,7 +911,20 @@ MACSIO_MIF_HandOffBaton(
     void *file
 )
 {
-    int retval = Bat->closeCb(file, Bat->clientData);
+    MACSIO_TIMING_TimerId_t tid;
+    int retval;
+
+    if (Bat->writeTid != MIF_NO_TIMER)
+    {
+        Bat->phaseTime[MIF_PHASE_WRITE] += MT_StopTimer(Bat->writeTid);
+        Bat->writeTid = MIF_NO_TIMER;
+    }
+
+    tid = MT_StartTimer("MIF close", Bat->timerGroup, MACSIO_TIMING_ITER_AUTO);
+    retval = Bat->closeCb(file, Bat->clientData);
+    Bat->phaseTime[MIF_PHASE_CLOSE] += MT_StopTimer(tid);
+
+    tid = MT_StartTimer("MIF handoff", Bat->timerGroup, MACSIO_TIMING_ITER_AUTO);
     if (Bat->procAfterMe != -1)
     {
         int mpi_err;
@@ -274,6 +941,22 @@ MACSIO_MIF_HandOffBaton(
             Bat->mpiErr = mpi_err;
         }
     }
+#ifdef HAVE_MPI
+    else if (Bat->procAfterMyGroup != -1)
+    {
+        /* Let the group in the next wave in the same slot as this one begin */
+        int baton = Bat->mifErr;
+        int mpi_err = MPI_Ssend(&baton, 1, MPI_INT, Bat->procAfterMyGroup,
+                                Bat->mpiTag, Bat->mpiComm);
+        if (mpi_err != MPI_SUCCESS)
+        {
+            Bat->mifErr = MACSIO_MIF_BATON_ERR;
+            Bat->mpiErr = mpi_err;
+        }
+    }
+#endif
+    Bat->phaseTime[MIF_PHASE_HANDOFF] += MT_StopTimer(tid);
+
     return retval;
 }
 
@@ -284,15 +967,16 @@ MACSIO_MIF_RankOfGroup(
 )
 {
     int retval;
+    int pos = Bat->posOfRank ? Bat->posOfRank[rankInComm] : rankInComm;
 
-    if (rankInComm < Bat->commSplit)
+    if (pos < Bat->commSplit)
     {
-        retval = rankInComm / (Bat->groupSize + 1);
+        retval = pos / (Bat->groupSize + 1);
     }
     else
     {
         retval = Bat->numGroupsWithExtraProc +
-                 (rankInComm - Bat->commSplit) / Bat->groupSize; 
+                 (pos - Bat->commSplit) / Bat->groupSize; 
     }
 
     return retval;
@@ -305,15 +989,216 @@ MACSIO_MIF_RankInGroup(
 )
 {
     int retval;
+    int pos = Bat->posOfRank ? Bat->posOfRank[rankInComm] : rankInComm;
 
-    if (rankInComm < Bat->commSplit)
+    if (pos < Bat->commSplit)
     {
-        retval = rankInComm % (Bat->groupSize + 1);
+        retval = pos % (Bat->groupSize + 1);
     }
     else
     {
-        retval = (rankInComm - Bat->commSplit) % Bat->groupSize;
+        retval = (pos - Bat->commSplit) % Bat->groupSize;
     }
 
     return retval;
 }
+
+int
+MACSIO_MIF_NumGroups(
+    MACSIO_MIF_baton_t const *Bat
+)
+{
+    return Bat->numGroups;
+}
+
+int
+MACSIO_MIF_IsLastInGroup(
+    MACSIO_MIF_baton_t const *Bat
+)
+{
+    return Bat->procAfterMe == -1;
+}
+
+void
+MACSIO_MIF_RecordGroupFile(
+    MACSIO_MIF_baton_t const *Bat,
+    int dumpNum,
+    char const *fileName
+)
+{
+    if (MACSIO_MIF_IsLastInGroup(Bat))
+        MACSIO_UTILS_RecordOutputFiles(dumpNum, (char *) fileName);
+}
+
+#ifdef HAVE_MPI
+
+/* Node and aggregator communicators of a communicator. They are cached on it as an
+   attribute so that they are split once rather than once per dump and so that group
+   layouts cached on the aggregators' communicator survive from dump to dump. */
+typedef struct _node_comms_t
+{
+    MPI_Comm nodeComm;          /* Processors sharing memory with this processor */
+    MPI_Comm aggComm;           /* Aggregators of all nodes (MPI_COMM_NULL if not one) */
+} node_comms_t;
+
+static int nodeCommsKeyval = MPI_KEYVAL_INVALID;
+
+/* Attribute delete callback, called when the communicator is freed */
+static int
+free_node_comms(MPI_Comm comm, int keyval, void *attr, void *extra)
+{
+    node_comms_t *nc = (node_comms_t *) attr;
+    if (nc->aggComm != MPI_COMM_NULL)
+        MPI_Comm_free(&nc->aggComm);
+    MPI_Comm_free(&nc->nodeComm);
+    free(nc);
+    return MPI_SUCCESS;
+}
+
+/* Get the node and aggregator communicators of a communicator, splitting them if they
+   are not cached. Collective on mpiComm when it splits. */
+static node_comms_t const *
+get_node_comms(
+    MPI_Comm mpiComm
+)
+{
+    node_comms_t *nc = 0;
+    int found = 0, rankInComm, nodeRank;
+    MACSIO_TIMING_TimerId_t tid;
+
+    if (nodeCommsKeyval == MPI_KEYVAL_INVALID)
+        MPI_Comm_create_keyval(MPI_COMM_NULL_COPY_FN, free_node_comms, &nodeCommsKeyval, 0);
+    MPI_Comm_get_attr(mpiComm, nodeCommsKeyval, &nc, &found);
+    if (found)
+        return nc;
+
+    tid = MT_StartTimer("MIF setup", MACSIO_TIMING_GroupMask("MIF"), MACSIO_TIMING_ITER_AUTO);
+
+    nc = (node_comms_t *) malloc(sizeof(node_comms_t));
+    MPI_Comm_rank(mpiComm, &rankInComm);
+    MPI_Comm_split_type(mpiComm, MPI_COMM_TYPE_SHARED, rankInComm, MPI_INFO_NULL, &nc->nodeComm);
+    MPI_Comm_rank(nc->nodeComm, &nodeRank);
+
+    /* The lowest rank on each node is its aggregator */
+    MPI_Comm_split(mpiComm, nodeRank == 0 ? 0 : MPI_UNDEFINED, rankInComm, &nc->aggComm);
+    MPI_Comm_set_attr(mpiComm, nodeCommsKeyval, nc);
+
+    MT_StopTimer(tid);
+
+    return nc;
+}
+
+/*! \struct _MACSIO_MIF_nodeAgg_t */
+typedef struct _MACSIO_MIF_nodeAgg_t
+{
+    MPI_Comm nodeComm;          /**< Processors sharing memory with this processor (cached, not owned) */
+    MPI_Comm aggComm;           /**< Aggregators of all nodes (MPI_COMM_NULL if not one; cached, not owned) */
+    int nodeRank;               /**< Rank of this processor in nodeComm */
+    int nodeSize;               /**< Size of nodeComm */
+    MPI_Win win;                /**< Shared window of the current gather (MPI_WIN_NULL if none) */
+} MACSIO_MIF_nodeAgg_t;
+
+MACSIO_MIF_nodeAgg_t *
+MACSIO_MIF_NodeAggInit(
+    MPI_Comm mpiComm
+)
+{
+    node_comms_t const *nc = get_node_comms(mpiComm);
+    MACSIO_MIF_nodeAgg_t *ret = (MACSIO_MIF_nodeAgg_t *) malloc(sizeof(MACSIO_MIF_nodeAgg_t));
+
+    ret->nodeComm = nc->nodeComm;
+    ret->aggComm = nc->aggComm;
+    MPI_Comm_rank(ret->nodeComm, &ret->nodeRank);
+    MPI_Comm_size(ret->nodeComm, &ret->nodeSize);
+    ret->win = MPI_WIN_NULL;
+
+    return ret;
+}
+
+void
+MACSIO_MIF_NodeAggFinish(
+    MACSIO_MIF_nodeAgg_t *agg
+)
+{
+    if (agg->win != MPI_WIN_NULL)
+        MACSIO_MIF_NodeAggRelease(agg);
+    free(agg);
+}
+
+int
+MACSIO_MIF_NodeAggIsAggregator(
+    MACSIO_MIF_nodeAgg_t const *agg
+)
+{
+    return agg->nodeRank == 0;
+}
+
+MPI_Comm
+MACSIO_MIF_NodeAggComm(
+    MACSIO_MIF_nodeAgg_t const *agg
+)
+{
+    return agg->aggComm;
+}
+
+MPI_Comm
+MACSIO_MIF_NodeAggNodeComm(
+    MACSIO_MIF_nodeAgg_t const *agg
+)
+{
+    return agg->nodeComm;
+}
+
+void *
+MACSIO_MIF_NodeAggGather(
+    MACSIO_MIF_nodeAgg_t *agg,
+    void const *buf,
+    size_t len,
+    size_t *offset,
+    size_t *aggLen
+)
+{
+    unsigned long long myLen = len, myOffset = 0, totLen = 0;
+    void *mySeg = 0, *aggBuf = 0;
+
+    if (agg->win != MPI_WIN_NULL)
+        MACSIO_MIF_NodeAggRelease(agg);
+
+    /* Each processor's segment of the window is contiguous with those of the
+       processors before it on the node. So, it lands at its exclusive prefix sum. */
+    MPI_Exscan(&myLen, &myOffset, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, agg->nodeComm);
+    if (agg->nodeRank == 0) myOffset = 0;
+    MPI_Reduce(&myLen, &totLen, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, agg->nodeComm);
+
+    MPI_Win_allocate_shared((MPI_Aint) len, 1, MPI_INFO_NULL, agg->nodeComm, &mySeg, &agg->win);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, agg->win);
+    if (len)
+        memcpy(mySeg, buf, len);
+    MPI_Win_sync(agg->win);
+    MPI_Barrier(agg->nodeComm);
+    MPI_Win_sync(agg->win);
+
+    if (agg->nodeRank == 0 && totLen)
+    {
+        /* Address of the first non-empty segment which is where the whole buffer starts */
+        MPI_Aint segSize;
+        int dispUnit;
+        MPI_Win_shared_query(agg->win, MPI_PROC_NULL, &segSize, &dispUnit, &aggBuf);
+    }
+
+    if (offset) *offset = (size_t) myOffset;
+    if (aggLen) *aggLen = agg->nodeRank == 0 ? (size_t) totLen : 0;
+    return aggBuf;
+}
+
+void
+MACSIO_MIF_NodeAggRelease(
+    MACSIO_MIF_nodeAgg_t *agg
+)
+{
+    if (agg->win == MPI_WIN_NULL) return;
+    MPI_Win_unlock_all(agg->win);
+    MPI_Win_free(&agg->win);
+}
+
+#endif /* HAVE_MPI */
@@ -32,6 +32,8 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include <mpi.h>
 #endif
 
+#include <json-cwx/json.h>
+
 /*!
 \defgroup MACSIO_MIF MACSIO_MIF
 \brief Utilities supporting Multiple Indpendent File (MIF) Parallel I/O
@@ -45,6 +47,105 @@ extern "C" {
 #define MACSIO_MIF_READ  0
 #define MACSIO_MIF_WRITE 1
 
+/*! \brief File count requesting one file per processor */
+#define MACSIO_MIF_MIFMAX -1
+/*! \brief File count requesting MACSIO_MIF choose a file count */
+#define MACSIO_MIF_MIFAUTO -2
+
+/*! \brief Parallel file modes of \c --parallel_file_mode */
+typedef enum _MACSIO_MIF_fileMode_t
+{
+    MACSIO_MIF_MODE_SIF = 0, /**< Single shared file (or, with a file count, several; see \ref MACSIO_MSF) */
+    MACSIO_MIF_MODE_MIF,     /**< Multiple independent files, including \c MIFMAX, \c MIFAUTO and \c MIFOPT */
+    MACSIO_MIF_MODE_MIFMEM   /**< MIF with each group's file assembled in memory by its leader */
+} MACSIO_MIF_fileMode_t;
+
+/*!
+\brief Maximum number of groups writing at the same time
+
+The number of files and the number of files being written at any one moment are
+independent. For example, a dump to 1024 files with this set to 128 is done in 8 waves
+of 128 concurrently written files. This limits the load on the filesystem's metadata
+servers and I/O nodes without changing the file layout. A value of zero (the default)
+means all groups write concurrently. Set by MACSio's main from \c --mif_max_concurrent.
+Processors must agree on its value when they call MACSIO_MIF_Init().
+*/
+extern int MACSIO_MIF_MaxConcurrentFiles;
+
+/*!
+\brief Strategies for assigning processors to groups
+
+Whatever the strategy, the first \em R groups have one extra processor when the
+communicator size does not divide evenly into the file count and baton passing
+proceeds in group rank order. MACSIO_MIF_RankOfGroup() and MACSIO_MIF_RankInGroup()
+answer according to the strategy in effect when the baton was created.
+*/
+typedef enum _MACSIO_MIF_groupLayout_t
+{
+    MACSIO_MIF_LAYOUT_CONTIGUOUS = 0, /**< Each group is a contiguous range of ranks (default) */
+    MACSIO_MIF_LAYOUT_ROUND_ROBIN,    /**< Rank \em r is in group \em r mod (file count) */
+    MACSIO_MIF_LAYOUT_NODE_PACKED,    /**< Ranks ordered by node so a group is on as few nodes as possible */
+    MACSIO_MIF_LAYOUT_NODE_SPREAD     /**< Ranks ordered by rank within node so a group's processors are
+                                           on different nodes and each node serves many files */
+} MACSIO_MIF_groupLayout_t;
+
+/*!
+\brief Strategy used to assign processors to groups
+
+One of \ref MACSIO_MIF_groupLayout_t. Baton passing between processors on the same
+node is much cheaper than between nodes. The node aware strategies expose that
+difference. They determine which processors share a node with \c MPI_Comm_split_type
+and \c MPI_COMM_TYPE_SHARED. All but the contiguous strategy need a map of all ranks.
+Computing it is collective. So, it is computed once per communicator, strategy and file
+count (timed by the \c MIF \c setup timer) and cached on the communicator for later
+batons. Set by MACSio's main from \c --mif_group_layout. Processors must agree on
+its value when they call MACSIO_MIF_Init().
+*/
+extern int MACSIO_MIF_GroupLayout;
+
+/*!
+\brief Report per-group phase times when a MIF I/O operation ends
+
+Every phase of a processor's turn with its group's file is timed in the \c MIF timer
+group: waiting for the baton (\c MIF \c baton \c wait), the create or open callback
+(\c MIF \c create, \c MIF \c open), the caller's work on the file between acquiring
+and handing off the baton (\c MIF \c write), the close callback (\c MIF \c close) and
+sending the baton on (\c MIF \c handoff). These appear in the timings file. When this is
+non-zero, MACSIO_MIF_Finish() also gathers the times to the first processor and logs,
+for each phase, the minimum, average and maximum over groups of the time summed over each
+group's processors as well as, for modest group counts, each group's times. This tells
+whether a slow dump is limited by file creates and opens, baton latency or bandwidth.
+Set by MACSio's main from \c --mif_group_report.
+*/
+extern int MACSIO_MIF_GroupReport;
+
+/*! \brief Lowest MPI tag MACSIO_MIF_AllocTag() hands out */
+#define MACSIO_MIF_TAG_BASE 100
+
+/*!
+\brief Allocate the MPI tag of a stream of MIF I/O operations
+
+Each concurrent stream of MIF I/O operations (e.g. a plugin's burst dumps and its
+trickle dumps, which the main thread may do while a burst dump is in flight on a
+writer thread) needs its own MPI tag so that the batons of the two never receive each
+other's messages. This returns a tag unique to \c name. Calling it again with the same
+name returns the same tag. MACSIO_MIF_Init() fails if a baton using the same tag on the
+same communicator is still live.
+
+Processors must agree on the tag of each stream without communicating. So, tags are
+allocated in the order names are first seen and all processors must first see them
+in the same order. Plugins do this by allocating their tags when they register
+themselves, which is done identically on every processor before \c main runs.
+Allocation is thread safe. A tag is the stream's for the life of the process; there
+are at most 64 streams and their names are shorter than 64 characters.
+
+\returns The MPI tag of the stream
+*/
+extern int
+MACSIO_MIF_AllocTag(
+    char const *name /**< [in] Name of the stream (e.g. \c "miftmpl dump") */
+);
+
 /*!
 \brief Bit Field struct for I/O flags
 */
@@ -88,6 +189,13 @@ Processors in the \c mpiComm communicator are broken into \c numFiles groups.
 If there is a remainder, \em R, after dividing the communicator size into
 \c numFiles groups, then the first \em R groups will have one additional
 processor.
+How processors are assigned to groups is governed by \ref MACSIO_MIF_GroupLayout.
+
+If \ref MACSIO_MIF_MaxConcurrentFiles is positive and less than the number of
+groups, the groups do not all write at once. They are scheduled in waves of at most
+that many groups. The first processor of group \em g waits, before creating the
+group's file, until the last processor of group \em g-MaxConcurrentFiles has closed
+its file.
 
 \returns The MACSIO_MIF \em baton object
 */
@@ -96,9 +204,9 @@ MACSIO_MIF_Init(
     int numFiles,                   /**< [in] Number of resultant files. Note: this is entirely independent of
                                          number of tasks. Typically, this number is chosen to match
                                          the number of independent I/O pathways between the nodes the
-                                         application is executing on and the filesystem. Pass MACSIO_MIF_MAX for
-                                         file-per-processor. Pass MACSIO_MIF_AUTO (currently not supported) to
-                                         request that MACSIO_MIF determine and use an optimum file count. */
+                                         application is executing on and the filesystem. Pass MACSIO_MIF_MIFMAX for
+                                         file-per-processor. Pass MACSIO_MIF_MIFAUTO to have MACSIO_MIF use
+                                         MACSIO_MIF_DefaultFileCount(). */
     MACSIO_MIF_ioFlags_t ioFlags,   /**< [in] See \ref MACSIO_MIF_ioFlags_t for meaning of flags. */
 #ifdef HAVE_MPI
     MPI_Comm mpiComm,               /**< [in] The MPI communicator containing all the MPI ranks that will
@@ -107,20 +215,93 @@ MACSIO_MIF_Init(
     int      mpiComm,               /**< [in] Dummy arg (ignored) for MPI communicator */
 #endif
     int mpiTag,                     /**< [in] MPI message tag MACSIO_MIF will use in all MPI messages for
-                                         this MIF I/O context. */
+                                         this MIF I/O context. Get one from MACSIO_MIF_AllocTag(). */
     MACSIO_MIF_CreateCB createCb,   /**< [in] Callback MACSIO_MIF should use to create a group's file */
     MACSIO_MIF_OpenCB openCb,       /**< [in] Callback MACSIO_MIF should use to open a group's file */
     MACSIO_MIF_CloseCB closeCb,     /**< [in] Callback MACSIO_MIF should use to close a group's file */
     void *clientData                /**< [in] Optional, client specific data MACSIO_MIF will pass to callbacks */
 );
 
+/*!
+\brief Heuristic file count for a given number of processors
+
+This is the file count used when none is given. It is a rule of thumb that grows
+slowly with scale (32 files up to 32 processors, 64 up to 8K, 128 up to 64K and 256
+beyond that) and is never more than the processor count. MACSio's main can do better by
+measuring. With \c --parallel_file_mode \c MIFAUTO (or \c MIFOPT), it probes several
+file counts with trial dumps and replaces the mode with \c MIF and the best count it finds
+before any plugin sees it. This function is the fallback when that did not happen.
+*/
+extern int
+MACSIO_MIF_DefaultFileCount(
+    int commSize /**< [in] Number of processors */
+);
+
+/*!
+\brief Get the parallel file mode and file count a plugin should dump with
+
+Parses \c --parallel_file_mode from the main object. For the MIF modes, the file count is
+that given, the processor count for \c MIFMAX and \c MIFFPP or MACSIO_MIF_DefaultFileCount()
+for \c MIFAUTO and \c MIFOPT. For SIF mode, it is that given or 1 if none was. Dies on an
+unknown mode name.
+\return One of \ref MACSIO_MIF_fileMode_t
+*/
+extern int
+MACSIO_MIF_ParallelFileMode(
+    json_object *main_obj, /**< [in] The main json object */
+    int *numFiles          /**< [out] The file count */
+);
+
+/*!
+\brief Compute and cache the group layout for a file count ahead of time
+
+MACSIO_MIF_Init() computes the group layout of a communicator the first time it
+sees a file count and caches it on the communicator. Computing it is collective on
+the communicator, so it must not happen on a thread or forked child dumping
+asynchronously while the main thread is using the same communicator. MACSio's main
+calls this before its first asynchronous dump so that the dumps find the layout
+cached. It does nothing for \ref MACSIO_MIF_LAYOUT_CONTIGUOUS. When
+\ref MACSIO_MIF_GroupReport is set, it likewise creates the communicator each
+allocated stream reports its groups on. Collective on mpiComm.
+*/
+extern void
+MACSIO_MIF_PrepareLayout(
+    int numFiles,     /**< [in] The file count as it will be passed to MACSIO_MIF_Init() */
+#ifdef HAVE_MPI
+    MPI_Comm mpiComm  /**< [in] The communicator as it will be passed to MACSIO_MIF_Init() */
+#else
+    int      mpiComm  /**< [in] Dummy arg (ignored) for MPI communicator */
+#endif
+);
+
 /*!
 \brief End a MACSIO_MIF I/O operation and free resources
+
+Collective on the communicator passed to MACSIO_MIF_Init() when
+\ref MACSIO_MIF_GroupReport is set.
 */
 extern void MACSIO_MIF_Finish(
     MACSIO_MIF_baton_t *bat /**< [in] The MACSIO_MIF baton handle */
 );
 
+/*!
+\brief Begin waiting for exclusive access to the group's file
+
+This is the first half of a split-phase MACSIO_MIF_WaitForBaton(). It posts
+non-blocking receives for the baton and returns immediately. The caller can then do
+work that does not need the file (e.g. serializing, compressing or packing its data
+into a buffer) while the tasks before it in the group are writing. A later call to
+MACSIO_MIF_WaitForBaton() completes the receives and opens (or creates) the file so
+that only the write itself remains on the group's critical path.
+
+Calling this function is optional. Any receives it posts that are never completed
+are cancelled by MACSIO_MIF_Finish().
+*/
+extern void
+MACSIO_MIF_PostBaton(
+    MACSIO_MIF_baton_t *Bat /**< [in] The MACSIO_MIF baton handle */
+);
+
 /*!
 \brief Wait for exclusive access to the group's file
 
@@ -128,6 +309,7 @@ All tasks in \c mpiComm argument to \c MACSIO_MIF_Init() call this function
 collectively. For the first task in each group, this call returns immediately.
 For all others in the group, it blocks, waiting for the task \em before it to
 finish its work on the group's file and call \c MACSIO_MIF_HandOffBaton().
+If MACSIO_MIF_PostBaton() was called, this completes the receives it posted.
 
 \returns A void pointer to whatever data instance the \c createCb or \c openCb
 methods return. The caller must cast this returned pointer to the correct type.
@@ -183,6 +365,155 @@ MACSIO_MIF_RankInGroup(
     int rankInComm                 /**< [in] The (global) rank of a task for which it's rank in a group is desired */
 );
 
+/*!
+\brief Get the number of groups (and so files)
+
+This is the file count actually in effect after MACSIO_MIF_Init() has resolved
+MACSIO_MIF_MIFMAX, MACSIO_MIF_MIFAUTO or a non-positive count.
+*/
+extern int
+MACSIO_MIF_NumGroups(
+    MACSIO_MIF_baton_t const *Bat /**< [in] The MACSIO_MIF baton handle */
+);
+
+/*!
+\brief Indicate if calling task is the last in its group
+
+The last task in a group is the last to access, and so the last to close, the
+group's file. This makes it the natural task to account for the file's size once
+the dump is complete.
+*/
+extern int
+MACSIO_MIF_IsLastInGroup(
+    MACSIO_MIF_baton_t const *Bat /**< [in] The MACSIO_MIF baton handle */
+);
+
+/*!
+\brief Record the group's file for size accounting
+
+Only the last task in the group records the file. See MACSIO_UTILS_RecordOutputFiles().
+*/
+extern void
+MACSIO_MIF_RecordGroupFile(
+    MACSIO_MIF_baton_t const *Bat, /**< [in] The MACSIO_MIF baton handle */
+    int dumpNum,                   /**< [in] Number of the dump */
+    char const *fileName           /**< [in] Name of the group's file */
+);
+
+#ifdef HAVE_MPI
+/*!
+\brief Opaque struct holding private implementation of node-level aggregation
+
+MIF mode makes every task open, write and close its group's file in turn. With
+node-level aggregation, tasks sharing a node's memory (as determined by
+\c MPI_Comm_split_type with \c MPI_COMM_TYPE_SHARED) instead deposit their data into an
+\c MPI_Win_allocate_shared window. One \em aggregator task per node then takes part in
+MIF I/O (among the aggregators only) and writes the whole node's data with one large
+write. This reduces the number of file opens and closes by the tasks-per-node factor and
+replaces many medium sized writes with a few large ones. The data is never copied
+between tasks. Requires MPI-3.
+
+A typical dump looks like...
+
+\code
+agg = MACSIO_MIF_NodeAggInit(comm);
+buf = MACSIO_MIF_NodeAggGather(agg, myData, myLen, &myOffset, &aggLen);
+if (MACSIO_MIF_NodeAggIsAggregator(agg))
+{
+    bat = MACSIO_MIF_Init(numFiles, ioFlags, MACSIO_MIF_NodeAggComm(agg), tag, ...);
+    file = MACSIO_MIF_WaitForBaton(bat, fname, 0);
+    write(file, buf, aggLen);
+    MACSIO_MIF_HandOffBaton(bat, file);
+    MACSIO_MIF_Finish(bat);
+}
+MACSIO_MIF_NodeAggRelease(agg);
+MACSIO_MIF_NodeAggFinish(agg);
+\endcode
+*/
+typedef struct _MACSIO_MIF_nodeAgg_t MACSIO_MIF_nodeAgg_t;
+
+/*!
+\brief Initialize node-level aggregation
+
+Collective on \c mpiComm. The lowest ranked task on each node is its aggregator. The
+node and aggregator communicators are split on first use and cached on \c mpiComm until
+it is freed.
+*/
+extern MACSIO_MIF_nodeAgg_t *
+MACSIO_MIF_NodeAggInit(
+    MPI_Comm mpiComm /**< [in] Communicator of all tasks taking part in the I/O */
+);
+
+/*!
+\brief End node-level aggregation and free resources
+
+Collective on the \c mpiComm passed to MACSIO_MIF_NodeAggInit().
+*/
+extern void
+MACSIO_MIF_NodeAggFinish(
+    MACSIO_MIF_nodeAgg_t *agg /**< [in] The node aggregation handle */
+);
+
+/*!
+\brief Indicate if calling task is its node's aggregator
+*/
+extern int
+MACSIO_MIF_NodeAggIsAggregator(
+    MACSIO_MIF_nodeAgg_t const *agg /**< [in] The node aggregation handle */
+);
+
+/*!
+\brief Communicator of all the aggregators
+
+This is the communicator to pass to MACSIO_MIF_Init(). It is \c MPI_COMM_NULL on
+tasks that are not aggregators. Note that its size is the number of nodes and so a
+file count larger than that cannot be used with it.
+*/
+extern MPI_Comm
+MACSIO_MIF_NodeAggComm(
+    MACSIO_MIF_nodeAgg_t const *agg /**< [in] The node aggregation handle */
+);
+
+/*!
+\brief Communicator of the tasks on calling task's node
+
+The aggregator is rank 0. Useful for broadcasting where the aggregator wrote the
+node's data (file name, offset) to the other tasks of the node.
+*/
+extern MPI_Comm
+MACSIO_MIF_NodeAggNodeComm(
+    MACSIO_MIF_nodeAgg_t const *agg /**< [in] The node aggregation handle */
+);
+
+/*!
+\brief Gather data of all tasks on a node into its aggregator's memory
+
+Collective on the node. Each task's data is copied into its own segment of a shared
+memory window. The segments are contiguous and in rank order. The buffer remains valid
+until MACSIO_MIF_NodeAggRelease() is called.
+
+\returns On the aggregator, a pointer to the node's data. Null on all other tasks.
+*/
+extern void *
+MACSIO_MIF_NodeAggGather(
+    MACSIO_MIF_nodeAgg_t *agg, /**< [in] The node aggregation handle */
+    void const *buf,           /**< [in] This task's data */
+    size_t len,                /**< [in] Size of this task's data in bytes */
+    size_t *offset,            /**< [out] Optional, offset of this task's data in the node's buffer */
+    size_t *aggLen             /**< [out] Optional, size of the node's buffer on the aggregator, zero elsewhere */
+);
+
+/*!
+\brief Release the buffer of the last MACSIO_MIF_NodeAggGather()
+
+Collective on the node. The aggregator must be done with the buffer when it calls this.
+*/
+extern void
+MACSIO_MIF_NodeAggRelease(
+    MACSIO_MIF_nodeAgg_t *agg /**< [in] The node aggregation handle */
+);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -24,7 +24,12 @@ this program; if not, write to the Free Software Foundation, Inc., 59 Temple
 Place, Suite 330, Boston, MA 02111-1307 USA
 */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #ifdef HAVE_SCR
 #ifdef __cplusplus
@@ -38,6 +43,8 @@ extern "C" {
 
 #include <macsio_msf.h>
 #include <macsio_log.h>
+#include <macsio_timing.h>
+#include <macsio_utils.h>
 
 #define MACSIO_MSF_BATON_OK  0
 #define MACSIO_MSF_BATON_ERR 1
@@ -60,10 +67,11 @@ typedef struct _MACSIO_MSF_baton_t
     int numGroups;              /**< Number of groups the MPI comm is divided into */
     int numGroupsWithExtraProc; /**< Number of groups that contain one extra proc/rank */
     int groupSize;              /**< Nominal size of each group (some groups have one extra) */
+    int sizeOfGroup;            /**< Size of this processor's group */
     int groupRank;              /**< Rank of this processor's group */
     int commSplit;              /**< Rank of the last MPI task assigned to +1 groups */
     int rankInGroup;            /**< Rank of this processor within its group */
-    int *groupRanks;            /**< Array of all of the ranks in the group */
+    int *groupRanks;            /**< Array of all of the ranks in the group (owned by the group context) */
     int groupRoot;          /**< Rank of the root process for this group */
     int procBeforeMe;           /**< Rank of processor before this processor in the group */
     int procAfterMe;            /**< Rank of processor after this processor in the group */
@@ -73,6 +81,77 @@ typedef struct _MACSIO_MSF_baton_t
     void *clientData;           /**< Client data to be passed around in calls */
 } MACSIO_MSF_baton_t;
 
+int MACSIO_MSF_CbAggregators = 0;
+int MACSIO_MSF_CbBufferSize = 16*1024*1024;
+int MACSIO_MSF_CbAlignment = 1024*1024;
+
+#ifdef HAVE_MPI
+/* The groups of a parent communicator for a file count. It is cached on the parent
+   communicator as an attribute so that the group communicator is built once per file
+   count rather than once per dump. */
+typedef struct _msf_context_t
+{
+    int numGroups;              /* File count the context was built for */
+    MPI_Comm groupComm;         /* Communicator of this processor's group */
+    int *groupRanks;            /* Ranks in the parent communicator of the group's processors */
+} msf_context_t;
+
+static int contextKeyval = MPI_KEYVAL_INVALID;
+
+/* Attribute delete callback, called when the parent communicator is freed or its
+   context replaced */
+static int
+free_context(MPI_Comm comm, int keyval, void *attr, void *extra)
+{
+    msf_context_t *ctx = (msf_context_t *) attr;
+    MPI_Comm_free(&ctx->groupComm);
+    free(ctx->groupRanks);
+    free(ctx);
+    return MPI_SUCCESS;
+}
+
+/* Get the group context of a parent communicator, building it if there is none or
+   the file count has changed. Collective on mpiComm. */
+static msf_context_t *
+get_context(
+    MPI_Comm mpiComm,
+    int numGroups,
+    int groupRank,
+    int rankInGroup,
+    int sizeOfGroup,
+    int rankInComm
+)
+{
+    msf_context_t *ctx = 0;
+    int found = 0;
+    MACSIO_TIMING_TimerId_t tid;
+
+    if (contextKeyval == MPI_KEYVAL_INVALID)
+        MPI_Comm_create_keyval(MPI_COMM_NULL_COPY_FN, free_context, &contextKeyval, 0);
+    MPI_Comm_get_attr(mpiComm, contextKeyval, &ctx, &found);
+    if (found && ctx->numGroups == numGroups)
+        return ctx;
+
+    tid = MT_StartTimer("MSF setup", MACSIO_TIMING_GroupMask("MSF"), MACSIO_TIMING_ITER_AUTO);
+
+    ctx = (msf_context_t *) malloc(sizeof(msf_context_t));
+    ctx->numGroups = numGroups;
+    ctx->groupRanks = (int *) malloc(sizeOfGroup * sizeof(int));
+    MPI_Comm_split(mpiComm, groupRank, rankInGroup, &ctx->groupComm);
+
+    /* Gather the ranks of each process in this group. They are in group rank order
+       so the first is the group's root. */
+    MPI_Allgather(&rankInComm, 1, MPI_INT, ctx->groupRanks, 1, MPI_INT, ctx->groupComm);
+
+    /* This frees any context for another file count */
+    MPI_Comm_set_attr(mpiComm, contextKeyval, ctx);
+
+    MT_StopTimer(tid);
+
+    return ctx;
+}
+#endif
+
 
 MACSIO_MSF_baton_t *MACSIO_MSF_Init(
     int numFiles,                   
@@ -87,8 +166,8 @@ MACSIO_MSF_baton_t *MACSIO_MSF_Init(
 )
 {
     int numGroups = numFiles;
-    int commSize, rankInComm;
-    int groupSize, numGroupsWithExtraProc, commSplit,
+    int commSize = 1, rankInComm = 0;
+    int groupSize, numGroupsWithExtraProc, commSplit, sizeOfGroup,
         groupRank, rankInGroup, procBeforeMe, procAfterMe;
     MACSIO_MSF_baton_t *ret = 0;
 
@@ -114,7 +193,7 @@ MACSIO_MSF_baton_t *MACSIO_MSF_Init(
         rankInGroup = rankInComm % (groupSize + 1);
         if (rankInGroup < groupSize)
             procAfterMe = rankInComm + 1;
-        groupSize++;
+        sizeOfGroup = groupSize + 1;
     }
     else
     {
@@ -122,30 +201,17 @@ MACSIO_MSF_baton_t *MACSIO_MSF_Init(
         rankInGroup = (rankInComm - commSplit) % groupSize;
         if (rankInGroup < groupSize - 1)
             procAfterMe = rankInComm + 1;
+        sizeOfGroup = groupSize;
     }
     if (rankInGroup > 0)
         procBeforeMe = rankInComm - 1;
 
-    /* Create group communicator */
-    int groupRootRank;
-    int *groupRanks = (int*)malloc(sizeof(int) * groupSize);
+    int groupRootRank = 0;
+    int *groupRanks = 0;
 #ifdef HAVE_MPI
-    MPI_Comm groupComm;
-    MPI_Comm_split(mpiComm, groupRank, rankInGroup, &groupComm);
- 
-    /* Gather the ranks of each process in this group */
-    MPI_Allgather(&rankInComm, 1, MPI_INT, groupRanks, 1, MPI_INT, groupComm);
-
-    /* Broadcast the rank from the group root to rest of group */
-    int amIRoot = rankInGroup == 0 ? rankInComm : -1;
-    int *rankArray = (int*)malloc(sizeof(int) * groupSize);
-    MPI_Allgather(&amIRoot, 1, MPI_INT, rankArray, 1, MPI_INT, groupComm);
-    for (int i = 0; i<groupSize; i++){
-        if (rankArray[i] > -1){
-            groupRootRank = rankArray[i];
-            break;
-        }
-    }
+    msf_context_t *ctx = get_context(mpiComm, numGroups, groupRank, rankInGroup, sizeOfGroup, rankInComm);
+    groupRanks = ctx->groupRanks;
+    groupRootRank = groupRanks[0];
 #endif
 
     ret = (MACSIO_MSF_baton_t *) malloc(sizeof(MACSIO_MSF_baton_t));
@@ -154,6 +220,7 @@ MACSIO_MSF_baton_t *MACSIO_MSF_Init(
     ret->rankInComm = rankInComm;
     ret->numGroups = numGroups;
     ret->groupSize = groupSize;
+    ret->sizeOfGroup = sizeOfGroup;
     ret->numGroupsWithExtraProc = numGroupsWithExtraProc;
     ret->commSplit = commSplit;
     ret->groupRank = groupRank;
@@ -165,7 +232,7 @@ MACSIO_MSF_baton_t *MACSIO_MSF_Init(
     ret->MSFErr = MACSIO_MSF_BATON_OK;
 #ifdef HAVE_MPI
     ret->mpiErr = MPI_SUCCESS;
-    ret->mpiComm = groupComm;
+    ret->mpiComm = ctx->groupComm;
 #else
     ret->mpiErr = 0;
 #endif
@@ -179,9 +246,7 @@ void MACSIO_MSF_Finish(
     MACSIO_MSF_baton_t *bat
 )
 {
-#ifdef HAVE_MPI
-    MPI_Comm_free(&(bat->mpiComm));
-#endif
+    /* The group communicator belongs to the group context and is kept for the next dump */
     free(bat);
 }
 
@@ -228,7 +293,7 @@ int MACSIO_MSF_SizeOfGroup(
     MACSIO_MSF_baton_t const *Bat
 )
 {
-    return Bat->groupSize;
+    return Bat->sizeOfGroup;
 }
 
 #ifdef HAVE_MPI
@@ -246,4 +311,306 @@ int MACSIO_MSF_RootOfGroup(
 {
     return Bat->groupRoot;
 }
+
+void MACSIO_MSF_RecordGroupFile(
+    MACSIO_MSF_baton_t const *Bat,
+    int dumpNum,
+    char const *fileName
+)
+{
+    if (Bat->rankInGroup == 0)
+        MACSIO_UTILS_RecordOutputFiles(dumpNum, (char *) fileName);
+}
+
+/* Write all of a buffer at an offset, retrying short writes */
+static int
+write_fully(int fd, char const *buf, long long len, long long off)
+{
+    while (len > 0)
+    {
+        ssize_t n = pwrite(fd, buf, (size_t) len, (off_t) off);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+        off += n;
+    }
+    return 0;
+}
+
+#ifdef HAVE_MPI
+/* A processor's piece of the file */
+typedef struct _msf_extent_t
+{
+    long long off;
+    long long len;
+    int rank;
+} msf_extent_t;
+
+static int
+compare_extents(void const *a, void const *b)
+{
+    msf_extent_t const *ea = (msf_extent_t const *) a;
+    msf_extent_t const *eb = (msf_extent_t const *) b;
+    if (ea->off != eb->off) return ea->off < eb->off ? -1 : 1;
+    return ea->rank - eb->rank;
+}
+
+/* Rank in the group of an aggregator. Aggregators are spread evenly over the group. */
+static int
+agg_rank(int agg, int numAggs, int groupSize)
+{
+    return (int) ((long long) agg * groupSize / numAggs);
+}
+
+/* Datatype of len bytes, for lengths that may not fit in an int count */
+static MPI_Datatype
+bytes_type(long long len)
+{
+    long long const chunk = 1LL << 30;
+    int blens[2] = {1, (int) (len % chunk)};
+    MPI_Aint displs[2] = {0, (MPI_Aint) (len / chunk * chunk)};
+    MPI_Datatype chunkType, types[2], ret;
+
+    MPI_Type_contiguous((int) chunk, MPI_BYTE, &chunkType);
+    MPI_Type_contiguous((int) (len / chunk), chunkType, &types[0]);
+    types[1] = MPI_BYTE;
+    MPI_Type_create_struct(2, blens, displs, types, &ret);
+    MPI_Type_commit(&ret);
+    MPI_Type_free(&types[0]);
+    MPI_Type_free(&chunkType);
+
+    return ret;
+}
+
+/* Two-phase write of each processor's piece of the group's file. The file's extent is
+   divided into one alignment multiple sized domain per aggregator. In each round, every
+   aggregator receives the data falling in the next buffer sized window of its domain
+   with one MPI_Alltoallw and writes each contiguous run of it with one call. A round's
+   counts are at most the buffer size but a processor's piece may be larger than an int
+   can index. So, each piece sent is described by a datatype with an MPI_Aint
+   displacement. Collective on the group's communicator. fd is only used by aggregators. */
+static int
+two_phase_write(MACSIO_MSF_baton_t const *bat, int fd, long long offset, char const *buf, long long len)
+{
+    MPI_Comm comm = bat->mpiComm;
+    int size = bat->sizeOfGroup, me = bat->rankInGroup;
+    int i, a, r, myAgg = -1, err = 0;
+    int numAggs = MACSIO_MSF_CbAggregators < size ? MACSIO_MSF_CbAggregators : size;
+    long long align = MACSIO_MSF_CbAlignment > 0 ? MACSIO_MSF_CbAlignment : 1;
+    long long bufSize = (long long) MACSIO_MSF_CbBufferSize / align * align;
+    long long lo = LLONG_MAX, hi = 0, domSize, numRounds;
+    long long mine[2] = {offset, len};
+    long long *all = (long long *) malloc(2 * size * sizeof(long long));
+    msf_extent_t *ext = (msf_extent_t *) malloc(size * sizeof(msf_extent_t));
+    int *scounts = (int *) malloc(4 * size * sizeof(int));
+    int *sdispls = scounts + size, *rcounts = scounts + 2*size, *rdispls = scounts + 3*size;
+    MPI_Datatype *stypes = (MPI_Datatype *) malloc(2 * size * sizeof(MPI_Datatype));
+    MPI_Datatype *rtypes = stypes + size;
+    char *aggBuf = 0;
+
+    if (bufSize < align) bufSize = align;
+
+    MPI_Allgather(mine, 2, MPI_LONG_LONG, all, 2, MPI_LONG_LONG, comm);
+    for (i = 0; i < size; i++)
+    {
+        ext[i].off = all[2*i];
+        ext[i].len = all[2*i+1];
+        ext[i].rank = i;
+        if (ext[i].len <= 0) continue;
+        if (ext[i].off < lo) lo = ext[i].off;
+        if (ext[i].off + ext[i].len > hi) hi = ext[i].off + ext[i].len;
+    }
+    free(all);
+
+    if (lo < hi)
+    {
+        lo = lo / align * align;
+        domSize = ((hi - lo + numAggs - 1) / numAggs + align - 1) / align * align;
+        numRounds = (domSize + bufSize - 1) / bufSize;
+        for (a = 0; a < numAggs; a++)
+        {
+            if (agg_rank(a, numAggs, size) == me)
+                myAgg = a;
+        }
+        if (myAgg >= 0)
+        {
+            aggBuf = (char *) malloc((size_t) bufSize);
+            qsort(ext, size, sizeof(msf_extent_t), compare_extents);
+        }
+
+        for (r = 0; r < numRounds; r++)
+        {
+            memset(scounts, 0, 4 * size * sizeof(int));
+            for (i = 0; i < size; i++)
+                stypes[i] = rtypes[i] = MPI_BYTE;
+
+            /* What this processor sends to each aggregator this round */
+            for (a = 0; a < numAggs && len > 0; a++)
+            {
+                long long ws = lo + a * domSize + r * bufSize;
+                long long we = ws + bufSize < lo + (a+1) * domSize ? ws + bufSize : lo + (a+1) * domSize;
+                long long s = offset > ws ? offset : ws;
+                long long e = offset + len < we ? offset + len : we;
+                int n = (int) (e - s);
+                MPI_Aint disp = (MPI_Aint) (s - offset);
+                if (s >= e) continue;
+                MPI_Type_create_hindexed(1, &n, &disp, MPI_BYTE, &stypes[agg_rank(a, numAggs, size)]);
+                MPI_Type_commit(&stypes[agg_rank(a, numAggs, size)]);
+                scounts[agg_rank(a, numAggs, size)] = 1;
+            }
+
+            /* What this aggregator receives from each processor this round */
+            if (myAgg >= 0)
+            {
+                long long ws = lo + myAgg * domSize + r * bufSize;
+                long long we = ws + bufSize < lo + (myAgg+1) * domSize ? ws + bufSize : lo + (myAgg+1) * domSize;
+                long long runStart = -1, runEnd = -1;
+
+                for (i = 0; i < size; i++)
+                {
+                    long long s = ext[i].off > ws ? ext[i].off : ws;
+                    long long e = ext[i].off + ext[i].len < we ? ext[i].off + ext[i].len : we;
+                    if (ext[i].len <= 0 || s >= e) continue;
+                    rcounts[ext[i].rank] = (int) (e - s);
+                    rdispls[ext[i].rank] = (int) (s - ws);
+                }
+
+                MPI_Alltoallw((void *) buf, scounts, sdispls, stypes,
+                    aggBuf, rcounts, rdispls, rtypes, comm);
+
+                /* Write each contiguous run of the window's data with a single call */
+                for (i = 0; i <= size; i++)
+                {
+                    long long s = -1, e = -1;
+                    if (i < size)
+                    {
+                        s = ext[i].off > ws ? ext[i].off : ws;
+                        e = ext[i].off + ext[i].len < we ? ext[i].off + ext[i].len : we;
+                        if (ext[i].len <= 0 || s >= e) continue;
+                        if (s <= runEnd)
+                        {
+                            if (e > runEnd) runEnd = e;
+                            continue;
+                        }
+                    }
+                    if (runStart >= 0 && write_fully(fd, aggBuf + (runStart - ws), runEnd - runStart, runStart) < 0)
+                        err = -1;
+                    runStart = s;
+                    runEnd = e;
+                }
+            }
+            else
+            {
+                MPI_Alltoallw((void *) buf, scounts, sdispls, stypes,
+                    aggBuf, rcounts, rdispls, rtypes, comm);
+            }
+
+            for (i = 0; i < size; i++)
+            {
+                if (stypes[i] != MPI_BYTE)
+                    MPI_Type_free(&stypes[i]);
+            }
+        }
+    }
+
+    free(aggBuf);
+    free(stypes);
+    free(scounts);
+    free(ext);
+
+    return err;
+}
+#endif
+
+int
+MACSIO_MSF_WriteAt(
+    MACSIO_MSF_baton_t const *bat,
+    char const *fileName,
+    long long offset,
+    void const *buf,
+    long long len
+)
+{
+    int fd, err = 0;
+    MACSIO_TIMING_TimerId_t tid = MT_StartTimer("MSF write", MACSIO_TIMING_GroupMask("MSF"),
+        MACSIO_TIMING_ITER_AUTO);
+
+#ifdef HAVE_MPI
+    if (MACSIO_MSF_CbAggregators < 0)
+    {
+        /* Leave it to the MPI library's collective buffering */
+        MPI_File fh;
+        if (MPI_File_open(bat->mpiComm, (char *) fileName, MPI_MODE_CREATE|MPI_MODE_WRONLY,
+                MPI_INFO_NULL, &fh) != MPI_SUCCESS)
+        {
+            MACSIO_LOG_MSG(Err, ("Unable to open \"%s\"", fileName));
+            MT_StopTimer(tid);
+            return -1;
+        }
+        MPI_File_set_size(fh, 0);
+        if (len > INT_MAX)
+        {
+            MPI_Datatype type = bytes_type(len);
+            if (MPI_File_write_at_all(fh, (MPI_Offset) offset, (void *) buf, 1, type,
+                    MPI_STATUS_IGNORE) != MPI_SUCCESS)
+                err = -1;
+            MPI_Type_free(&type);
+        }
+        else if (MPI_File_write_at_all(fh, (MPI_Offset) offset, (void *) buf, (int) len, MPI_BYTE,
+                MPI_STATUS_IGNORE) != MPI_SUCCESS)
+            err = -1;
+        MPI_File_close(&fh);
+        MT_StopTimer(tid);
+        return err;
+    }
+#endif
+
+    /* The group's root creates the file before anyone writes to it */
+    if (bat->rankInGroup == 0)
+    {
+        fd = open(fileName, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+        if (fd < 0)
+            err = -1;
+        else
+            close(fd);
+    }
+#ifdef HAVE_MPI
+    MPI_Barrier(bat->mpiComm);
+#endif
+
+    fd = -1;
+#ifdef HAVE_MPI
+    if (MACSIO_MSF_CbAggregators > 0)
+    {
+        int a, numAggs = MACSIO_MSF_CbAggregators < bat->sizeOfGroup ?
+            MACSIO_MSF_CbAggregators : bat->sizeOfGroup;
+        for (a = 0; a < numAggs; a++)
+        {
+            if (agg_rank(a, numAggs, bat->sizeOfGroup) == bat->rankInGroup)
+                fd = open(fileName, O_WRONLY);
+        }
+        if (two_phase_write(bat, fd, offset, (char const *) buf, len) < 0)
+            err = -1;
+    }
+    else
+#endif
+    if (len > 0)
+    {
+        fd = open(fileName, O_WRONLY);
+        if (fd < 0 || write_fully(fd, (char const *) buf, len, offset) < 0)
+            err = -1;
+    }
+    if (fd >= 0)
+        close(fd);
+
+    if (err)
+        MACSIO_LOG_MSG(Err, ("Unable to write to \"%s\"", fileName));
+    MT_StopTimer(tid);
+
+    return err;
+}
 /*!@}*/
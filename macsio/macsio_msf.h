@@ -56,7 +56,46 @@ typedef struct _MACSIO_MSF_ioFlags_t
 
 typedef struct _MACSIO_MSF_baton_t MACSIO_MSF_baton_t;
 
-//#warning ENSURE DIFFERENT INSTANCES USE DIFFERENT MPI TAGS
+/*!
+\brief Number of collective buffering aggregators per group
+
+Governs how MACSIO_MSF_WriteAt() writes the processors' pieces of a group's file.
+With zero (the default), each processor writes its own piece. With a positive value,
+MACSIO_MSF does two-phase collective buffering itself. The pieces are exchanged with
+\c MPI_Alltoallv to this many aggregators spread evenly over the group, which write
+large, aligned, contiguous runs. With a negative value, the pieces are written with
+\c MPI_File_write_at_all to compare with the MPI library's own collective buffering.
+Set by MACSio's main from \c --msf_cb_aggregators.
+*/
+extern int MACSIO_MSF_CbAggregators;
+
+/*!
+\brief Size of each aggregator's collective buffer in bytes
+
+Each aggregator receives and writes at most this many bytes per round. Rounded down to
+a multiple of MACSIO_MSF_CbAlignment. Set by MACSio's main from \c --msf_cb_buffer_size.
+*/
+extern int MACSIO_MSF_CbBufferSize;
+
+/*!
+\brief Alignment of aggregators' file domains in bytes
+
+Each aggregator's domain of the file starts at a multiple of this (e.g. the file
+system's stripe size) so no two aggregators write the same stripe. Set by MACSio's
+main from \c --msf_cb_align.
+*/
+extern int MACSIO_MSF_CbAlignment;
+
+/*!
+\brief Begin an MSF I/O operation
+
+Divides the processors of \c mpiComm into \c numFiles groups, each with its own
+communicator. Building the group communicators takes an \c MPI_Comm_split and an
+\c MPI_Allgather. So, they are built only on the first call for a given \c mpiComm and
+file count (timed by the \c MSF \c setup timer) and are cached on \c mpiComm for later
+calls. The cache is replaced when the file count changes and freed with \c mpiComm.
+Collective on \c mpiComm.
+*/
 #ifdef HAVE_MPI
 extern MACSIO_MSF_baton_t *MACSIO_MSF_Init(int numFiles, MACSIO_MSF_ioFlags_t ioFlags,
     MPI_Comm mpiComm, int mpiTag,
@@ -75,6 +114,31 @@ extern MPI_Comm MACSIO_MSF_CommOfGroup(MACSIO_MSF_baton_t const *Bat);
 #endif
 extern int MACSIO_MSF_RootOfGroup(MACSIO_MSF_baton_t const *Bat);
 
+/*!
+\brief Record the group's file for size accounting
+
+Only the first task in the group records the file. See MACSIO_UTILS_RecordOutputFiles().
+*/
+extern void MACSIO_MSF_RecordGroupFile(MACSIO_MSF_baton_t const *Bat, int dumpNum, char const *fileName);
+
+/*!
+\brief Write each processor's piece of its group's file
+
+Each processor passes the offset and length of its piece of the group's file. Pieces
+must not overlap. The file is created (or truncated) first. How the pieces are written
+is governed by \ref MACSIO_MSF_CbAggregators. Collective on the group's communicator.
+Timed by the \c MSF \c write timer.
+
+\returns 0 on success, -1 if any write on this processor failed
+*/
+extern int MACSIO_MSF_WriteAt(
+    MACSIO_MSF_baton_t const *bat, /**< [in] The MSF baton */
+    char const *fileName,          /**< [in] Name of the group's file */
+    long long offset,              /**< [in] Offset of this processor's piece in the file */
+    void const *buf,               /**< [in] This processor's piece */
+    long long len                  /**< [in] Length of this processor's piece in bytes */
+);
+
 #ifdef __cplusplus
 }
 #endif
@@ -38,81 +38,152 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include <cfloat>
 #include <climits>
 #include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
+#include <time.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define MACSIO_TIMING_HAVE_TSC
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
 
 #define MACSIO_TIMING_HASH_TABLE_SIZE 10007
 
-int MACSIO_TIMING_UseMPI_Wtime = 1;
+static char const *clockNames[] = {"gettimeofday", "mpi_wtime", "monotonic_raw", "tsc"};
+static int timerClock = -1;   /* Clock in use or -1 if not yet chosen */
+static double clockBase;      /* Reading of timerClock that is time zero */
 
-static double get_current_time()
-{
-    static int first = 1;
+#ifdef MACSIO_TIMING_HAVE_TSC
+static unsigned long long tscBase;
+static double tscSecsPerTick;
 
-#ifdef HAVE_MPI
-    if (MACSIO_TIMING_UseMPI_Wtime)
-    {
-        static double t0;
-        if (first)
-        {
-            first = 0;
-            t0 = MPI_Wtime();
-            return 0;
-        }
-        return MPI_Wtime() - t0;
-    }
-#endif
+/* Check the processor's TSC ticks at a constant rate regardless of frequency
+   scaling and sleep states */
+static int
+tsc_is_invariant(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
+        return 0;
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return (edx >> 8) & 0x1;
+}
 
-#if defined(_WIN32)
+/* Measure TSC frequency against CLOCK_MONOTONIC_RAW over ~20 milliseconds */
+static int
+calibrate_tsc(void)
+{
+    struct timespec ts0, ts1;
+    unsigned long long c0, c1;
+    double dt;
 
-    static struct _timeb T0;
-           struct _timeb T1;
-    int ms;
+    if (!tsc_is_invariant())
+        return 0;
 
-    /* initilize T0 */
-    if (first)
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts0);
+    c0 = __rdtsc();
+    do
     {
-        first = 0;
-        _ftime(&T0);
-        return 0.0;
-    }
-
-    _ftime(T1);
+        clock_gettime(CLOCK_MONOTONIC_RAW, &ts1);
+        dt = (double) (ts1.tv_sec - ts0.tv_sec) + (double) (ts1.tv_nsec - ts0.tv_nsec) * 1e-9;
+    } while (dt < 0.02);
+    c1 = __rdtsc();
+    if (c1 <= c0)
+        return 0;
 
-    ms = (int) difftime(T1.time, T0.time);
+    tscBase = c0;
+    tscSecsPerTick = dt / (double) (c1 - c0);
+    return 1;
+}
+#endif
 
-    if (ms == 0)
+static int
+clock_available(int clk)
+{
+    switch (clk)
     {
-        ms = T1.millitm - T0.millitm;
+        case MACSIO_TIMING_CLOCK_GETTIMEOFDAY: return 1;
+#ifdef HAVE_MPI
+        case MACSIO_TIMING_CLOCK_MPI_WTIME: return 1;
+#endif
+#ifdef CLOCK_MONOTONIC_RAW
+        case MACSIO_TIMING_CLOCK_MONOTONIC_RAW: return 1;
+#endif
+#ifdef MACSIO_TIMING_HAVE_TSC
+        case MACSIO_TIMING_CLOCK_TSC: return tscSecsPerTick > 0 || calibrate_tsc();
+#endif
     }
-    else
+    return 0;
+}
+
+static double
+clock_now(int clk)
+{
+    switch (clk)
     {
-        ms =  ((ms - 1) * 1000);
-        ms += (1000 - T0.millitm) + T1.millitm;
+#ifdef HAVE_MPI
+        case MACSIO_TIMING_CLOCK_MPI_WTIME:
+            return MPI_Wtime();
+#endif
+#ifdef CLOCK_MONOTONIC_RAW
+        case MACSIO_TIMING_CLOCK_MONOTONIC_RAW:
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+            return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+        }
+#endif
+#ifdef MACSIO_TIMING_HAVE_TSC
+        case MACSIO_TIMING_CLOCK_TSC:
+            return (double) (__rdtsc() - tscBase) * tscSecsPerTick;
+#endif
     }
 
-    return (ms/1000.);
-
+#if defined(_WIN32)
+    {
+        struct _timeb tb;
+        _ftime(&tb);
+        return (double) tb.time + tb.millitm / 1000.;
+    }
 #else
-
-    static struct timeval T0;
-           struct timeval T1;
-
-    if (first)
     {
-        first = 0;
-        gettimeofday(&T0, 0);
-        return 0.0;
+        struct timeval tv;
+        gettimeofday(&tv, 0);
+        return (double) tv.tv_sec + (double) tv.tv_usec / 1000000.;
     }
+#endif
+}
 
-    gettimeofday(&T1, 0);
+/* Best clock available. The TSC is never chosen automatically because its
+   calibration costs time and its frequency may differ between nodes. */
+static int
+default_clock(void)
+{
+    if (clock_available(MACSIO_TIMING_CLOCK_MONOTONIC_RAW))
+        return MACSIO_TIMING_CLOCK_MONOTONIC_RAW;
+    if (clock_available(MACSIO_TIMING_CLOCK_MPI_WTIME))
+        return MACSIO_TIMING_CLOCK_MPI_WTIME;
+    return MACSIO_TIMING_CLOCK_GETTIMEOFDAY;
+}
 
-    return (double) (T1.tv_sec - T0.tv_sec) +
-           (double) (T1.tv_usec - T0.tv_usec) / 1000000.;
+static pthread_once_t clockOnce = PTHREAD_ONCE_INIT;
 
-#endif
+static void
+init_clock(void)
+{
+    timerClock = default_clock();
+    clockBase = clock_now(timerClock);
+}
+
+/* Seconds since the first call, or since the time zero MACSIO_TIMING_SyncClock agreed on */
+static double get_current_time()
+{
+    pthread_once(&clockOnce, init_clock);
+    return clock_now(timerClock) - clockBase;
 }
 
 /* A small collection of strings to be associated with different
@@ -121,6 +192,12 @@ static double get_current_time()
    example for MIF-I/O, there are various activities that we may
    time including initial creates, handoffs (close->open) as well
    as each processor's work on the file. */
+/* Timers are started and stopped by more than one thread at once (e.g. MIF phase timers
+   of a burst dump on the async writer thread and of a trickle dump on the main thread).
+   So, all state shared by threads, the timer and group tables, histograms and call tree,
+   is guarded by this mutex. The start times of running timers are kept per thread. */
+static pthread_mutex_t timingMutex = PTHREAD_MUTEX_INITIALIZER;
+
 static int const maxTimerGroups = sizeof(MACSIO_TIMING_GroupMask_t)*8;
 static char *timerGroupNames[maxTimerGroups];
 static int timerGroupCount = 0;
@@ -166,7 +243,13 @@ group_mask_from_name(char const *grpName)
 MACSIO_TIMING_GroupMask_t
 MACSIO_TIMING_GroupMask(char const *grpName)
 {
-    return group_mask_from_name(grpName);
+    MACSIO_TIMING_GroupMask_t gmask;
+
+    pthread_mutex_lock(&timingMutex);
+    gmask = group_mask_from_name(grpName);
+    pthread_mutex_unlock(&timingMutex);
+
+    return gmask;
 }
 
 typedef struct _timerInfo_t
@@ -200,6 +283,199 @@ typedef struct _timerInfo_t
 static timerInfo_t timerHashTable[MACSIO_TIMING_HASH_TABLE_SIZE];
 static timerInfo_t reducedTimerTable[MACSIO_TIMING_HASH_TABLE_SIZE];
 
+/* Log-bucketed histograms of the iteration times of timers. Bucket 0 counts times below
+   2^HIST_MIN_EXP seconds and the last bucket times of 2^HIST_MAX_EXP seconds or more. The
+   buckets between split each power of 2 into HIST_SUBBUCKETS equal parts so that a time
+   read back from its bucket is within 1/(2*HIST_SUBBUCKETS) of the actual time. They are
+   kept outside of timerInfo_t and allocated only for timers that are stopped. */
+#define HIST_MIN_EXP -24
+#define HIST_MAX_EXP 13
+#define HIST_SUBBUCKETS 8
+#define HIST_NUM_BUCKETS ((HIST_MAX_EXP - HIST_MIN_EXP) * HIST_SUBBUCKETS + 2)
+
+int MACSIO_TIMING_UseHistograms = 1;
+
+static unsigned int *timerHist[MACSIO_TIMING_HASH_TABLE_SIZE];
+static unsigned int *reducedTimerHist[MACSIO_TIMING_HASH_TABLE_SIZE];
+
+static unsigned int **
+hists_of(timerInfo_t const *table)
+{
+    return table == timerHashTable ? timerHist : reducedTimerHist;
+}
+
+static int
+hist_bucket(double t)
+{
+    int e;
+    double m = frexp(t, &e); /* t = m * 2^e, 0.5 <= m < 1 */
+
+    if (t <= 0 || e <= HIST_MIN_EXP) return 0;
+    if (e > HIST_MAX_EXP) return HIST_NUM_BUCKETS - 1;
+    return 1 + (e - HIST_MIN_EXP - 1) * HIST_SUBBUCKETS + (int) ((m - 0.5) * 2 * HIST_SUBBUCKETS);
+}
+
+/* Time at the middle of a histogram bucket */
+static double
+hist_bucket_time(int b)
+{
+    int e = (b - 1) / HIST_SUBBUCKETS + HIST_MIN_EXP + 1;
+    int sub = (b - 1) % HIST_SUBBUCKETS;
+    return ldexp(0.5 + (sub + 0.5) / (2 * HIST_SUBBUCKETS), e);
+}
+
+/* Nearest-rank percentile, p in [0,1], of a timer's iteration times from its histogram */
+static double
+hist_percentile(timerInfo_t const *info, unsigned int const *hist, double p)
+{
+    unsigned long long n = 0, rank, cnt = 0;
+    double t;
+    int b;
+
+    for (b = 0; b < HIST_NUM_BUCKETS; b++)
+        n += hist[b];
+    if (!n) return 0;
+
+    rank = (unsigned long long) ceil(p * n);
+    if (rank < 1) rank = 1;
+    for (b = 0; b < HIST_NUM_BUCKETS; b++)
+    {
+        cnt += hist[b];
+        if (cnt >= rank) break;
+    }
+
+    if (b == 0) return info->min_time;
+    if (b == HIST_NUM_BUCKETS - 1) return info->max_time;
+    t = hist_bucket_time(b);
+    if (t < info->min_time) t = info->min_time;
+    if (t > info->max_time) t = info->max_time;
+    return t;
+}
+
+/* Call tree of timers. Each node is a timer started while another, its parent, was the
+   innermost running timer in the same thread. Nodes are kept in a hash table keyed by
+   parent slot and timer ID so that, like timers, the same node lands in the same slot on
+   all ranks and the table can be reduced slot by slot. Threads share the tree. So, like
+   the timer table, it is guarded by timingMutex. */
+#define CALL_TREE_SIZE 1021
+#define CALL_STACK_DEPTH 32
+
+typedef struct _callNode_t
+{
+    /* If you change this structure in any way, you need to change the code that
+       creates its MPI datatype in ReduceTimers */
+    int in_use;                      /**< 1 if slot holds a node, 2 if its node was cleared, -1
+                                          if ranks disagreed on the node (only in reductions) */
+    int parent;                      /**< Slot of parent node or -1 for a root */
+    int tid;                         /**< ID of the node's timer */
+    int depth;                       /**< Number of ancestors of the node */
+    int count;                       /**< Number of times the timer was stopped under its parent */
+
+    double incl_time;                /**< Total time in the timer under its parent, including children */
+    double max_incl_time;            /**< Max of incl_time over ranks (only used in reductions) */
+} callNode_t;
+
+static callNode_t callTree[CALL_TREE_SIZE];
+static callNode_t reducedCallTree[CALL_TREE_SIZE];
+static int reducedNumRanks = 1;
+
+/* Timers running in the calling thread, innermost last */
+typedef struct _runningTimer_t
+{
+    MACSIO_TIMING_TimerId_t tid;     /**< ID of the timer */
+    int node;                        /**< Slot of the timer's call tree node or -1 */
+    double start_time;               /**< Time at which this thread started the timer */
+} runningTimer_t;
+
+static __thread runningTimer_t runningTimers[CALL_STACK_DEPTH];
+static __thread int numRunningTimers = 0;
+
+/* Add a timer being started to the calling thread's running timers and find or make
+   its call tree node. A new node takes the first cleared slot on its probe chain, if
+   any, so that slots freed by MACSIO_TIMING_ClearTimers are used again. */
+static void
+push_running(MACSIO_TIMING_TimerId_t tid, double start_time)
+{
+    int parent = numRunningTimers ? runningTimers[numRunningTimers-1].node : -1;
+    int slot = (int) (((unsigned) (parent + 1) * 16411u + tid) % CALL_TREE_SIZE);
+    int free_slot = -1;
+    int n;
+
+    if (numRunningTimers == CALL_STACK_DEPTH) return;
+
+    for (n = 0; n < CALL_TREE_SIZE; n++, slot = (slot + 1) % CALL_TREE_SIZE)
+    {
+        if (!callTree[slot].in_use)
+        {
+            if (free_slot < 0)
+                free_slot = slot;
+            break;
+        }
+        if (callTree[slot].in_use == 2)
+        {
+            if (free_slot < 0)
+                free_slot = slot;
+            continue;
+        }
+        if (callTree[slot].parent == parent && callTree[slot].tid == (int) tid)
+            break;
+    }
+
+    if (n == CALL_TREE_SIZE || !callTree[slot].in_use)
+    {
+        slot = free_slot;
+        if (slot >= 0)
+        {
+            callTree[slot].in_use = 1;
+            callTree[slot].parent = parent;
+            callTree[slot].tid = tid;
+            callTree[slot].depth = numRunningTimers;
+            callTree[slot].count = 0;
+            callTree[slot].incl_time = 0;
+        }
+    }
+
+    runningTimers[numRunningTimers].tid = tid;
+    runningTimers[numRunningTimers].node = slot;
+    runningTimers[numRunningTimers].start_time = start_time;
+    numRunningTimers++;
+}
+
+/* Index of the innermost running timer of the calling thread with a given ID or -1 */
+static int
+find_running(MACSIO_TIMING_TimerId_t tid)
+{
+    int i;
+    for (i = numRunningTimers-1; i >= 0; i--)
+    {
+        if (runningTimers[i].tid == tid)
+            return i;
+    }
+    return -1;
+}
+
+/* Remove a timer being stopped from the calling thread's running timers and
+   account its time to its call tree node */
+static void
+pop_running(int i, double timer_time)
+{
+    int node = runningTimers[i].node;
+
+    /* Another thread may have cleared the node and its slot may since hold another */
+    if (node >= 0 && callTree[node].in_use == 1 && callTree[node].tid == (int) runningTimers[i].tid)
+    {
+        callTree[node].count++;
+        callTree[node].incl_time += timer_time;
+    }
+
+    numRunningTimers--;
+    memmove(&runningTimers[i], &runningTimers[i+1], (numRunningTimers - i) * sizeof(runningTimer_t));
+}
+
+/* Incremented whenever timers are cleared so that IDs cached at call sites of
+   MT_StartTimerCached are looked up again */
+static unsigned int timerGeneration = 1;
+
 #ifdef HAVE_CALIPER
 typedef struct _caliperAttributeInfo_t {
     cali_id_t attr;                  /**< Caliper attribute id for the timer */
@@ -209,7 +485,31 @@ typedef struct _caliperAttributeInfo_t {
 static caliperAttributeInfo_t caliperAttributeInfo[MACSIO_TIMING_HASH_TABLE_SIZE];
 #endif
 
-MACSIO_TIMING_TimerId_t MACSIO_TIMING_StartTimer(
+/* Start another iteration of, or restart, an existing timer */
+static MACSIO_TIMING_TimerId_t
+restart_timer(MACSIO_TIMING_TimerId_t tid, int iter_num)
+{
+    timerHashTable[tid].is_restart = 0;
+    if (iter_num == MACSIO_TIMING_ITER_AUTO)
+        timerHashTable[tid].iter_num++;
+    else if (iter_num == timerHashTable[tid].iter_num)
+        timerHashTable[tid].is_restart = 1;
+    else
+        timerHashTable[tid].iter_num = iter_num;
+    timerHashTable[tid].depth = numRunningTimers;
+    timerHashTable[tid].start_time = get_current_time();
+    push_running(tid, timerHashTable[tid].start_time);
+
+#ifdef HAVE_CALIPER
+    cali_begin_int(caliperAttributeInfo[tid].iter_attr, timerHashTable[tid].iter_num);
+    cali_begin_string(caliperAttributeInfo[tid].attr, timerHashTable[tid].label);
+#endif
+
+    return tid;
+}
+
+static MACSIO_TIMING_TimerId_t
+start_timer(
     char const *label,
     MACSIO_TIMING_GroupMask_t gmask,
     int iter_num,
@@ -249,12 +549,13 @@ MACSIO_TIMING_TimerId_t MACSIO_TIMING_StartTimer(
             timerHashTable[tid].max_iter = -INT_MAX;
             timerHashTable[tid].running_mean = 0;
             timerHashTable[tid].running_var = 0;
-            timerHashTable[tid].iter_num = iter_num;
+            timerHashTable[tid].iter_num = iter_num == MACSIO_TIMING_ITER_AUTO ? 0 : iter_num;
             timerHashTable[tid].total_time_this_iter = 0;
             timerHashTable[tid].is_restart = 0;
 
-            timerHashTable[tid].depth = 0;
+            timerHashTable[tid].depth = numRunningTimers;
             timerHashTable[tid].start_time = get_current_time();
+            push_running(tid, timerHashTable[tid].start_time);
 
 #ifdef HAVE_CALIPER
             _cali_iter_label = (char*) malloc(5 + 1 + strlen(label));
@@ -277,21 +578,7 @@ MACSIO_TIMING_TimerId_t MACSIO_TIMING_StartTimer(
             timerHashTable[tid].__line__ == __line__)
         {
             /* Another iteration of or re-starting an existing timer */
-            timerHashTable[tid].is_restart = 0;
-            if (iter_num == timerHashTable[tid].iter_num)
-                timerHashTable[tid].is_restart = 1;
-            else if (iter_num == MACSIO_TIMING_ITER_AUTO)
-                timerHashTable[tid].iter_num++;
-            else
-                timerHashTable[tid].iter_num = iter_num;
-            timerHashTable[tid].start_time = get_current_time();
-
-#ifdef HAVE_CALIPER
-            cali_begin_int(caliperAttributeInfo[tid].iter_attr, timerHashTable[tid].iter_num);
-            cali_begin_string(caliperAttributeInfo[tid].attr, timerHashTable[tid].label);
-#endif
-            
-            return tid;
+            return restart_timer(tid, iter_num);
         }
 
         /* We have a collision. Try next slot in table. */
@@ -310,18 +597,59 @@ MACSIO_TIMING_TimerId_t MACSIO_TIMING_StartTimer(
     return MACSIO_TIMING_INVALID_TIMER;
 }
 
-double MACSIO_TIMING_StopTimer(MACSIO_TIMING_TimerId_t tid)
+MACSIO_TIMING_TimerId_t MACSIO_TIMING_StartTimer(
+    char const *label,
+    MACSIO_TIMING_GroupMask_t gmask,
+    int iter_num,
+    char const *__file__,
+    int __line__
+)
 {
-    double stop_time = get_current_time();
-    double timer_time = stop_time - timerHashTable[tid].start_time;
+    MACSIO_TIMING_TimerId_t tid;
 
-    if (tid >= MACSIO_TIMING_HASH_TABLE_SIZE) return DBL_MAX;
+    pthread_mutex_lock(&timingMutex);
+    tid = start_timer(label, gmask, iter_num, __file__, __line__);
+    pthread_mutex_unlock(&timingMutex);
+
+    return tid;
+}
+
+MACSIO_TIMING_TimerId_t MACSIO_TIMING_StartTimerAtSite(
+    MACSIO_TIMING_TimerSite_t *site,
+    char const *label,
+    MACSIO_TIMING_GroupMask_t gmask,
+    int iter_num,
+    char const *__file__,
+    int __line__
+)
+{
+    MACSIO_TIMING_TimerId_t tid;
+
+    pthread_mutex_lock(&timingMutex);
+    if (site->generation == timerGeneration && site->tid < MACSIO_TIMING_HASH_TABLE_SIZE)
+    {
+        tid = restart_timer(site->tid, iter_num);
+    }
+    else
+    {
+        char const *base = strrchr(__file__, '/');
+        tid = start_timer(label, gmask, iter_num, base ? base + 1 : __file__, __line__);
+        site->tid = tid;
+        site->generation = timerGeneration;
+    }
+    pthread_mutex_unlock(&timingMutex);
 
+    return tid;
+}
+
+static double
+stop_timer(MACSIO_TIMING_TimerId_t tid, double timer_time)
+{
 #ifdef HAVE_CALIPER
     cali_end(caliperAttributeInfo[tid].attr);
     cali_end(caliperAttributeInfo[tid].iter_attr);
 #endif
-    
+
     if (timerHashTable[tid].is_restart)
     {
         timerHashTable[tid].total_time_this_iter += timer_time;
@@ -363,7 +691,65 @@ double MACSIO_TIMING_StopTimer(MACSIO_TIMING_TimerId_t tid)
             timerHashTable[tid].max_time = timer_time;
             timerHashTable[tid].max_iter = timerHashTable[tid].iter_num;
         }
+
+        if (MACSIO_TIMING_UseHistograms)
+        {
+            if (!timerHist[tid])
+                timerHist[tid] = (unsigned int *) calloc(HIST_NUM_BUCKETS, sizeof(unsigned int));
+            if (timerHist[tid])
+                timerHist[tid][hist_bucket(timer_time)]++;
+        }
+    }
+
+    return timer_time;
+}
+
+double MACSIO_TIMING_StopTimer(MACSIO_TIMING_TimerId_t tid)
+{
+    double stop_time = get_current_time();
+    double timer_time;
+    int i;
+
+    if (tid >= MACSIO_TIMING_HASH_TABLE_SIZE) return DBL_MAX;
+
+    pthread_mutex_lock(&timingMutex);
+
+    /* Use this thread's start time. The timer's last start time is only a fallback for
+       a timer started by another thread. */
+    i = find_running(tid);
+    timer_time = stop_time - (i >= 0 ? runningTimers[i].start_time : timerHashTable[tid].start_time);
+    if (i >= 0)
+        pop_running(i, timer_time);
+    stop_timer(tid, timer_time);
+
+    pthread_mutex_unlock(&timingMutex);
+
+    return timer_time;
+}
+
+double MACSIO_TIMING_RecordTimer(
+    char const *label,
+    MACSIO_TIMING_GroupMask_t gmask,
+    int iter_num,
+    double timer_time,
+    char const *__file__,
+    int __line__
+)
+{
+    MACSIO_TIMING_TimerId_t tid;
+    int i;
+
+    pthread_mutex_lock(&timingMutex);
+    tid = start_timer(label, gmask, iter_num, __file__, __line__);
+    if (tid < MACSIO_TIMING_HASH_TABLE_SIZE)
+    {
+        if ((i = find_running(tid)) >= 0)
+            pop_running(i, timer_time);
+        stop_timer(tid, timer_time);
     }
+    pthread_mutex_unlock(&timingMutex);
+
+    if (tid >= MACSIO_TIMING_HASH_TABLE_SIZE) return DBL_MAX;
 
     return timer_time;
 }
@@ -406,18 +792,32 @@ get_timer_datum(
         return table[tid].running_mean;
     else if (!strncmp(field, "running_var", 11))
         return table[tid].running_var;
+    else if (field[0] == 'p' && hists_of(table)[tid])
+        return hist_percentile(&table[tid], hists_of(table)[tid], strtod(field+1, 0) / 100);
 
     return -1;
 }
 
 double MACSIO_TIMING_GetTimerDatum(MACSIO_TIMING_TimerId_t tid, char const *field)
 {
-    return get_timer_datum(timerHashTable, tid, field);
+    double val;
+
+    pthread_mutex_lock(&timingMutex);
+    val = get_timer_datum(timerHashTable, tid, field);
+    pthread_mutex_unlock(&timingMutex);
+
+    return val;
 }
 
 double MACSIO_TIMING_GetReducedTimerDatum(MACSIO_TIMING_TimerId_t tid, char const *field)
 {
-    return get_timer_datum(reducedTimerTable, tid, field);
+    double val;
+
+    pthread_mutex_lock(&timingMutex);
+    val = get_timer_datum(reducedTimerTable, tid, field);
+    pthread_mutex_unlock(&timingMutex);
+
+    return val;
 }
 
 static void
@@ -449,6 +849,9 @@ clear_timers(timerInfo_t *table, MACSIO_TIMING_GroupMask_t gmask)
         table[i].is_restart = 0;
         table[i].depth = 0;
         table[i].start_time = 0;
+
+        free(hists_of(table)[i]);
+        hists_of(table)[i] = 0;
     }
 }
 
@@ -542,6 +945,98 @@ reduce_a_timerinfo(
 }
 #endif
 
+#ifdef HAVE_MPI
+/* Sum histograms of timers across ranks into reducedTimerHist on root. Only the histograms
+   of the table slots in use on some rank are sent. */
+static void
+reduce_histograms(MPI_Comm comm, int root)
+{
+    int i, n = 0, rank;
+    int *used = (int *) malloc(MACSIO_TIMING_HASH_TABLE_SIZE * sizeof(int));
+    int *anyUsed = (int *) malloc(MACSIO_TIMING_HASH_TABLE_SIZE * sizeof(int));
+    unsigned int *buf, *rbuf = 0;
+
+    MPI_Comm_rank(comm, &rank);
+
+    for (i = 0; i < MACSIO_TIMING_HASH_TABLE_SIZE; i++)
+        used[i] = timerHist[i] != 0;
+    MPI_Allreduce(used, anyUsed, MACSIO_TIMING_HASH_TABLE_SIZE, MPI_INT, MPI_MAX, comm);
+    for (i = 0; i < MACSIO_TIMING_HASH_TABLE_SIZE; i++)
+        n += anyUsed[i];
+
+    if (n)
+    {
+        buf = (unsigned int *) calloc((size_t) n * HIST_NUM_BUCKETS, sizeof(unsigned int));
+        if (rank == root)
+            rbuf = (unsigned int *) malloc((size_t) n * HIST_NUM_BUCKETS * sizeof(unsigned int));
+
+        for (i = 0, n = 0; i < MACSIO_TIMING_HASH_TABLE_SIZE; i++)
+        {
+            if (!anyUsed[i]) continue;
+            if (timerHist[i])
+                memcpy(&buf[n * HIST_NUM_BUCKETS], timerHist[i], HIST_NUM_BUCKETS * sizeof(unsigned int));
+            n++;
+        }
+
+        MPI_Reduce(buf, rbuf, n * HIST_NUM_BUCKETS, MPI_UNSIGNED, MPI_SUM, root, comm);
+
+        if (rank == root)
+        {
+            for (i = 0, n = 0; i < MACSIO_TIMING_HASH_TABLE_SIZE; i++)
+            {
+                if (!anyUsed[i]) continue;
+                reducedTimerHist[i] = (unsigned int *) malloc(HIST_NUM_BUCKETS * sizeof(unsigned int));
+                memcpy(reducedTimerHist[i], &rbuf[n * HIST_NUM_BUCKETS], HIST_NUM_BUCKETS * sizeof(unsigned int));
+                n++;
+            }
+        }
+
+        free(buf);
+        free(rbuf);
+    }
+
+    free(used);
+    free(anyUsed);
+}
+#endif
+
+#ifdef HAVE_MPI
+static void
+reduce_a_callnode(
+    void *a,		/**< [in] first input for MPI_User_function */
+    void *b,		/**< [in,out] second input arg for MPI_User_function and reduced output */
+    int *len,		/**< [in] number of values in A and B buffers */
+    MPI_Datatype *type	/**< [in] type of values in A and B buffers */
+)
+{
+    int i;
+    callNode_t *a_node = (callNode_t*) a;
+    callNode_t *b_node = (callNode_t*) b;
+
+    for (i = 0; i < *len; i++)
+    {
+        if (a_node[i].in_use != 1 && a_node[i].in_use != -1)
+            continue;
+
+        if (b_node[i].in_use != 1 && b_node[i].in_use != -1)
+        {
+            b_node[i] = a_node[i];
+            continue;
+        }
+
+        /* If nodes don't match, record that fact as -1 */
+        if (a_node[i].in_use == -1 || a_node[i].parent != b_node[i].parent ||
+            a_node[i].tid != b_node[i].tid)
+            b_node[i].in_use = -1;
+
+        b_node[i].count += a_node[i].count;
+        b_node[i].incl_time += a_node[i].incl_time;
+        if (a_node[i].max_incl_time > b_node[i].max_incl_time)
+            b_node[i].max_incl_time = a_node[i].max_incl_time;
+    }
+}
+#endif
+
 void
 MACSIO_TIMING_ReduceTimers(
 #ifdef HAVE_MPI
@@ -558,6 +1053,8 @@ MACSIO_TIMING_ReduceTimers(
     static MPI_Datatype str_32_mpi_type;
     static MPI_Datatype str_64_mpi_type;
     static MPI_Datatype timerinfo_mpi_type;
+    static MPI_Op callnode_reduce_op;
+    static MPI_Datatype callnode_mpi_type;
     int i, rank = 0;
 
     MPI_Comm_rank(comm, &rank);
@@ -568,6 +1065,8 @@ MACSIO_TIMING_ReduceTimers(
         MPI_Type_free(&str_32_mpi_type);
         MPI_Type_free(&str_64_mpi_type);
         MPI_Type_free(&timerinfo_mpi_type);
+        MPI_Op_free(&callnode_reduce_op);
+        MPI_Type_free(&callnode_mpi_type);
         first = 1;
         return;
     }
@@ -604,15 +1103,41 @@ MACSIO_TIMING_ReduceTimers(
         MPI_Type_create_struct(5, lengths, offsets, types, &timerinfo_mpi_type);
         MPI_Type_commit(&timerinfo_mpi_type);
 
+        MPI_Op_create(reduce_a_callnode, 0, &callnode_reduce_op);
+        lengths[0] = 5;
+        types[0] = MPI_INT;
+        MPI_Get_address(&callTree[0], offsets);
+        lengths[1] = 2;
+        types[1] = MPI_DOUBLE;
+        MPI_Get_address(&callTree[0].incl_time, offsets+1);
+        offsets[1] -= offsets[0];
+        offsets[0] = 0;
+        MPI_Type_create_struct(2, lengths, offsets, types, &callnode_mpi_type);
+        MPI_Type_commit(&callnode_mpi_type);
+
         first = 0;
     }
 
+    /* Hold the lock throughout so that other threads' timers can't change the tables
+       mid-reduction. Timers are normally reduced only between dumps. */
+    pthread_mutex_lock(&timingMutex);
+
     clear_timers(reducedTimerTable, MACSIO_TIMING_ALL_GROUPS);
     for (i = 0; i < MACSIO_TIMING_HASH_TABLE_SIZE; i++)
         timerHashTable[i].min_rank = timerHashTable[i].max_rank = rank;
 
     MPI_Reduce(timerHashTable, reducedTimerTable, MACSIO_TIMING_HASH_TABLE_SIZE,
         timerinfo_mpi_type, timerinfo_reduce_op, root, comm);
+
+    reduce_histograms(comm, root);
+
+    MPI_Comm_size(comm, &reducedNumRanks);
+    for (i = 0; i < CALL_TREE_SIZE; i++)
+        callTree[i].max_incl_time = callTree[i].incl_time;
+    MPI_Reduce(callTree, reducedCallTree, CALL_TREE_SIZE,
+        callnode_mpi_type, callnode_reduce_op, root, comm);
+
+    pthread_mutex_unlock(&timingMutex);
 #endif
 }
 
@@ -639,6 +1164,8 @@ dump_timers_to_strings(
             int len;
             double min_in_stddev_steps_from_mean = 0, max_in_stddev_steps_from_mean = 0;
             double dev;
+            char pcts[128] = "";
+            unsigned int const *hist = hists_of(table)[i];
 
             if (!strlen(table[i].label)) continue;
 
@@ -656,16 +1183,22 @@ dump_timers_to_strings(
                 max_in_stddev_steps_from_mean = (table[i].max_time - table[i].running_mean) / dev;
             }
 
+            if (hist)
+                snprintf(pcts, sizeof(pcts), ",P50=%8.5f,P90=%8.5f,P99=%8.5f,P99.9=%8.5f",
+                    hist_percentile(&table[i], hist, 0.5), hist_percentile(&table[i], hist, 0.9),
+                    hist_percentile(&table[i], hist, 0.99), hist_percentile(&table[i], hist, 0.999));
+
 //#warning USE COLUMN HEADINGS INSTEAD
 //#warning HANDLE INDENTATION HERE
             len = snprintf(_strs[_nstrs-1], max_str_size,
-                "TOT=%10.5f,CNT=%04d,MIN=%8.5f(%4.2f):%06d,AVG=%8.5f,MAX=%8.5f(%4.2f):%06d,DEV=%8.8f:FILE=%s:LINE=%d:LAB=%s",
+                "TOT=%10.5f,CNT=%04d,MIN=%8.5f(%4.2f):%06d,AVG=%8.5f,MAX=%8.5f(%4.2f):%06d,DEV=%8.8f%s:FILE=%s:LINE=%d:LAB=%s",
                 table[i].total_time,
                 table[i].iter_count,
                 table[i].min_time, min_in_stddev_steps_from_mean, table[i].min_rank,
                 table[i].running_mean,
                 table[i].max_time, max_in_stddev_steps_from_mean, table[i].max_rank,
                 dev,
+                pcts,
                 table[i].__file__,
                 table[i].__line__,
                 table[i].label);
@@ -690,7 +1223,9 @@ MACSIO_TIMING_DumpTimersToStrings(
     int *maxlen
 )
 {
+    pthread_mutex_lock(&timingMutex);
     dump_timers_to_strings(timerHashTable, gmask, strs, nstrs, maxlen);
+    pthread_mutex_unlock(&timingMutex);
 }
 
 void MACSIO_TIMING_DumpReducedTimersToStrings(
@@ -700,13 +1235,272 @@ void MACSIO_TIMING_DumpReducedTimersToStrings(
     int *maxlen
 )
 {
+    pthread_mutex_lock(&timingMutex);
     dump_timers_to_strings(reducedTimerTable, gmask, strs, nstrs, maxlen);
+    pthread_mutex_unlock(&timingMutex);
+}
+
+/* Clear the nodes of timers in a group and their descendants. Slots of cleared nodes
+   are marked so that lookups of nodes placed after them still find them and are
+   reused by push_running. */
+static void
+clear_call_tree(MACSIO_TIMING_GroupMask_t gmask)
+{
+    int i, d, n = 0;
+
+    for (d = 0; d < CALL_STACK_DEPTH; d++)
+    {
+        for (i = 0; i < CALL_TREE_SIZE; i++)
+        {
+            callNode_t *node = &callTree[i];
+            if (node->in_use != 1 || node->depth != d) continue;
+            if ((timerHashTable[node->tid].gmask & gmask) ||
+                (node->parent >= 0 && callTree[node->parent].in_use != 1))
+                node->in_use = 2;
+            else
+                n++;
+        }
+    }
+
+    if (n == 0)
+        memset(callTree, 0, sizeof(callTree));
+    memset(reducedCallTree, 0, sizeof(reducedCallTree));
+
+    /* Detach the calling thread's running timers from cleared nodes */
+    for (i = 0; i < numRunningTimers; i++)
+    {
+        if (runningTimers[i].node >= 0 && callTree[runningTimers[i].node].in_use != 1)
+            runningTimers[i].node = -1;
+    }
+}
+
+/* Children of a call tree node, in decreasing order of inclusive time */
+static int
+call_children(callNode_t const *nodes, double const *incl_time, int parent, int *children)
+{
+    int i, j, n = 0;
+
+    for (i = 0; i < CALL_TREE_SIZE; i++)
+    {
+        if (nodes[i].in_use != 1 || nodes[i].parent != parent) continue;
+        for (j = n; j > 0 && incl_time[children[j-1]] < incl_time[i]; j--)
+            children[j] = children[j-1];
+        children[j] = i;
+        n++;
+    }
+    return n;
+}
+
+static void
+dump_call_subtree(
+    callNode_t const *nodes,
+    timerInfo_t const *table,
+    int nranks,
+    double const *incl_time,
+    double const *child_time,
+    int parent,
+    char **strs,
+    int *nstrs,
+    int *maxlen
+)
+{
+    int i, n, *children = (int *) malloc(CALL_TREE_SIZE * sizeof(int));
+    int const max_str_size = 1024;
+
+    n = call_children(nodes, incl_time, parent, children);
+    for (i = 0; i < n; i++)
+    {
+        int c = children[i];
+        double max_incl_time = nranks > 1 ? nodes[c].max_incl_time : incl_time[c];
+
+        if (max_incl_time < incl_time[c] / nranks)
+            max_incl_time = incl_time[c] / nranks;
+
+        if (strs)
+        {
+            int len;
+            strs[*nstrs] = (char *) malloc(max_str_size);
+            len = snprintf(strs[*nstrs], max_str_size,
+                "INCL=%10.5f,EXCL=%10.5f,MAX=%10.5f,CNT=%06d:%*s%s",
+                incl_time[c] / nranks, (incl_time[c] - child_time[c]) / nranks, max_incl_time,
+                nodes[c].count, 2 * nodes[c].depth, "", table[nodes[c].tid].label);
+            if (len > *maxlen) *maxlen = len;
+        }
+        (*nstrs)++;
+
+        dump_call_subtree(nodes, table, nranks, incl_time, child_time, c, strs, nstrs, maxlen);
+    }
+
+    free(children);
+}
+
+static void
+dump_call_tree_to_strings(
+    callNode_t const *nodes,
+    timerInfo_t const *table,
+    int nranks,
+    char ***strs,
+    int *nstrs,
+    int *maxlen
+)
+{
+    int i, d, _nstrs = 0, _maxlen = 0;
+    double *incl_time = (double *) calloc(CALL_TREE_SIZE, sizeof(double));
+    double *child_time = (double *) calloc(CALL_TREE_SIZE, sizeof(double));
+
+    /* Sum children's times into their parents, deepest first. A timer still running (e.g.
+       main) has accumulated less than its children. So, it is given its children's time. */
+    for (d = CALL_STACK_DEPTH-1; d >= 0; d--)
+    {
+        for (i = 0; i < CALL_TREE_SIZE; i++)
+        {
+            if (nodes[i].in_use != 1 || nodes[i].depth != d) continue;
+            incl_time[i] = nodes[i].incl_time > child_time[i] ? nodes[i].incl_time : child_time[i];
+            if (nodes[i].parent >= 0)
+                child_time[nodes[i].parent] += incl_time[i];
+        }
+    }
+
+    /* Count the strings on a first pass */
+    dump_call_subtree(nodes, table, nranks, incl_time, child_time, -1, 0, &_nstrs, &_maxlen);
+    *strs = (char **) malloc(_nstrs * sizeof(char*));
+    _nstrs = 0;
+    dump_call_subtree(nodes, table, nranks, incl_time, child_time, -1, *strs, &_nstrs, &_maxlen);
+
+    free(incl_time);
+    free(child_time);
+
+    *nstrs = _nstrs;
+    *maxlen = _maxlen;
+}
+
+void
+MACSIO_TIMING_DumpCallTreeToStrings(
+    char ***strs,
+    int *nstrs,
+    int *maxlen
+)
+{
+    pthread_mutex_lock(&timingMutex);
+    dump_call_tree_to_strings(callTree, timerHashTable, 1, strs, nstrs, maxlen);
+    pthread_mutex_unlock(&timingMutex);
+}
+
+void
+MACSIO_TIMING_DumpReducedCallTreeToStrings(
+    char ***strs,
+    int *nstrs,
+    int *maxlen
+)
+{
+    pthread_mutex_lock(&timingMutex);
+    dump_call_tree_to_strings(reducedCallTree, reducedTimerTable, reducedNumRanks, strs, nstrs, maxlen);
+    pthread_mutex_unlock(&timingMutex);
 }
 
 void MACSIO_TIMING_ClearTimers(MACSIO_TIMING_GroupMask_t gmask)
 {
+    pthread_mutex_lock(&timingMutex);
+    clear_call_tree(gmask);
     clear_timers(timerHashTable, gmask);
     clear_timers(reducedTimerTable, MACSIO_TIMING_ALL_GROUPS);
+    timerGeneration++;
+    pthread_mutex_unlock(&timingMutex);
+}
+
+int
+MACSIO_TIMING_SetClock(char const *name)
+{
+    int i, clk = -1, retval = 0;
+    double now = get_current_time();
+
+    for (i = 0; i < (int) (sizeof(clockNames)/sizeof(clockNames[0])); i++)
+    {
+        if (!strcmp(name, clockNames[i]))
+            clk = i;
+    }
+
+    if (clk < 0 || !clock_available(clk))
+    {
+        retval = strcmp(name, "auto") ? 1 : 0;
+        clk = default_clock();
+    }
+
+    /* Keep time continuous so that timers already running are unaffected */
+    timerClock = clk;
+    clockBase = clock_now(clk) - now;
+
+    return retval;
+}
+
+void
+MACSIO_TIMING_SyncClock(
+#ifdef HAVE_MPI
+    MPI_Comm comm
+#else
+    int comm
+#endif
+)
+{
+#ifdef HAVE_MPI
+    int *isGlobal = 0, found = 0;
+    double now, latest;
+
+    get_current_time();
+
+    /* A global MPI_Wtime() agrees across ranks already, so the earliest base is exact */
+    if (timerClock == MACSIO_TIMING_CLOCK_MPI_WTIME)
+        MPI_Comm_get_attr(comm, MPI_WTIME_IS_GLOBAL, &isGlobal, &found);
+    if (found && *isGlobal)
+    {
+        MPI_Allreduce(MPI_IN_PLACE, &clockBase, 1, MPI_DOUBLE, MPI_MIN, comm);
+        return;
+    }
+
+    /* Otherwise, make all ranks read the same time as they leave a barrier. Time only
+       moves forward so that timers already running are unaffected but for the skew. */
+    MPI_Barrier(comm);
+    now = get_current_time();
+    MPI_Allreduce(&now, &latest, 1, MPI_DOUBLE, MPI_MAX, comm);
+    clockBase -= latest - now;
+#endif
+}
+
+char const *
+MACSIO_TIMING_GetClockName(void)
+{
+    get_current_time();
+    return clockNames[timerClock];
+}
+
+double
+MACSIO_TIMING_GetClockResolution(void)
+{
+    get_current_time();
+    switch (timerClock)
+    {
+#ifdef HAVE_MPI
+        case MACSIO_TIMING_CLOCK_MPI_WTIME:
+            return MPI_Wtick();
+#endif
+#ifdef CLOCK_MONOTONIC_RAW
+        case MACSIO_TIMING_CLOCK_MONOTONIC_RAW:
+        {
+            struct timespec ts;
+            clock_getres(CLOCK_MONOTONIC_RAW, &ts);
+            return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+        }
+#endif
+#ifdef MACSIO_TIMING_HAVE_TSC
+        case MACSIO_TIMING_CLOCK_TSC:
+            return tscSecsPerTick;
+#endif
+    }
+#if defined(_WIN32)
+    return 0.001;
+#else
+    return 0.000001;
+#endif
 }
 
 double MACSIO_TIMING_GetCurrentTime(void)
@@ -37,6 +37,11 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 \defgroup MACSIO_TIMING MACSIO_TIMING
 \brief Timing utilities 
 
+Timers may be started and stopped by several threads at once. Each thread's start
+times are its own. So, threads running the same timer (e.g. a MIF phase timer of a
+burst dump on the async writer thread and of a trickle dump on the main thread) don't
+overwrite each other's. A timer should be stopped by the thread that started it.
+
 @{
 */
 
@@ -98,6 +103,12 @@ Used to strip unnecessary path terms from \c __FILE__ in messages
 */
 #define MT_StartTimer(LAB, GMASK, ITER) MACSIO_TIMING_StartTimer(LAB, GMASK, ITER, __BASEFILE__, __LINE__)
 
+/*!
+\def MT_TIMER_SITE
+\brief Initializer of the cached timer ID of a call site of \c MT_StartTimerCached()
+*/
+#define MT_TIMER_SITE {MACSIO_TIMING_INVALID_TIMER, 0, __FILE__, __LINE__}
+
 /*!
 \def MT_StopTimer
 \brief Shorthand for \c MACSIO_TIMING_StopTimer()
@@ -105,16 +116,47 @@ Used to strip unnecessary path terms from \c __FILE__ in messages
 */
 #define MT_StopTimer(ID) MACSIO_TIMING_StopTimer(ID)
 
+/*!
+\def MT_RecordTimer
+\brief Shorthand for \c MACSIO_TIMING_RecordTimer()
+\param [in] LAB User defined timer label string
+\param [in] GMASK User defined group mask. Use MACSIO_TIMING_NO_GROUP if timer grouping is not needed.
+\param [in] ITER The iteration number. Use MACSIO_TIMING_ITER_IGNORE if timer iteration is not needed.
+\param [in] DT The elapsed time to record for this iteration of the timer.
+*/
+#define MT_RecordTimer(LAB, GMASK, ITER, DT) MACSIO_TIMING_RecordTimer(LAB, GMASK, ITER, DT, __BASEFILE__, __LINE__)
+
 typedef unsigned int MACSIO_TIMING_TimerId_t;
 typedef unsigned long long MACSIO_TIMING_GroupMask_t;
 
+/*! \brief Cached timer ID of a call site of \c MT_StartTimerCached(). Initialize with \c MT_TIMER_SITE. */
+typedef struct _MACSIO_TIMING_TimerSite_t
+{
+    MACSIO_TIMING_TimerId_t tid;     /**< ID of the call site's timer */
+    unsigned int generation;         /**< Timer table generation \c tid is valid for */
+    char const *file;                /**< Source file of the call site */
+    int line;                        /**< Source line of the call site */
+} MACSIO_TIMING_TimerSite_t;
+
+/*! \brief Clocks timers may read */
+typedef enum _MACSIO_TIMING_Clock_t
+{
+    MACSIO_TIMING_CLOCK_GETTIMEOFDAY = 0, /**< \c gettimeofday(), microsecond resolution, not monotonic */
+    MACSIO_TIMING_CLOCK_MPI_WTIME,        /**< \c MPI_Wtime() */
+    MACSIO_TIMING_CLOCK_MONOTONIC_RAW,    /**< \c clock_gettime(CLOCK_MONOTONIC_RAW) */
+    MACSIO_TIMING_CLOCK_TSC               /**< Invariant x86 time stamp counter, calibrated at startup */
+} MACSIO_TIMING_Clock_t;
+
 /*!
-\brief Integer variable to control function used to get timer values
+\brief Integer variable to control histograms of timer iteration times
 
-A non-zero value indicates that MACSIO_TIMING should use \c MPI_Wtime(). Otherwise, it will
-use \c gettimeofday().
+A non-zero value (the default) indicates that MACSIO_TIMING should keep a log-bucketed
+histogram of the iteration times of each timer so that percentiles of the times can be
+reported. Buckets are 1/8th of a power of 2 wide. So, percentiles are accurate to about 6%.
+Histograms are summed across ranks by MACSIO_TIMING_ReduceTimers(). Each costs about 1.2
+kilobytes.
 */
-extern int MACSIO_TIMING_UseMPI_Wtime;
+extern int MACSIO_TIMING_UseHistograms;
 
 /*!
 \brief Create a group name and mask
@@ -141,6 +183,52 @@ MACSIO_TIMING_StartTimer(
     char const *file,                /**< The source file name */
     int line                         /**< The source file line number*/);
 
+/*!
+\brief Start a timer whose ID is cached at its call site
+
+Starts the timer cached in \c site exactly as MACSIO_TIMING_StartTimer() would. If the
+cached ID is not valid (e.g. on the first call or after the timers have been cleared),
+it looks the timer up with MACSIO_TIMING_StartTimer() and caches its ID. Use
+\c MT_StartTimerCached() rather than calling this directly.
+\return The timer's ID
+*/
+extern MACSIO_TIMING_TimerId_t
+MACSIO_TIMING_StartTimerAtSite(
+    MACSIO_TIMING_TimerSite_t *site, /**< Cached timer ID of the call site */
+    char const *label,               /**< User defined label to be assigned to the timer */
+    MACSIO_TIMING_GroupMask_t gmask, /**< Mask to indicate the timer's group membership */
+    int iter_num,                    /**< Iteration number */
+    char const *file,                /**< The source file name (its directory is ignored) */
+    int line                         /**< The source file line number*/);
+
+/*!
+\brief Low overhead equivalent of \c MT_StartTimer() for frequently started timers
+
+\c MT_StartTimer() formats and hashes a string identifying the timer and probes the
+timer table on every call. This caches the timer's ID in \c site, a static variable
+private to the call site, after the first call. Later calls just start the timer. The
+label and group mask must be the same on every call from the call site. Use it for
+fine-grained timing such as inside plugins' write loops.
+
+\code
+static MACSIO_TIMING_TimerSite_t site = MT_TIMER_SITE;
+MACSIO_TIMING_TimerId_t tid = MT_StartTimerCached(&site, "H5Dwrite", grp, MACSIO_TIMING_ITER_AUTO);
+\endcode
+
+The timer is identified by the file and line at which \c site is declared.
+\return The timer's ID
+*/
+static inline MACSIO_TIMING_TimerId_t
+MT_StartTimerCached(
+    MACSIO_TIMING_TimerSite_t *site, /**< Cached timer ID of the call site */
+    char const *label,               /**< User defined label string */
+    MACSIO_TIMING_GroupMask_t gmask, /**< User defined group mask */
+    int iter_num                     /**< The iteration number */
+)
+{
+    return MACSIO_TIMING_StartTimerAtSite(site, label, gmask, iter_num, site->file, site->line);
+}
+
 /*!
 \brief Stop a timer
 
@@ -152,6 +240,24 @@ MACSIO_TIMING_StopTimer(
     MACSIO_TIMING_TimerId_t id /**< The timer's ID, returned from MACSIO_TIMING_StartTimer() */
 );
 
+/*!
+\brief Record an iteration of a timer from an externally measured time
+
+This call creates or starts a timer exactly as MACSIO_TIMING_StartTimer() does and then
+immediately stops it but with the given elapsed time instead of the time that actually
+elapsed. It is useful for time intervals that are not bracketed by the calling thread
+or process such as background (asynchronous) dumps.
+\return Returns the time for the current iteration of the timer
+*/
+extern double
+MACSIO_TIMING_RecordTimer(
+    char const *label,               /**< User defined label to be assigned to the timer */
+    MACSIO_TIMING_GroupMask_t gmask, /**< Mask to indicate the timer's group membership */
+    int iter_num,                    /**< Iteration number */
+    double timer_time,               /**< The elapsed time to record */
+    char const *file,                /**< The source file name */
+    int line                         /**< The source file line number*/);
+
 /*!
 \brief Get specific data field from a timer
 
@@ -170,6 +276,9 @@ Possible field names are...
   - "max_time"  maximum time observed for this timer
   - "running_mean" current average time for this timer
   - "running_var"  current variance for this timer
+  - "p50", "p90", "p99", "p99.9", or "p" followed by any other percentage, the percentile of
+    the iteration times of this timer estimated from its histogram (see
+    \c MACSIO_TIMING_UseHistograms)
 
 Where applicable, returned values are over either
   - all iterations (when using non-reduced timers)
@@ -216,6 +325,8 @@ separated by colons...
     - (%4.2f) the number of standard deviations of the max from the mean time
     - :%06d task rank where the maximum was observed. (only valid when reduced)
   - DEV=%8.8f standard deviation observed for all iterations of this timer
+  - P50=%8.5f,P90=%8.5f,P99=%8.5f,P99.9=%8.5f percentiles of the iteration times of this timer
+    (and ranks when reduced), present only if the timer has a histogram
   - FILE=\%s the source file where this timer is triggered
   - LINE=\%d the source line number where this timer is triggered
   - LAB=\%s the user-defined label for this timer
@@ -256,6 +367,44 @@ MACSIO_TIMING_DumpReducedTimersToStrings(
     int *maxlen                      /**< The maximum length of all strings */
 );
 
+/*!
+\brief Dump call tree of timers to ascii strings
+
+Timers started while another timer is running in the same thread are its children in
+a call tree. The same timer started within different timers is a different node of the
+tree. This call dumps the tree depth first, children in decreasing order of inclusive
+time, one node per string with the following fields...
+
+  - INCL=%10.5f total time spent in the timer within its parent, including children
+  - EXCL=%10.5f time spent in the timer within its parent excluding its children
+  - MAX=%10.5f same as INCL here. The maximum over ranks of INCL when reduced
+  - CNT=%06d number of times the timer was stopped within its parent
+  - the timer's label indented by two spaces per level of nesting
+
+A timer stopped after its parent is not accounted to the tree. Nor are timers nested
+more than 32 deep. A timer that is still running is shown with the times of its children.
+*/
+extern void
+MACSIO_TIMING_DumpCallTreeToStrings(
+    char ***strs, /**< Array of strings, one for each node, returned to caller. Caller must free. */
+    int *nstrs,   /**< Number of strings returned to caller */
+    int *maxlen   /**< The maximum length of all strings */
+);
+
+/*!
+\brief Dump reduced call tree of timers to ascii strings
+
+Similar to \c DumpCallTreeToStrings except this call dumps the call tree reduced across
+ranks by MACSIO_TIMING_ReduceTimers(). INCL and EXCL are averages over all ranks, MAX is
+the maximum over ranks of a rank's inclusive time and CNT is the sum over ranks.
+*/
+extern void
+MACSIO_TIMING_DumpReducedCallTreeToStrings(
+    char ***strs, /**< Array of strings, one for each node, returned to caller. Caller must free */
+    int *nstrs,   /**< Number of strings returned to caller */
+    int *maxlen   /**< The maximum length of all strings */
+);
+
 /*!
 \brief Clear a group of timers
 
@@ -271,12 +420,59 @@ MACSIO_TIMING_ClearTimers(
 /*!
 \brief Get current time
 
-Depending on current value of \c MACSIO_TIMING_UseMPI_Wtime, uses either
-\c MPI_WTime() or \c gettimeofday().
+Seconds since the timing package was first used as read from the clock selected with
+MACSIO_TIMING_SetClock(), or since the time zero agreed on by MACSIO_TIMING_SyncClock().
 */
 extern double
 MACSIO_TIMING_GetCurrentTime(void);
 
+/*!
+\brief Select the clock timers read
+
+Recognized names are \c "gettimeofday", \c "mpi_wtime", \c "monotonic_raw", \c "tsc"
+and \c "auto". \c "auto" selects \c "monotonic_raw" if it is available and otherwise
+\c "mpi_wtime" or \c "gettimeofday". The \c "tsc" clock is available only on x86
+processors with an invariant TSC and is calibrated, taking about 20 milliseconds, when
+first selected. If the named clock is unknown or not available, the \c "auto" clock is
+selected. Time remains continuous across the switch so timers may be running. Intended to
+be called once at startup.
+\return Zero if the named clock was selected and non-zero if another was.
+*/
+extern int
+MACSIO_TIMING_SetClock(
+    char const *name /**< Name of the clock */
+);
+
+/*!
+\brief Agree on time zero across MPI tasks
+
+Each task's time is otherwise relative to its own first use of the timing package.
+Afterwards, times read on different tasks of \c comm are comparable. With a global
+\c MPI_Wtime() (see \c MPI_WTIME_IS_GLOBAL), they agree exactly. Otherwise, they agree
+to within the skew of tasks leaving a barrier. Time only moves forward on any task so
+timers may be running. Collective on \c comm. Call it after MACSIO_TIMING_SetClock().
+*/
+extern void
+MACSIO_TIMING_SyncClock(
+#ifdef HAVE_MPI
+    MPI_Comm comm /**< The MPI communicator of the tasks to agree */
+#else
+    int comm      /**< Dummy value for non-parallel builds */
+#endif
+);
+
+/*!
+\brief Get name of the clock in use
+*/
+extern char const *
+MACSIO_TIMING_GetClockName(void);
+
+/*!
+\brief Get resolution, in seconds, of the clock in use
+*/
+extern double
+MACSIO_TIMING_GetClockResolution(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -24,13 +24,17 @@ this program; if not, write to the Free Software Foundation, Inc., 59 Temple
 Place, Suite 330, Boston, MA 02111-1307 USA
 */
 
+#include <errno.h>
 #include <float.h>
 #include <math.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <strings.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
+#include <macsio_log.h>
 #include <macsio_utils.h>
 
 char MACSIO_UTILS_UnitsPrefixSystem[32];
@@ -452,7 +456,7 @@ void MACSIO_UTILS_CreateFileStore(int num_dumps, int files_per_dump)
 
 void MACSIO_UTILS_RecordOutputFiles(int dump_num, char *filename)
 {
-    if (dump_num > filegroup_count) return;
+    if (dump_num >= filegroup_count) return;
 
     int count = files[dump_num].size;
 
@@ -460,14 +464,21 @@ void MACSIO_UTILS_RecordOutputFiles(int dump_num, char *filename)
     strcpy(name, filename);
 
     if (files[dump_num].size == files[dump_num].total){
-        files[dump_num].names = (char**)realloc(files[dump_num].names, 1.5*files[dump_num].total*sizeof(char*));
-        files[dump_num].total *= 1.5;
+        files[dump_num].total *= 2;
+        files[dump_num].names = (char**)realloc(files[dump_num].names, files[dump_num].total*sizeof(char*));
     }
 
     files[dump_num].names[count] = name;
     files[dump_num].size++;
 }
 
+char const *MACSIO_UTILS_GetOutputFile(int dump_num, int i)
+{
+    if (dump_num >= filegroup_count) return 0;
+    if (i < 0 || i >= files[dump_num].size) return 0;
+    return files[dump_num].names[i];
+}
+
 void MACSIO_UTILS_CleanupFileStore()
 {   
     for (int i=0; i<filegroup_count; i++){
@@ -479,9 +490,12 @@ void MACSIO_UTILS_CleanupFileStore()
     free(files);
 }
 
+/* Stats only the files this task recorded. Plugins arrange for only one task
+   (e.g. the last to close it) to record any given file so that no file is stat'd
+   more than once. The caller is responsible for summing over tasks. */
 unsigned long long MACSIO_UTILS_StatFiles(int dump_num)
 {
-    if (dump_num > filegroup_count) return 0;
+    if (dump_num >= filegroup_count) return 0;
 
     unsigned long long dump_bytes = 0;
 
@@ -498,3 +512,232 @@ unsigned long long MACSIO_UTILS_StatFiles(int dump_num)
     free(buf);
     return dump_bytes;
 }
+
+/* Removes the files this task recorded for a dump (e.g. trial dumps) and forgets them */
+void MACSIO_UTILS_RemoveFiles(int dump_num)
+{
+    if (dump_num >= filegroup_count) return;
+
+    for (int i=0; i<files[dump_num].size; i++){
+        unlink(files[dump_num].names[i]);
+        free(files[dump_num].names[i]);
+    }
+    files[dump_num].size = 0;
+}
+
+/* The --max_dir_size value or -1 if it was not given */
+static int
+max_dir_size(json_object *main_obj)
+{
+    json_object *obj = json_object_path_get_any(main_obj, "clargs/max_dir_size");
+    if (!obj) return -1;
+    return json_object_get_int(obj);
+}
+
+/* Number of levels of directories, each holding at most n entries, needed to hold count
+   leaves. Zero means the leaves fit in a single directory. */
+static int
+dir_levels(int count, int n)
+{
+    int levels = 0;
+    double cap = n;
+
+    if (n < 2) return 0;
+    while (cap < count)
+    {
+        cap *= n;
+        levels++;
+    }
+    return levels;
+}
+
+/* Append the directory of a given depth holding the idx'th leaf directory. Each level
+   is one base n digit of idx. */
+static int
+append_index_dirs(char *path, int len, int size, int idx, int depth, int n)
+{
+    int k;
+
+    for (k = depth - 1; k >= 0; k--)
+    {
+        long long div = 1;
+        int j;
+        for (j = 0; j < k; j++)
+            div *= n;
+        len += snprintf(path + len, len < size ? size - len : 0, "d%04d/", (int) ((idx / div) % n));
+    }
+    return len;
+}
+
+/* Append the directory of a dump. Dumps are themselves leaves of a tree if there are
+   more of them than fit in one directory. Files that span dumps have a directory of
+   their own beside the dumps' directories. */
+static int
+append_dump_dir(json_object *main_obj, int dumpn, char *path, int len, int size)
+{
+    int n = max_dir_size(main_obj);
+    int numDumps = MU_MAX(JsonGetInt(main_obj, "clargs/num_dumps"), dumpn + 1);
+
+    if (n < 0) return len;
+    if (dumpn == MACSIO_UTILS_ALL_DUMPS)
+        return len + snprintf(path + len, len < size ? size - len : 0, "all_dumps/");
+    if (n > 0)
+        len = append_index_dirs(path, len, size, dumpn / n, dir_levels(numDumps, n), n);
+    len += snprintf(path + len, len < size ? size - len : 0, "dump_%05d/", dumpn);
+    return len;
+}
+
+/* Append the directories within a dump's directory holding the idx'th of a dump's files */
+static int
+append_file_dirs(json_object *main_obj, int fileIdx, int numFiles, char *path, int len, int size)
+{
+    int n = max_dir_size(main_obj);
+
+    if (n <= 0 || fileIdx < 0) return len;
+    return append_index_dirs(path, len, size, fileIdx / n, dir_levels(numFiles, n), n);
+}
+
+/* Create a directory that may already exist */
+static int
+make_dir(char const *path)
+{
+    if (mkdir(path, 0755) == 0 || errno == EEXIST)
+        return 0;
+    MACSIO_LOG_MSG(Err, ("Unable to create directory \"%s\"", path));
+    return -1;
+}
+
+char *
+MACSIO_UTILS_OutputPath(
+    json_object *main_obj,
+    int dumpn,
+    int fileIdx,
+    int numFiles,
+    char *path,
+    int size,
+    char const *fmt,
+    ...
+)
+{
+    va_list ap;
+    int len;
+
+    path[0] = '\0';
+    len = append_dump_dir(main_obj, dumpn, path, 0, size);
+    len = append_file_dirs(main_obj, fileIdx, numFiles, path, len, size);
+    va_start(ap, fmt);
+    vsnprintf(path + len, len < size ? size - len : 0, fmt, ap);
+    va_end(ap);
+
+    return path;
+}
+
+char *
+MACSIO_UTILS_RelativeOutputPath(
+    json_object *main_obj,
+    int fromIdx,
+    int fileIdx,
+    int numFiles,
+    char *path,
+    int size,
+    char const *fmt,
+    ...
+)
+{
+    va_list ap;
+    int i, len = 0, n = max_dir_size(main_obj);
+
+    path[0] = '\0';
+    if (n > 0 && fromIdx >= 0)
+    {
+        for (i = dir_levels(numFiles, n); i > 0; i--)
+            len += snprintf(path + len, len < size ? size - len : 0, "../");
+    }
+    len = append_file_dirs(main_obj, fileIdx, numFiles, path, len, size);
+    va_start(ap, fmt);
+    vsnprintf(path + len, len < size ? size - len : 0, fmt, ap);
+    va_end(ap);
+
+    return path;
+}
+
+void
+MACSIO_UTILS_MakeOutputDirs(
+    json_object *main_obj,
+    int dumpn,
+    int numFiles,
+#ifdef HAVE_MPI
+    MPI_Comm comm
+#else
+    int comm
+#endif
+)
+{
+    int rank = 0, size = 1, n = max_dir_size(main_obj);
+    int depth, levels;
+    char path[1024];
+
+    if (n < 0) return;
+
+#ifdef HAVE_MPI
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+#endif
+
+    /* The dump's directory and those above it are created by the first task */
+    if (rank == 0)
+    {
+        char *p;
+        append_dump_dir(main_obj, dumpn, path, 0, sizeof(path));
+        for (p = strchr(path, '/'); p; p = strchr(p + 1, '/'))
+        {
+            *p = '\0';
+            make_dir(path);
+            *p = '/';
+        }
+    }
+#ifdef HAVE_MPI
+    MPI_Barrier(comm);
+#endif
+
+    /* Then the tree within it, one level at a time so parents always exist, with
+       the directories of each level dealt out to tasks round-robin */
+    levels = n > 0 ? dir_levels(numFiles, n) : 0;
+    for (depth = 1; depth <= levels; depth++)
+    {
+        long long per = 1;
+        int i, j, numDirs;
+
+        for (i = 0; i <= levels - depth; i++)
+            per *= n;
+        numDirs = (int) ((numFiles + per - 1) / per);
+
+        for (j = rank; j < numDirs; j += size)
+        {
+            int len = append_dump_dir(main_obj, dumpn, path, 0, sizeof(path));
+            append_index_dirs(path, len, sizeof(path), j, depth, n);
+            make_dir(path);
+        }
+#ifdef HAVE_MPI
+        MPI_Barrier(comm);
+#endif
+    }
+}
+
+void
+MACSIO_UTILS_MakeParentDirs(
+    char const *path
+)
+{
+    char tmp[1024];
+    char *p;
+
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    for (p = strchr(tmp, '/'); p; p = strchr(p + 1, '/'))
+    {
+        if (p == tmp) continue;
+        *p = '\0';
+        make_dir(tmp);
+        *p = '/';
+    }
+}
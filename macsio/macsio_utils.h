@@ -28,6 +28,10 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include <json-cwx/json.h>
 
+#ifdef HAVE_MPI
+#include <mpi.h>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -97,10 +101,55 @@ extern char const *MACSIO_UTILS_PrintSeconds(double seconds, char const *fmt, ch
 extern char const *MACSIO_UTILS_PrintBandwidth(unsigned long long bytes, double seconds,
     char const *fmt, char *str, int n);
 
+/*
+Output files of each dump
+
+Each task records the files of a dump it is responsible for with
+MACSIO_UTILS_RecordOutputFiles() so that their sizes can be stat'd and summed over
+tasks once the dump is done. For each file to be counted exactly once, exactly one task
+records it and does so only after it has finished writing it. For a MIF group's file,
+that is the last task in the group, the last to close the file; use
+MACSIO_MIF_RecordGroupFile(). For an MSF group's file, it is the group's first task; use
+MACSIO_MSF_RecordGroupFile(). For a single shared file or a root file, it is rank 0.
+*/
 extern void MACSIO_UTILS_CreateFileStore(int num_dumps, int files_per_dump);
 extern void MACSIO_UTILS_RecordOutputFiles(int dump_num, char *filename);
+extern char const *MACSIO_UTILS_GetOutputFile(int dump_num, int i);
 extern void MACSIO_UTILS_CleanupFileStore();
 extern unsigned long long MACSIO_UTILS_StatFiles(int dump_num);
+extern void MACSIO_UTILS_RemoveFiles(int dump_num);
+
+/*
+Output file paths honoring --max_dir_size
+
+When --max_dir_size is not given, all files go in the current directory. When it is
+zero, each dump's files go in a directory of their own, dump_NNNNN. When it is N>0,
+no directory holds more than N entries. A dump's files are the leaves of a tree of
+directories, dNNNN, within the dump's directory and the dump directories are themselves
+leaves of such a tree if there are more than N dumps.
+
+Plugins form file names with MACSIO_UTILS_OutputPath() in place of sprintf, passing the
+index of the file among the dump's files (e.g. its MIF group) or -1 for a file that
+belongs at the top of the dump's directory (e.g. a root file). Files written to by more
+than one dump (e.g. trickle files) pass MACSIO_UTILS_ALL_DUMPS for the dump number and
+go in a directory, all_dumps, beside the dumps' directories. Before creating any of a
+dump's files, all tasks call MACSIO_UTILS_MakeOutputDirs() collectively to create the
+whole tree in parallel, with each directory created exactly once. A task that cannot
+take part in collectives (e.g. a forked writer) uses MACSIO_UTILS_MakeParentDirs()
+instead. MACSIO_UTILS_RelativeOutputPath() names one of a dump's files relative to the
+directory of another (e.g. for Silo's multi-block objects).
+*/
+#define MACSIO_UTILS_ALL_DUMPS -1
+extern char *MACSIO_UTILS_OutputPath(json_object *main_obj, int dumpn, int fileIdx, int numFiles,
+    char *path, int size, char const *fmt, ...);
+extern char *MACSIO_UTILS_RelativeOutputPath(json_object *main_obj, int fromIdx, int fileIdx, int numFiles,
+    char *path, int size, char const *fmt, ...);
+#ifdef HAVE_MPI
+extern void MACSIO_UTILS_MakeOutputDirs(json_object *main_obj, int dumpn, int numFiles, MPI_Comm comm);
+#else
+extern void MACSIO_UTILS_MakeOutputDirs(json_object *main_obj, int dumpn, int numFiles, int comm);
+#endif
+extern void MACSIO_UTILS_MakeParentDirs(char const *path);
 
 #ifdef __cplusplus
 }
@@ -38,6 +38,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include <macsio_data.h>
 #include <macsio_log.h>
 #include <macsio_main.h>
+#include <macsio_timing.h>
 #include <macsio_utils.h>
 #include <macsio_work.h>
 
@@ -64,8 +65,7 @@ char *getTimestamp()
 
 void MACSIO_WORK_DoComputeWork(double *currentT, double currentDt, int workIntensity) 
 {
-    time_t start,end;
-    time(&start);
+    double start = MT_Time(), end;
     char *start_c = getTimestamp();
     switch(workIntensity)
     {
@@ -82,8 +82,8 @@ void MACSIO_WORK_DoComputeWork(double *currentT, double currentDt, int workInten
 	    return;
     }
     char *end_c = getTimestamp();
-    time(&end);
-    MACSIO_LOG_MSG(Info, ("Work phase: Level %d: Begin %s - End %s: Duration %.2f sec", workIntensity, start_c, end_c, difftime(end, start)));
+    end = MT_Time();
+    MACSIO_LOG_MSG(Info, ("Work phase: Level %d: Begin %s - End %s: Duration %.2f sec", workIntensity, start_c, end_c, end - start));
     *currentT += currentDt;
 }
 
@@ -114,7 +114,7 @@ typedef struct _mesh {
 /* Spin CPU */
 void MACSIO_WORK_LevelTwo(double currentDt)
 {
-    time_t start_t, end_t;
+    double start_t, end_t;
 
     mesh_t *mesh;
     double *xx,*yy,*zz;
@@ -190,7 +190,7 @@ void MACSIO_WORK_LevelTwo(double currentDt)
     }
 
     /* Start timer */ 
-    time(&start_t);
+    start_t = MT_Time();
 
     cell = mesh->mcell;
     int ii=0;
@@ -228,9 +228,9 @@ void MACSIO_WORK_LevelTwo(double currentDt)
 			    + sin(cell[loc[i1]].ncv2[0][2])+ sin(cell[loc[i1]].ncv2[1][2])+ sin(cell[loc[i1]].ncv2[2][2])+ sin(cell[loc[i1]].ncv2[4][2]));
 	}
 
-	time(&end_t);
+	end_t = MT_Time();
 	/* If we've done enough work break out and return to main loop */
-	if (difftime(end_t, start_t) >= currentDt) break;
+	if (end_t - start_t >= currentDt) break;
 	ii++;
 	if (ii >= np){
 	    ii = 0;
@@ -254,6 +254,13 @@ double square(double num)
  * The domains are divided into strips and non blocking MPI routines are used
  */
 
+#ifdef HAVE_MPI
+/* Level three work communicates on its own communicator so that its messages
+   can never be confused with those of a dump that is still in progress on
+   MACSIO_MAIN_Comm (e.g. an asynchronous dump) */
+static MPI_Comm work_comm = MPI_COMM_NULL;
+#endif
+
 /* macro to index into a 2-D (N+2)x(N+2) array */
 #define INDEX(i,j) ((N+2)*(i)+(j))
 
@@ -277,6 +284,11 @@ void MACSIO_WORK_LevelThree(double currentDt)
     int *i_min, *i_max;		/* min, max vertex indices of processes */
     int *left_proc, *right_proc;	/* processes to left and right */
 
+#ifdef HAVE_MPI
+    if (work_comm == MPI_COMM_NULL)
+        MPI_Comm_dup(MACSIO_MAIN_Comm, &work_comm);
+#endif
+
     /* allocate and zero u and u_new */
     int ndof = ( N + 2 ) * ( N + 2 );
     u = ( double * ) malloc ( ndof * sizeof ( double ) );
@@ -392,8 +404,8 @@ void MACSIO_WORK_LevelThree(double currentDt)
 	    }
 	}
 #ifdef HAVE_MPI
-	MPI_Allreduce ( &my_change, &change, 1, MPI_DOUBLE, MPI_SUM, MACSIO_MAIN_Comm );
-	MPI_Allreduce ( &my_n, &n, 1, MPI_INT, MPI_SUM, MACSIO_MAIN_Comm );
+	MPI_Allreduce ( &my_change, &change, 1, MPI_DOUBLE, MPI_SUM, work_comm );
+	MPI_Allreduce ( &my_n, &n, 1, MPI_INT, MPI_SUM, work_comm );
 #endif
 
 	if ( n != 0 ){
@@ -409,7 +421,7 @@ void MACSIO_WORK_LevelThree(double currentDt)
 #ifdef HAVE_MPI
 	end = MPI_Wtime();
 	wall_time = end-start;
-	MPI_Bcast(&wall_time, 1, MPI_DOUBLE, 0, MACSIO_MAIN_Comm);
+	MPI_Bcast(&wall_time, 1, MPI_DOUBLE, 0, work_comm);
 #endif
     } while (wall_time < currentDt);
 
@@ -435,21 +447,21 @@ void jacobi (int N, double *f, double *u, double *u_new, int *i_min, int *i_max,
 #ifdef HAVE_MPI
     if ( left_proc[MACSIO_MAIN_Rank] >= 0 && left_proc[MACSIO_MAIN_Rank] < MACSIO_MAIN_Size ) {
 	MPI_Irecv ( u + INDEX(i_min[MACSIO_MAIN_Rank] - 1, 1), N, MPI_DOUBLE,
-		left_proc[MACSIO_MAIN_Rank], 0, MACSIO_MAIN_Comm,
+		left_proc[MACSIO_MAIN_Rank], 0, work_comm,
 		request + requests++ );
 
 	MPI_Isend ( u + INDEX(i_min[MACSIO_MAIN_Rank], 1), N, MPI_DOUBLE,
-		left_proc[MACSIO_MAIN_Rank], 1, MACSIO_MAIN_Comm,
+		left_proc[MACSIO_MAIN_Rank], 1, work_comm,
 		request + requests++ );
     }
 
     if ( right_proc[MACSIO_MAIN_Rank] >= 0 && right_proc[MACSIO_MAIN_Rank] < MACSIO_MAIN_Size ) {
 	MPI_Irecv ( u + INDEX(i_max[MACSIO_MAIN_Rank] + 1, 1), N, MPI_DOUBLE,
-		right_proc[MACSIO_MAIN_Rank], 1, MACSIO_MAIN_Comm,
+		right_proc[MACSIO_MAIN_Rank], 1, work_comm,
 		request + requests++ );
 
 	MPI_Isend ( u + INDEX(i_max[MACSIO_MAIN_Rank], 1), N, MPI_DOUBLE,
-		right_proc[MACSIO_MAIN_Rank], 0, MACSIO_MAIN_Comm,
+		right_proc[MACSIO_MAIN_Rank], 0, work_comm,
 		request + requests++ );
     }
 #endif
@@ -25,7 +25,9 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 */
 
 #include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -93,9 +95,343 @@ void func1()
     MT_StopTimer(tid);
 }
 
+/* Start the "bench" timer with or without caching its ID at the call site. The call
+   site's declaration and the uncached call must be on the same line to start the same
+   timer. */
+static MACSIO_TIMING_TimerId_t start_bench(int cached)
+{
+    static MACSIO_TIMING_TimerSite_t site = MT_TIMER_SITE; return cached ? MT_StartTimerCached(&site, "bench", MACSIO_TIMING_ALL_GROUPS, MACSIO_TIMING_ITER_AUTO) : MT_StartTimer("bench", MACSIO_TIMING_ALL_GROUPS, MACSIO_TIMING_ITER_AUTO);
+}
+
+/* Check a cached timer ID is the one MT_StartTimer returns, also after clearing the
+   timers has invalidated it. Returns the number of failed checks. */
+static int check_cached_timer(void)
+{
+    int pass, errors = 0;
+
+    for (pass = 0; pass < 2; pass++)
+    {
+        MACSIO_TIMING_TimerId_t tid, ctid;
+
+        MACSIO_TIMING_ClearTimers(MACSIO_TIMING_ALL_GROUPS);
+        ctid = start_bench(1);
+        dsleep(0.001);
+        MT_StopTimer(ctid);
+        tid = start_bench(0);
+        MT_StopTimer(tid);
+
+        if (ctid == MACSIO_TIMING_INVALID_TIMER || ctid != tid)
+        {
+            fprintf(stderr, "pass %d: cached timer id %u differs from timer id %u\n", pass, ctid, tid);
+            errors++;
+        }
+        else if (MACSIO_TIMING_GetTimerDatum(tid, "iter_count") != 2 ||
+                 MACSIO_TIMING_GetTimerDatum(tid, "total_time") < 0.001)
+        {
+            fprintf(stderr, "pass %d: timer has count %g and time %g, expected 2 and at least 0.001\n", pass,
+                MACSIO_TIMING_GetTimerDatum(tid, "iter_count"), MACSIO_TIMING_GetTimerDatum(tid, "total_time"));
+            errors++;
+        }
+    }
+    MACSIO_TIMING_ClearTimers(MACSIO_TIMING_ALL_GROUPS);
+
+    return errors;
+}
+
+/* Record iterations of a timer taking the given times and return the timer's ID. The ID
+   is returned by restarting the last iteration, which adds no iteration, of the timer. */
+static MACSIO_TIMING_TimerId_t record_timer(char const *label, int n, double const *times)
+{
+    int const line = __LINE__;
+    MACSIO_TIMING_TimerId_t tid;
+    int i;
+
+    for (i = 0; i < n; i++)
+        MACSIO_TIMING_RecordTimer(label, MACSIO_TIMING_ALL_GROUPS, i, times[i], __BASEFILE__, line);
+    tid = MACSIO_TIMING_StartTimer(label, MACSIO_TIMING_ALL_GROUPS, n - 1, __BASEFILE__, line);
+    MT_StopTimer(tid);
+
+    return tid;
+}
+
+/* Check a percentile is in the histogram bucket, 1/8th of a power of 2 wide, of time t.
+   Returns the number of failed checks. */
+static int check_percentile(char const *label, char const *field, double p, double t)
+{
+    int e;
+    double w, lo;
+
+    frexp(t, &e);
+    w = ldexp(1, e - 4);
+    lo = floor(t / w) * w;
+    if (p >= lo && p < lo + w)
+        return 0;
+
+    fprintf(stderr, "%s of %s is %g, expected it in [%g,%g)\n", field, label, p, lo, lo + w);
+    return 1;
+}
+
+/* Check percentiles of timers whose iteration times are known, before and after reducing
+   them across ranks. Returns the number of failed checks. */
+static int check_histograms(int rank, int size)
+{
+    double const fast = 0.001, slow = 0.1;
+    double mixed[100], skewed[100];
+    MACSIO_TIMING_TimerId_t mtid, stid;
+    int i, errors = 0;
+
+    /* Each rank has 90 fast and 10 slow iterations of "mixed". Rank 0 has 100 fast and
+       other ranks 100 slow iterations of "skewed". */
+    for (i = 0; i < 100; i++)
+    {
+        mixed[i] = i < 90 ? fast : slow;
+        skewed[i] = rank ? slow : fast;
+    }
+
+    MACSIO_TIMING_ClearTimers(MACSIO_TIMING_ALL_GROUPS);
+    mtid = record_timer("mixed", 100, mixed);
+    stid = record_timer("skewed", 100, skewed);
+
+    if (MACSIO_TIMING_GetTimerDatum(mtid, "iter_count") != 100)
+    {
+        fprintf(stderr, "mixed has count %g, expected 100\n", MACSIO_TIMING_GetTimerDatum(mtid, "iter_count"));
+        errors++;
+    }
+    errors += check_percentile("mixed", "p50", MACSIO_TIMING_GetTimerDatum(mtid, "p50"), fast);
+    errors += check_percentile("mixed", "p80", MACSIO_TIMING_GetTimerDatum(mtid, "p80"), fast);
+    errors += check_percentile("mixed", "p95", MACSIO_TIMING_GetTimerDatum(mtid, "p95"), slow);
+    errors += check_percentile("mixed", "p99", MACSIO_TIMING_GetTimerDatum(mtid, "p99"), slow);
+
+#ifdef HAVE_MPI
+    /* The reduced histograms are the sums of all ranks' histograms. So, "mixed" has the
+       same percentiles and the fastest 1/size of the iterations of "skewed" are fast. */
+    MACSIO_TIMING_ReduceTimers(MPI_COMM_WORLD, 0);
+    if (!rank)
+    {
+        char field[32];
+
+        if (MACSIO_TIMING_GetReducedTimerDatum(mtid, "iter_count") != 100 * size ||
+            MACSIO_TIMING_GetReducedTimerDatum(stid, "iter_count") != 100 * size)
+        {
+            fprintf(stderr, "reduced counts are %g and %g, expected %d\n",
+                MACSIO_TIMING_GetReducedTimerDatum(mtid, "iter_count"),
+                MACSIO_TIMING_GetReducedTimerDatum(stid, "iter_count"), 100 * size);
+            errors++;
+        }
+        errors += check_percentile("reduced mixed", "p50", MACSIO_TIMING_GetReducedTimerDatum(mtid, "p50"), fast);
+        errors += check_percentile("reduced mixed", "p99", MACSIO_TIMING_GetReducedTimerDatum(mtid, "p99"), slow);
+
+        snprintf(field, sizeof(field), "p%g", 50.0 / size);
+        errors += check_percentile("reduced skewed", field, MACSIO_TIMING_GetReducedTimerDatum(stid, field), fast);
+        if (size > 1)
+        {
+            snprintf(field, sizeof(field), "p%g", 150.0 / size);
+            errors += check_percentile("reduced skewed", field, MACSIO_TIMING_GetReducedTimerDatum(stid, field), slow);
+        }
+    }
+#else
+    (void) stid;
+    (void) size;
+#endif
+    MACSIO_TIMING_ClearTimers(MACSIO_TIMING_ALL_GROUPS);
+
+    return errors;
+}
+
+/* A node of the call tree as dumped by MACSIO_TIMING_DumpCallTreeToStrings() */
+typedef struct _treeNode_t
+{
+    char label[64];
+    int parent;                      /* Index of the parent node or -1 for a root */
+    int count;
+    double incl, excl;
+} treeNode_t;
+
+/* Parse the dumped call tree into at most maxnodes nodes. Nodes are dumped depth first,
+   each label indented by two spaces per ancestor. Returns the number of nodes. */
+static int get_call_tree(treeNode_t *nodes, int maxnodes)
+{
+    char **strs;
+    int i, n, maxlen, ancestors[32];
+
+    MACSIO_TIMING_DumpCallTreeToStrings(&strs, &n, &maxlen);
+    for (i = 0; i < n; i++)
+    {
+        int pos = 0, depth = 0;
+
+        if (i < maxnodes &&
+            sscanf(strs[i], "INCL=%lf,EXCL=%lf,MAX=%*f,CNT=%d:%n",
+                &nodes[i].incl, &nodes[i].excl, &nodes[i].count, &pos) == 3 && pos > 0)
+        {
+            while (strs[i][pos + 2 * depth] == ' ' && depth < 31)
+                depth++;
+            snprintf(nodes[i].label, sizeof(nodes[i].label), "%s", &strs[i][pos + 2 * depth]);
+            ancestors[depth] = i;
+            nodes[i].parent = depth ? ancestors[depth-1] : -1;
+        }
+        free(strs[i]);
+    }
+    free(strs);
+
+    return n < maxnodes ? n : maxnodes;
+}
+
+/* Index of the node with the given label and parent or -1 */
+static int find_node(treeNode_t const *nodes, int n, char const *label, int parent)
+{
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        if (nodes[i].parent == parent && !strcmp(nodes[i].label, label))
+            return i;
+    }
+    return -1;
+}
+
+/* Check a node is in the tree with the given parent and count and, if incl is not
+   negative, inclusive time. Returns the node's index or -1. */
+static int check_node(treeNode_t const *nodes, int n, char const *label, int parent, int count,
+    double incl, int *errors)
+{
+    int i = find_node(nodes, n, label, parent);
+
+    if (i < 0)
+    {
+        fprintf(stderr, "no %s node under node %d\n", label, parent);
+        (*errors)++;
+    }
+    else if (nodes[i].count != count || (incl >= 0 && fabs(nodes[i].incl - incl) > 1e-5))
+    {
+        fprintf(stderr, "%s node under node %d has count %d and time %g, expected %d and %g\n",
+            label, parent, nodes[i].count, nodes[i].incl, count, incl);
+        (*errors)++;
+    }
+
+    return i;
+}
+
+/* The "leaf" timer, started from a single line so that it is the same timer wherever
+   it is called from */
+static void record_leaf(double t)
+{
+    MT_RecordTimer("leaf", MACSIO_TIMING_ALL_GROUPS, MACSIO_TIMING_ITER_AUTO, t);
+}
+
+/* Check the call tree of a known nesting of timers. The same timer, "leaf", started
+   within two others is two nodes. Returns the number of failed checks. */
+static int check_call_tree(void)
+{
+    treeNode_t nodes[8];
+    MACSIO_TIMING_TimerId_t outer, mid;
+    int i, j, n, o, m, errors = 0;
+
+    MACSIO_TIMING_ClearTimers(MACSIO_TIMING_ALL_GROUPS);
+    outer = MT_StartTimer("outer", MACSIO_TIMING_ALL_GROUPS, 0);
+    dsleep(0.02);
+    mid = MT_StartTimer("mid", MACSIO_TIMING_ALL_GROUPS, 0);
+    record_leaf(0.004);
+    record_leaf(0.004);
+    MT_StopTimer(mid);
+    record_leaf(0.001);
+    MT_RecordTimer("side", MACSIO_TIMING_ALL_GROUPS, 0, 0.003);
+    MT_StopTimer(outer);
+
+    n = get_call_tree(nodes, 8);
+    if (n != 5)
+    {
+        fprintf(stderr, "call tree has %d nodes, expected 5\n", n);
+        errors++;
+    }
+
+    /* The time of "mid" is that of its children as it ran for less */
+    o = check_node(nodes, n, "outer", -1, 1, -1, &errors);
+    if (o >= 0)
+    {
+        if (nodes[o].incl < 0.02)
+        {
+            fprintf(stderr, "outer node has time %g, expected at least 0.02\n", nodes[o].incl);
+            errors++;
+        }
+        m = check_node(nodes, n, "mid", o, 1, 0.008, &errors);
+        if (m >= 0)
+            check_node(nodes, n, "leaf", m, 2, 0.008, &errors);
+        check_node(nodes, n, "leaf", o, 1, 0.001, &errors);
+        check_node(nodes, n, "side", o, 1, 0.003, &errors);
+    }
+
+    /* Exclusive time is inclusive time less that of children, up to rounding */
+    for (i = 0; i < n; i++)
+    {
+        double child_time = 0;
+        for (j = 0; j < n; j++)
+        {
+            if (nodes[j].parent == i)
+                child_time += nodes[j].incl;
+        }
+        if (fabs(nodes[i].incl - child_time - nodes[i].excl) > 5e-5)
+        {
+            fprintf(stderr, "%s node has times %g and %g, expected exclusive time %g\n",
+                nodes[i].label, nodes[i].incl, nodes[i].excl, nodes[i].incl - child_time);
+            errors++;
+        }
+    }
+    MACSIO_TIMING_ClearTimers(MACSIO_TIMING_ALL_GROUPS);
+
+    return errors;
+}
+
+/* Check the call tree slots of cleared nodes are used again. Clearing only the "cleared"
+   group keeps the tree and marks the cleared node's slot free. Without reuse, clearing
+   and restarting its timer more times than the tree has slots would fill the tree.
+   Returns the number of failed checks. */
+static int check_node_reuse(void)
+{
+    MACSIO_TIMING_GroupMask_t kept = MACSIO_TIMING_GroupMask("kept");
+    MACSIO_TIMING_GroupMask_t cleared = MACSIO_TIMING_GroupMask("cleared");
+    treeNode_t nodes[4];
+    int i, n, errors = 0;
+
+    MACSIO_TIMING_ClearTimers(MACSIO_TIMING_ALL_GROUPS);
+    MT_RecordTimer("kept", kept, 0, 0.001);
+    for (i = 0; i < 2000; i++)
+    {
+        MACSIO_TIMING_ClearTimers(cleared);
+        MT_RecordTimer("cleared", cleared, 0, 0.002);
+    }
+
+    n = get_call_tree(nodes, 4);
+    if (n != 2)
+    {
+        fprintf(stderr, "call tree has %d nodes after clearing, expected 2\n", n);
+        errors++;
+    }
+    check_node(nodes, n, "kept", -1, 1, 0.001, &errors);
+    check_node(nodes, n, "cleared", -1, 1, 0.002, &errors);
+    MACSIO_TIMING_ClearTimers(MACSIO_TIMING_ALL_GROUPS);
+
+    return errors;
+}
+
+/* Average cost, in nanoseconds, of a start/stop pair of a timer */
+static double bench_timer(int cached)
+{
+    int const n = 1000000;
+    double t0, t1;
+    int i;
+
+    MACSIO_TIMING_ClearTimers(MACSIO_TIMING_ALL_GROUPS);
+    t0 = MT_Time();
+    for (i = 0; i < n; i++)
+        MT_StopTimer(start_bench(cached));
+    t1 = MT_Time();
+    MACSIO_TIMING_ClearTimers(MACSIO_TIMING_ALL_GROUPS);
+
+    return (t1 - t0) * 1e9 / n;
+}
+
 int main(int argc, char **argv)
 {
-    int i, rank = 0, size = 1;
+    int i, rank = 0, size = 1, errors;
     MACSIO_TIMING_TimerId_t a, b;
     char **timer_strs;
     int ntimer_strs, maxstrlen;
@@ -141,7 +477,7 @@ int main(int argc, char **argv)
     {
         int rbuf[2], sbuf[2] = {ntimer_strs, maxstrlen};
         MPI_Allreduce(sbuf, rbuf, 2, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
-        MACSIO_LOG_MainLog = MACSIO_LOG_LogInit(MPI_COMM_WORLD, "tsttiming.log", rbuf[1]+32, 2*rbuf[0]+4,0);
+        MACSIO_LOG_MainLog = MACSIO_LOG_LogInit(MPI_COMM_WORLD, "tsttiming.log", rbuf[1]+32, 4*rbuf[0]+8,0);
     }
 #else
     MACSIO_LOG_MainLog = MACSIO_LOG_LogInit(0, "tsttiming.log", maxstrlen+4, ntimer_strs+4, 0);
@@ -166,6 +502,15 @@ int main(int argc, char **argv)
             free(timer_strs[i]);
         }
         free(timer_strs);
+
+        MACSIO_TIMING_DumpReducedCallTreeToStrings(&timer_strs, &ntimer_strs, &maxstrlen);
+        MACSIO_LOG_MSG(Dbg1, ("#####################Reduced Call Tree#########################"));
+        for (i = 0; i < ntimer_strs; i++)
+        {
+            MACSIO_LOG_MSG(Dbg1, (timer_strs[i]));
+            free(timer_strs[i]);
+        }
+        free(timer_strs);
     }
 #endif
 
@@ -173,9 +518,26 @@ int main(int argc, char **argv)
 
     MACSIO_TIMING_ClearTimers(MACSIO_TIMING_ALL_GROUPS);
 
+    errors = check_cached_timer();
+    errors += check_histograms(rank, size);
+    errors += check_call_tree();
+    errors += check_node_reuse();
+
+    /* Overhead of the timers themselves, only when asked for with --bench */
+    if (argc > 1 && !strcmp(argv[1], "--bench"))
+    {
+        double ns = bench_timer(0);
+        double nsCached = bench_timer(1);
+        if (!rank)
+        {
+            printf("MT_StartTimer/MT_StopTimer:       %8.1f ns per start/stop pair\n", ns);
+            printf("MT_StartTimerCached/MT_StopTimer: %8.1f ns per start/stop pair\n", nsCached);
+        }
+    }
+
 #ifdef HAVE_MPI
     MPI_Finalize();
 #endif
 
-    return 0;
+    return errors ? 1 : 0;
 }
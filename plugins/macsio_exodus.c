@@ -61,6 +61,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 /* the name you want to assign to the interface */
 static char const *iface_name = "exodus";
 static char const *iface_ext = "exoII";
+static int mif_tag;
 static char *cpu_word_size = "double";
 static char io_word_size[32];
 static int use_nemesis = 0;
@@ -545,49 +546,36 @@ static void main_dump(int argi, int argc, char **argv, json_object *main_obj, in
     rank = JsonGetInt(main_obj, "parallel/mpi_rank");
     size = JsonGetInt(main_obj, "parallel/mpi_size");
 
-//#warning MOVE TO A FUNCTION
-    /* ensure we're in MIF mode and determine the file count */
-    json_object *parfmode_obj = JsonGetObj(main_obj, "clargs/parallel_file_mode");
-    if (parfmode_obj)
+    /* ensure we're in MIF mode; this plugin always writes a file per task */
+    switch (MACSIO_MIF_ParallelFileMode(main_obj, &numGroups))
     {
-        json_object *modestr = json_object_array_get_idx(parfmode_obj, 0);
-        json_object *filecnt = json_object_array_get_idx(parfmode_obj, 1);
-        if (modestr && !strcmp(json_object_get_string(modestr), "SIF"))
-        {
+        case MACSIO_MIF_MODE_SIF:
             MACSIO_LOG_MSG(Die, ("Exodus plugin doesn't support SIF mode"));
-        }
-        else if (modestr && strcmp(json_object_get_string(modestr), "MIFMAX"))
-        {
-            MACSIO_LOG_MSG(Warn, ("Exodus plugin supports only MIFMAX mode"));
-        }
-        numGroups = size;
-    }
-    else
-    {
-        char const * modestr = JsonGetStr(main_obj, "clargs/parallel_file_mode");
-        if (!strcmp(modestr, "SIF"))
-        {
-            MACSIO_LOG_MSG(Die, ("Exodus plugin doesn't support SIF mode"));
-        }
-        else if (strcmp(modestr, "MIFMAX"))
-        {
-            MACSIO_LOG_MSG(Warn, ("Exodus plugin supports only MIFMAX mode"));
-        }
-        numGroups = size;
+            break;
+        case MACSIO_MIF_MODE_MIFMEM:
+            MACSIO_LOG_MSG(Die, ("Exodus plugin doesn't support MIFMEM mode"));
+            break;
+        default:
+            if (numGroups != size)
+                MACSIO_LOG_MSG(Warn, ("Exodus plugin supports only MIFMAX mode"));
+            break;
     }
+    numGroups = size;
 
     get_exodus_global_init_params(main_obj, dumpn, dumpt, &ex_globals);
 
-    bat = MACSIO_MIF_Init(numGroups, ioFlags, MACSIO_MAIN_Comm, 1,
+    bat = MACSIO_MIF_Init(numGroups, ioFlags, MACSIO_MAIN_Comm, mif_tag,
         CreateExodusFile, OpenExodusFile, CloseExodusFile, &ex_globals);
 
     /* Construct name for the file */
-    sprintf(fileName, "%s_exodus_%05d.%s",
+    MACSIO_UTILS_OutputPath(main_obj, dumpn, MACSIO_MIF_RankOfGroup(bat, rank),
+        MACSIO_MIF_NumGroups(bat), fileName, sizeof(fileName), "%s_exodus_%05d.%s",
         JsonGetStr(main_obj, "clargs/filebase"),
         MACSIO_MIF_RankOfGroup(bat, rank),
         JsonGetStr(main_obj, "clargs/fileext"));
+    MACSIO_UTILS_MakeOutputDirs(main_obj, dumpn, MACSIO_MIF_NumGroups(bat), MACSIO_MAIN_Comm);
 
-    MACSIO_UTILS_RecordOutputFiles(dumpn, fileName);
+    MACSIO_MIF_RecordGroupFile(bat, dumpn, fileName);
 
     /* Wait for write access to the file. All processors call this.
      * Some processors (the first in each group) return immediately
@@ -635,6 +623,8 @@ static int register_this_interface()
 {
     MACSIO_IFACE_Handle_t iface;
 
+    memset(&iface, 0, sizeof(iface));
+
     if (strlen(iface_name) >= MACSIO_IFACE_MAX_NAME)
         MACSIO_LOG_MSG(Die, ("Interface name \"%s\" too long",iface_name));
 
@@ -646,6 +636,8 @@ static int register_this_interface()
     iface.dumpFunc = main_dump;
     iface.processArgsFunc = process_args;
 
+    mif_tag = MACSIO_MIF_AllocTag("exodus mif");
+
     if (!MACSIO_IFACE_Register(&iface))
         MACSIO_LOG_MSG(Die, ("Failed to register interface \"%s\"", iface_name));
 
@@ -37,6 +37,8 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include <macsio_log.h>
 #include <macsio_main.h>
 #include <macsio_mif.h>
+#include <macsio_msf.h>
+#include <macsio_timing.h>
 #include <macsio_utils.h>
 
 #ifdef HAVE_MPI
@@ -92,6 +94,18 @@ static char const *iface_name = "hdf5";
 /*! \brief file extension for files managed by this plugin */
 static char const *iface_ext = "h5";
 
+/*! \brief MPI tag of MIF batons */
+static int mif_tag;
+
+/*! \brief MPI tag of file images sent to MIFMEM group leaders */
+static int image_tag;
+
+/*! \brief MPI tag of MSF batons */
+static int msf_tag;
+
+/*! \brief Timer group of HDF5 library calls */
+static MACSIO_TIMING_GroupMask_t h5_grp;
+
 static int use_log = 0; /**< Use HDF5's logging fapl */
 static int no_collective = 0; /**< Use HDF5 independent (e.g. not collective) I/O */
 static int no_single_chunk = 0; /**< disable single chunking */
@@ -511,12 +525,15 @@ main_dump_sif(
 
 //#warning FOR MIF, NEED A FILEROOT ARGUMENT OR CHANGE TO FILEFMT ARGUMENT
     /* Construct name for the HDF5 file */
-    sprintf(fileName, "%s_hdf5_%03d.%s",
+    MACSIO_UTILS_OutputPath(main_obj, dumpn, 0, 1, fileName, sizeof(fileName), "%s_hdf5_%03d.%s",
         json_object_path_get_string(main_obj, "clargs/filebase"),
         dumpn,
         json_object_path_get_string(main_obj, "clargs/fileext"));
+    MACSIO_UTILS_MakeOutputDirs(main_obj, dumpn, 1, MACSIO_MAIN_Comm);
 
-    MACSIO_UTILS_RecordOutputFiles(dumpn, fileName);
+    /* Only one task records the shared file for size accounting */
+    if (MACSIO_MAIN_Rank == 0)
+        MACSIO_UTILS_RecordOutputFiles(dumpn, fileName);
     h5file_id = H5Fcreate(fileName, H5F_ACC_TRUNC, H5P_DEFAULT, fapl_id);
 
     /* Create an HDF5 Dataspace for the global whole of mesh and var objects in the file. */
@@ -626,7 +643,10 @@ main_dump_sif(
                 buf = json_object_extarr_data(extarr_obj);
             }
 
+            static MACSIO_TIMING_TimerSite_t h5dwrite_site = MT_TIMER_SITE;
+            MACSIO_TIMING_TimerId_t tid = MT_StartTimerCached(&h5dwrite_site, "H5Dwrite", h5_grp, MACSIO_TIMING_ITER_AUTO);
             H5Dwrite(ds_id, dtype_id, mspace_id, fspace_id, dxpl_id, buf);
+            MT_StopTimer(tid);
             H5Sclose(fspace_id);
             H5Sclose(mspace_id);
 
@@ -764,13 +784,42 @@ write_mesh_part(
         fspace_id = H5Screate_simple(ndims, var_dims, 0);
         dcpl_id = make_dcpl(compression_alg_str, compression_params_str, fspace_id, dtype_id);
         ds_id = H5Dcreate1(h5loc, varname, dtype_id, fspace_id, dcpl_id); 
+        static MACSIO_TIMING_TimerSite_t h5dwrite_site = MT_TIMER_SITE;
+        MACSIO_TIMING_TimerId_t tid = MT_StartTimerCached(&h5dwrite_site, "H5Dwrite", h5_grp, MACSIO_TIMING_ITER_AUTO);
         H5Dwrite(ds_id, dtype_id, H5S_ALL, H5S_ALL, H5P_DEFAULT, buf);
+        MT_StopTimer(tid);
         H5Dclose(ds_id);
         H5Pclose(dcpl_id);
         H5Sclose(fspace_id);
     }
 }
 
+/*! \brief Write all of this task's mesh parts, each in its own domain group */
+static void
+write_mesh_parts(
+    hid_t h5File, /**< HDF5 file (or group) id into which to write */
+    json_object *main_obj /**< main data object to dump */
+)
+{
+    json_object *parts = json_object_path_get_array(main_obj, "problem/parts");
+
+    for (int i = 0; i < json_object_array_length(parts); i++)
+    {
+        char domain_dir[256];
+        json_object *this_part = json_object_array_get_idx(parts, i);
+        hid_t domain_group_id;
+
+        snprintf(domain_dir, sizeof(domain_dir), "domain_%07d",
+            json_object_path_get_int(this_part, "Mesh/ChunkID"));
+ 
+        domain_group_id = H5Gcreate1(h5File, domain_dir, 0);
+
+        write_mesh_part(domain_group_id, this_part);
+
+        H5Gclose(domain_group_id);
+    }
+}
+
 /*! \brief Main dump output for HDF5 plugin MIF mode */
 static void
 main_dump_mif( 
@@ -794,42 +843,28 @@ main_dump_mif(
 //#warning MAKE WHOLE FILE USE HDF5 1.8 INTERFACE
 //#warning SET FILE AND DATASET PROPERTIES
 //#warning DIFFERENT MPI TAGS FOR DIFFERENT PLUGINS AND CONTEXTS
-    MACSIO_MIF_baton_t *bat = MACSIO_MIF_Init(numFiles, ioFlags, MACSIO_MAIN_Comm, 3,
+    MACSIO_MIF_baton_t *bat = MACSIO_MIF_Init(numFiles, ioFlags, MACSIO_MAIN_Comm, mif_tag,
         CreateHDF5File, OpenHDF5File, CloseHDF5File, &userData);
 
     rank = json_object_path_get_int(main_obj, "parallel/mpi_rank");
     size = json_object_path_get_int(main_obj, "parallel/mpi_size");
 
     /* Construct name for the silo file */
-    sprintf(fileName, "%s_hdf5_%05d_%03d.%s",
+    MACSIO_UTILS_OutputPath(main_obj, dumpn, MACSIO_MIF_RankOfGroup(bat, rank),
+        MACSIO_MIF_NumGroups(bat), fileName, sizeof(fileName), "%s_hdf5_%05d_%03d.%s",
         json_object_path_get_string(main_obj, "clargs/filebase"),
         MACSIO_MIF_RankOfGroup(bat, rank),
         dumpn,
         json_object_path_get_string(main_obj, "clargs/fileext"));
+    MACSIO_UTILS_MakeOutputDirs(main_obj, dumpn, MACSIO_MIF_NumGroups(bat), MACSIO_MAIN_Comm);
 
-    MACSIO_UTILS_RecordOutputFiles(dumpn, fileName);
+    MACSIO_MIF_RecordGroupFile(bat, dumpn, fileName);
     
     h5File_ptr = (hid_t *) MACSIO_MIF_WaitForBaton(bat, fileName, 0);
     h5File = *h5File_ptr;
     h5Group = userData.groupId;
 
-    json_object *parts = json_object_path_get_array(main_obj, "problem/parts");
-
-    for (int i = 0; i < json_object_array_length(parts); i++)
-    {
-        char domain_dir[256];
-        json_object *this_part = json_object_array_get_idx(parts, i);
-        hid_t domain_group_id;
-
-        snprintf(domain_dir, sizeof(domain_dir), "domain_%07d",
-            json_object_path_get_int(this_part, "Mesh/ChunkID"));
- 
-        domain_group_id = H5Gcreate1(h5File, domain_dir, 0);
-
-        write_mesh_part(domain_group_id, this_part);
-
-        H5Gclose(domain_group_id);
-    }
+    write_mesh_parts(h5File, main_obj);
 
     /* If this is the 'root' processor, also write Silo's multi-XXX objects */
 #if 0
@@ -847,6 +882,349 @@ main_dump_mif(
 
 }
 
+#ifdef HAVE_MPI
+/*!
+\brief Describe all of this task's mesh parts' vars as text
+
+One line per var of each part giving the index of the part on this task, the part's
+chunk ID, the var's index in the part, its type (0 for double, 1 for int), its shape
+and its name. Every task in an MSF group needs this for every part in the group
+because creating datasets in a parallel HDF5 file is collective.
+*/
+static char *
+describe_mesh_parts(
+    json_object *main_obj, /**< main data object to dump */
+    int *len /**< [out] Length of the description including the terminating null */
+)
+{
+    json_object *parts = json_object_path_get_array(main_obj, "problem/parts");
+    int p, v, n = 0, size = 1;
+    char *desc;
+
+    for (p = 0; p < json_object_array_length(parts); p++)
+    {
+        json_object *part_obj = json_object_array_get_idx(parts, p);
+        json_object *vars_array = json_object_path_get_array(part_obj, "Vars");
+        for (v = 0; v < json_object_array_length(vars_array); v++)
+            size += 128 + strlen(json_object_path_get_string(json_object_array_get_idx(vars_array, v), "name"));
+    }
+
+    desc = (char *) malloc(size);
+    desc[0] = '\0';
+    for (p = 0; p < json_object_array_length(parts); p++)
+    {
+        json_object *part_obj = json_object_array_get_idx(parts, p);
+        json_object *vars_array = json_object_path_get_array(part_obj, "Vars");
+        int chunkId = json_object_path_get_int(part_obj, "Mesh/ChunkID");
+
+        for (v = 0; v < json_object_array_length(vars_array); v++)
+        {
+            json_object *var_obj = json_object_array_get_idx(vars_array, v);
+            json_object *data_obj = json_object_path_get_extarr(var_obj, "data");
+            int j, ndims = json_object_extarr_ndims(data_obj);
+            unsigned long long dims[3] = {1, 1, 1};
+
+            for (j = 0; j < ndims; j++)
+                dims[j] = (unsigned long long) json_object_extarr_dim(data_obj, j);
+            n += sprintf(desc + n, "%d %d %d %d %d %llu %llu %llu %s\n", p, chunkId, v,
+                json_object_extarr_type(data_obj)==json_extarr_type_flt64 ? 0 : 1,
+                ndims, dims[0], dims[1], dims[2],
+                json_object_path_get_string(var_obj, "name"));
+        }
+    }
+
+    *len = n + 1;
+    return desc;
+}
+
+/*!
+\brief Main dump output for HDF5 plugin MSF mode
+
+This is SIF mode with a file count. Tasks are divided into groups as in MIF mode but,
+instead of passing a baton, each group creates its file collectively with the MPI-IO
+VFD on the group's communicator from \ref MACSIO_MSF. So, the files are written
+concurrently and tasks within a group write concurrently. The files are laid out like
+MIF mode's with each part in its own domain group. Every task in a group creates all
+the group's datasets. Then, unless \c --no_collective is given, the tasks write each
+dataset collectively with only its owner selecting any data. With \c --no_collective,
+each task writes only its own datasets independently.
+*/
+static void
+main_dump_msf(
+   json_object *main_obj, /**< main data object to dump */
+   int numFiles, /**< MSF file count */
+   int dumpn, /**< dump number (like a cycle number) */
+   double dumpt /**< dump time */
+)
+{
+    int rank, groupSize, i, len, *lens, *displs, owner;
+    int prevChunkId = -1;
+    char fileName[256];
+    char *desc, *allDesc, *line;
+    json_object *parts = json_object_path_get_array(main_obj, "problem/parts");
+    hid_t h5File, fapl_id, dxpl_id, domain_group_id = -1;
+    MACSIO_MSF_ioFlags_t ioFlags = {MACSIO_MSF_WRITE, 0};
+    MACSIO_MSF_baton_t *bat;
+    MPI_Comm groupComm;
+
+    if (numFiles > json_object_path_get_int(main_obj, "parallel/mpi_size"))
+        numFiles = json_object_path_get_int(main_obj, "parallel/mpi_size");
+
+    bat = MACSIO_MSF_Init(numFiles, ioFlags, MACSIO_MAIN_Comm, msf_tag, 0);
+    groupComm = MACSIO_MSF_CommOfGroup(bat);
+    groupSize = MACSIO_MSF_SizeOfGroup(bat);
+    rank = json_object_path_get_int(main_obj, "parallel/mpi_rank");
+
+    MACSIO_UTILS_OutputPath(main_obj, dumpn, MACSIO_MSF_RankOfGroup(bat, rank),
+        numFiles, fileName, sizeof(fileName), "%s_hdf5_%05d_%03d.%s",
+        json_object_path_get_string(main_obj, "clargs/filebase"),
+        MACSIO_MSF_RankOfGroup(bat, rank),
+        dumpn,
+        json_object_path_get_string(main_obj, "clargs/fileext"));
+    MACSIO_UTILS_MakeOutputDirs(main_obj, dumpn, numFiles, MACSIO_MAIN_Comm);
+
+    MACSIO_MSF_RecordGroupFile(bat, dumpn, fileName);
+
+    /* Gather the descriptions of all the group's parts to all the group's tasks */
+    desc = describe_mesh_parts(main_obj, &len);
+    lens = (int *) malloc(groupSize * sizeof(int));
+    displs = (int *) malloc(groupSize * sizeof(int));
+    MPI_Allgather(&len, 1, MPI_INT, lens, 1, MPI_INT, groupComm);
+    for (i = 0, displs[0] = 0; i < groupSize-1; i++)
+        displs[i+1] = displs[i] + lens[i];
+    allDesc = (char *) malloc(displs[groupSize-1] + lens[groupSize-1]);
+    MPI_Allgatherv(desc, len, MPI_CHAR, allDesc, lens, displs, MPI_CHAR, groupComm);
+
+    fapl_id = make_fapl();
+#if H5_HAVE_PARALLEL
+    H5Pset_fapl_mpio(fapl_id, groupComm, MPI_INFO_NULL);
+#endif
+    h5File = H5Fcreate(fileName, H5F_ACC_TRUNC, H5P_DEFAULT, fapl_id);
+    H5Pclose(fapl_id);
+
+    dxpl_id = H5Pcreate(H5P_DATASET_XFER);
+#if H5_HAVE_PARALLEL
+    if (no_collective)
+        H5Pset_dxpl_mpio(dxpl_id, H5FD_MPIO_INDEPENDENT);
+    else
+        H5Pset_dxpl_mpio(dxpl_id, H5FD_MPIO_COLLECTIVE);
+#endif
+
+    /* Every task walks the group's vars in the same order. Each task's description
+       is null terminated so each is walked separately. */
+    for (owner = 0; owner < groupSize; owner++)
+    {
+        for (line = allDesc + displs[owner]; *line; line = strchr(line, '\n') + 1)
+        {
+            int p, chunkId, v, type, ndims;
+            unsigned long long dims[3];
+            char varName[256];
+            hsize_t var_dims[3];
+            hid_t fspace_id, mspace_id, ds_id, dcpl_id, dtype_id;
+            void const *buf = 0;
+
+            sscanf(line, "%d %d %d %d %d %llu %llu %llu %255s", &p, &chunkId, &v, &type, &ndims,
+                &dims[0], &dims[1], &dims[2], varName);
+            dtype_id = type == 0 ? H5T_NATIVE_DOUBLE : H5T_NATIVE_INT;
+            for (i = 0; i < ndims; i++)
+                var_dims[i] = (hsize_t) dims[i];
+
+            if (chunkId != prevChunkId)
+            {
+                char domain_dir[256];
+                if (domain_group_id >= 0)
+                    H5Gclose(domain_group_id);
+                snprintf(domain_dir, sizeof(domain_dir), "domain_%07d", chunkId);
+                domain_group_id = H5Gcreate1(h5File, domain_dir, 0);
+                prevChunkId = chunkId;
+            }
+
+            fspace_id = H5Screate_simple(ndims, var_dims, 0);
+            dcpl_id = make_dcpl(compression_alg_str, compression_params_str, fspace_id, dtype_id);
+            ds_id = H5Dcreate1(domain_group_id, varName, dtype_id, fspace_id, dcpl_id);
+            mspace_id = H5Scopy(fspace_id);
+
+            if (owner == MACSIO_MSF_RankInGroup(bat, rank))
+            {
+                json_object *part_obj = json_object_array_get_idx(parts, p);
+                json_object *var_obj = json_object_array_get_idx(
+                    json_object_path_get_array(part_obj, "Vars"), v);
+                buf = json_object_extarr_data(json_object_path_get_extarr(var_obj, "data"));
+            }
+            else
+            {
+                H5Sselect_none(fspace_id);
+                H5Sselect_none(mspace_id);
+            }
+
+            if (!no_collective || buf)
+            {
+                static MACSIO_TIMING_TimerSite_t h5dwrite_site = MT_TIMER_SITE;
+                MACSIO_TIMING_TimerId_t tid = MT_StartTimerCached(&h5dwrite_site, "H5Dwrite", h5_grp, MACSIO_TIMING_ITER_AUTO);
+                H5Dwrite(ds_id, dtype_id, mspace_id, fspace_id, dxpl_id, buf);
+                MT_StopTimer(tid);
+            }
+
+            H5Dclose(ds_id);
+            H5Pclose(dcpl_id);
+            H5Sclose(mspace_id);
+            H5Sclose(fspace_id);
+        }
+    }
+
+    if (domain_group_id >= 0)
+        H5Gclose(domain_group_id);
+    H5Pclose(dxpl_id);
+    H5Fclose(h5File);
+
+    free(desc);
+    free(allDesc);
+    free(lens);
+    free(displs);
+
+    MACSIO_MSF_Finish(bat);
+}
+#endif
+
+#ifdef HAVE_MPI
+/*! \brief H5Literate callback copying one object of a received file image to the group's file */
+static herr_t
+copy_image_object(
+    hid_t srcRoot, /**< root group of the file image */
+    char const *name, /**< name of the object in the root group */
+    H5L_info_t const *info, /**< link info (unused) */
+    void *dstFile /**< pointer to hid_t of the group's file */
+)
+{
+    return H5Ocopy(srcRoot, name, *((hid_t *) dstFile), name, H5P_DEFAULT, H5P_DEFAULT) < 0 ? -1 : 0;
+}
+
+/*!
+\brief Main dump output for HDF5 plugin in-memory MIF mode
+
+Tasks are grouped just as in MIF mode but only the first task of each group (its
+\em leader) ever opens a file on the file system. Every other task writes its parts
+to an HDF5 file in memory using the core VFD (with no backing store), gets the
+resulting file image with \c H5Fget_file_image and sends it to its leader. The leader
+writes its own parts to the group's file and then, in rank order, receives each other
+task's image, opens it (again with the core VFD) and \c H5Ocopy's its domain groups
+into the group's file. So, the files have the same layout as in MIF mode.
+*/
+static void
+main_dump_mifmem(
+   json_object *main_obj, /**< main data object to dump */
+   int numFiles, /**< MIF file count */
+   int dumpn, /**< dump number (like a cycle number) */
+   double dumpt /**< dump time */
+)
+{
+    int rank, size, src, myGroup, leader = 0;
+    char fileName[256];
+    MACSIO_MIF_ioFlags_t ioFlags = {MACSIO_MIF_WRITE, 0};
+
+    /* Use MACSIO_MIF only for its mapping of tasks to groups. There is no baton passing. */
+    MACSIO_MIF_baton_t *bat = MACSIO_MIF_Init(numFiles, ioFlags, MACSIO_MAIN_Comm, mif_tag,
+        CreateHDF5File, OpenHDF5File, CloseHDF5File, 0);
+
+    rank = json_object_path_get_int(main_obj, "parallel/mpi_rank");
+    size = json_object_path_get_int(main_obj, "parallel/mpi_size");
+    myGroup = MACSIO_MIF_RankOfGroup(bat, rank);
+    for (src = 0; src < size; src++)
+    {
+        if (MACSIO_MIF_RankOfGroup(bat, src) == myGroup && MACSIO_MIF_RankInGroup(bat, src) == 0)
+        {
+            leader = src;
+            break;
+        }
+    }
+
+    MACSIO_UTILS_MakeOutputDirs(main_obj, dumpn, MACSIO_MIF_NumGroups(bat), MACSIO_MAIN_Comm);
+
+    if (rank == leader)
+    {
+        hid_t *h5File_ptr;
+
+        MACSIO_UTILS_OutputPath(main_obj, dumpn, myGroup, MACSIO_MIF_NumGroups(bat),
+            fileName, sizeof(fileName), "%s_hdf5_%05d_%03d.%s",
+            json_object_path_get_string(main_obj, "clargs/filebase"),
+            myGroup,
+            dumpn,
+            json_object_path_get_string(main_obj, "clargs/fileext"));
+        MACSIO_UTILS_RecordOutputFiles(dumpn, fileName);
+
+        h5File_ptr = (hid_t *) CreateHDF5File(fileName, 0, 0);
+        if (!h5File_ptr)
+            MACSIO_LOG_MSG(Die, ("Unable to create \"%s\"", fileName));
+
+        write_mesh_parts(*h5File_ptr, main_obj);
+
+        for (src = 0; src < size; src++)
+        {
+            MPI_Status mpi_stat;
+            int imageSize;
+            void *image;
+            hid_t fapl, imageFile, imageRoot;
+
+            if (src == rank || MACSIO_MIF_RankOfGroup(bat, src) != myGroup)
+                continue;
+
+            /* The image's size is known only once its message has arrived */
+            MPI_Probe(src, image_tag, MACSIO_MAIN_Comm, &mpi_stat);
+            MPI_Get_count(&mpi_stat, MPI_BYTE, &imageSize);
+            image = malloc(imageSize);
+            MPI_Recv(image, imageSize, MPI_BYTE, src, image_tag, MACSIO_MAIN_Comm, &mpi_stat);
+
+            fapl = H5Pcreate(H5P_FILE_ACCESS);
+            H5Pset_fapl_core(fapl, (size_t) 1<<20, 0);
+            H5Pset_file_image(fapl, image, (size_t) imageSize);
+            snprintf(fileName, sizeof(fileName), "macsio_hdf5_image_%05d", src);
+            imageFile = H5Fopen(fileName, H5F_ACC_RDONLY, fapl);
+            H5Pclose(fapl);
+            free(image);
+            if (imageFile < 0)
+            {
+                MACSIO_LOG_MSG(Err, ("Unable to open file image from task %d", src));
+                continue;
+            }
+
+            imageRoot = H5Gopen2(imageFile, "/", H5P_DEFAULT);
+            H5Literate(imageRoot, H5_INDEX_NAME, H5_ITER_INC, 0, copy_image_object, h5File_ptr);
+            H5Gclose(imageRoot);
+            H5Fclose(imageFile);
+        }
+
+        CloseHDF5File(h5File_ptr, 0);
+    }
+    else
+    {
+        hid_t fapl, memFile;
+        ssize_t imageSize;
+        void *image;
+
+        fapl = H5Pcreate(H5P_FILE_ACCESS);
+        H5Pset_fapl_core(fapl, (size_t) 1<<20, 0);
+        snprintf(fileName, sizeof(fileName), "macsio_hdf5_image_%05d", rank);
+        memFile = H5Fcreate(fileName, H5F_ACC_TRUNC, H5P_DEFAULT, fapl);
+        H5Pclose(fapl);
+
+        write_mesh_parts(memFile, main_obj);
+
+        H5Fflush(memFile, H5F_SCOPE_GLOBAL);
+        imageSize = H5Fget_file_image(memFile, 0, 0);
+        if (imageSize < 0 || imageSize > INT_MAX)
+            MACSIO_LOG_MSG(Die, ("Unable to send HDF5 file image of %lld bytes", (long long) imageSize));
+        image = malloc(imageSize);
+        H5Fget_file_image(memFile, image, (size_t) imageSize);
+        H5Fclose(memFile);
+
+        MPI_Send(image, (int) imageSize, MPI_BYTE, leader, image_tag, MACSIO_MAIN_Comm);
+        free(image);
+    }
+
+    MACSIO_MIF_Finish(bat);
+}
+#endif
+
 /*!
 \brief Main dump callback for HDF5 plugin
 
@@ -862,7 +1240,7 @@ main_dump(
     double dumpt /**< dump time */
 )
 {
-    int rank, size, numFiles;
+    int numFiles;
 
 //#warning SET ERROR MODE OF HDF5 LIBRARY
 
@@ -874,34 +1252,22 @@ main_dump(
     /* process cl args */
     process_args(argi, argc, argv);
 
-    rank = json_object_path_get_int(main_obj, "parallel/mpi_rank");
-    size = json_object_path_get_int(main_obj, "parallel/mpi_size");
-
-//#warning MOVE TO A FUNCTION
-    /* ensure we're in MIF mode and determine the file count */
-    json_object *parfmode_obj = json_object_path_get_array(main_obj, "clargs/parallel_file_mode");
-    if (parfmode_obj)
-    {
-        json_object *modestr = json_object_array_get_idx(parfmode_obj, 0);
-        json_object *filecnt = json_object_array_get_idx(parfmode_obj, 1);
-//#warning ERRORS NEED TO GO TO LOG FILES AND ERROR BEHAVIOR NEEDS TO BE HONORED
-        if (!strcmp(json_object_get_string(modestr), "SIF"))
-        {
-            main_dump_sif(main_obj, dumpn, dumpt);
-        }
-        else
-        {
-            numFiles = json_object_get_int(filecnt);
-            main_dump_mif(main_obj, numFiles, dumpn, dumpt);
-        }
-    }
-    else
+    /* determine the mode and the file count */
+    switch (MACSIO_MIF_ParallelFileMode(main_obj, &numFiles))
     {
-        char const * modestr = json_object_path_get_string(main_obj, "clargs/parallel_file_mode");
-        if (!strcmp(modestr, "SIF"))
+        case MACSIO_MIF_MODE_SIF:
         {
             float avg_num_parts = json_object_path_get_double(main_obj, "clargs/avg_num_parts");
-            if (avg_num_parts == (float ((int) avg_num_parts)))
+            if (numFiles > 1)
+            {
+#ifdef HAVE_MPI
+                /* SIF with a file count is MSF mode */
+                main_dump_msf(main_obj, numFiles, dumpn, dumpt);
+#else
+                MACSIO_LOG_MSG(Die, ("HDF5 plugin SIF mode with a file count requires MPI"));
+#endif
+            }
+            else if (avg_num_parts == (float ((int) avg_num_parts)))
                 main_dump_sif(main_obj, dumpn, dumpt);
             else
             {
@@ -910,15 +1276,22 @@ main_dump(
                     "there are different numbers of parts on each MPI rank. "
                     "Set --avg_num_parts to an integral value." ));
             }
+            break;
+        }
+        case MACSIO_MIF_MODE_MIFMEM:
+        {
+#ifdef HAVE_MPI
+            main_dump_mifmem(main_obj, numFiles, dumpn, dumpt);
+#else
+            MACSIO_LOG_MSG(Die, ("HDF5 plugin MIFMEM mode requires MPI"));
+#endif
+            break;
         }
-        else if (!strcmp(modestr, "MIFMAX"))
-            numFiles = json_object_path_get_int(main_obj, "parallel/mpi_size");
-        else if (!strcmp(modestr, "MIFAUTO"))
+        default:
         {
-            /* Call utility to determine optimal file count */
-//#warning ADD UTILIT TO DETERMINE OPTIMAL FILE COUNT
+            main_dump_mif(main_obj, numFiles, dumpn, dumpt);
+            break;
         }
-        main_dump_mif(main_obj, numFiles, dumpn, dumpt);
     }
 }
 
@@ -928,6 +1301,8 @@ register_this_interface()
 {
     MACSIO_IFACE_Handle_t iface;
 
+    memset(&iface, 0, sizeof(iface));
+
     if (strlen(iface_name) >= MACSIO_IFACE_MAX_NAME)
         MACSIO_LOG_MSG(Die, ("Interface name \"%s\" too long", iface_name));
 
@@ -942,6 +1317,11 @@ register_this_interface()
     /* Register custom compression methods with HDF5 library */
     H5dont_atexit();
 
+    mif_tag = MACSIO_MIF_AllocTag("hdf5 mif");
+    image_tag = MACSIO_MIF_AllocTag("hdf5 mifmem image");
+    msf_tag = MACSIO_MIF_AllocTag("hdf5 msf");
+    h5_grp = MACSIO_TIMING_GroupMask("MACSIO_HDF5");
+
     /* Register this plugin */
     if (!MACSIO_IFACE_Register(&iface))
         MACSIO_LOG_MSG(Die, ("Failed to register interface \"%s\"", iface_name));
@@ -26,14 +26,18 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include <json-cwx/json.h>
 
+#include <macsio_async.h>
 #include <macsio_clargs.h>
 #include <macsio_iface.h>
 #include <macsio_log.h>
 #include <macsio_main.h>
 #include <macsio_mif.h>
+#include <macsio_msf.h>
 #include <macsio_utils.h>
 
+#include <limits.h>
 #include <stdio.h>
+#include <string.h>
 
 #ifdef HAVE_MPI
 #include <mpi.h>
@@ -52,7 +56,11 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 
 static char const *iface_name = "miftmpl"; /**< Name of the interface this plugin uses */
 static char const *iface_ext = "json";     /**< Default file extension for files generated by this plugin */
+static int dump_tag;                       /**< MPI tag of the batons of burst dumps */
+static int trickle_tag;                    /**< MPI tag of the batons of trickle dumps */
+static int msf_tag;                        /**< MPI tag of the batons of shared file dumps */
 static int json_as_html = 0;               /**< Use HTML output instead of raw ascii */
+static int node_agg = 0;                   /**< Aggregate each node's parts and write them from one task */
 static int my_opt_one;                     /**< Example of a static scope, plugin-specific variable to be set in
                                                 process_args to control plugin behavior */
 static int my_opt_two;                     /**< Another example variable to control plugin behavior */
@@ -84,6 +92,11 @@ static int process_args(
         "--json_as_html", "",
             "Write files as HTML instead of raw ascii [false]",
             &json_as_html,
+        "--node_agg", "",
+            "Gather the parts of all tasks on a node into shared memory and have\n"
+            "one task per node write them with a single write. The file count is\n"
+            "limited to the number of nodes. [false]",
+            &node_agg,
         "--my_opt_one", "",
             "Help message for my_opt_one which has no arguments. If present, local\n"
             "var my_opt_one will be assigned a value of 1 and a value of zero otherwise.",
@@ -148,41 +161,349 @@ static int CloseMyFile(
 }
 
 /*!
-\brief Write a single mesh part to a MIF file
+\brief CreateFile MIF Callback for trickle dumps
 
-All this method does is serialize the JSON object for the given mesh
-part to an ASCII string and then appends/writes that string at the
-end of the current file.
+Trickle dumps all append to the same set of files. So, the first processor
+in each group creates (truncates) its group's file, and the directories it
+goes in, only on the very first trickle dump and appends to it on all others.
+The directories are not made collectively because the main thread may trickle
+while a threaded dump is using the communicator.
 
-After serializing the object to an ASCII string and writing it to the
-file, the memory for the ASCII string is released by json_object_free_printbuf().
+\return A void pointer to the plugin-specific file handle
+*/
+static void *CreateMyTrickleFile(
+    const char *fname,     /**< [in] Name of the MIF file to create */
+    const char *nsname,    /**< [in] Name of the namespace within the file for caller should use. */
+    void *userData         /**< [in] Pointer to the trickle dump number */
+)
+{
+    int const *trickleNum = (int const *) userData;
+    FILE *file;
+
+    if (!*trickleNum)
+        MACSIO_UTILS_MakeParentDirs(fname);
+    file = fopen(fname, *trickleNum ? "a" : "w");
+    return (void *) file;
+}
+
+/*!
+\brief Serialize all of this task's mesh parts
 
-\return A tiny JSON object holding the name of the file, the offset at
-which the JSON object for this part was written in the file and the part's ID.
+Serializes the JSON object for each mesh part to an ASCII string and catenates
+them, each followed by a newline, into a single buffer that can then be written
+to a file with one call. The memory for each part's ASCII string is released by
+json_object_free_printbuf() as soon as it has been copied.
+
+This needs no access to a file. So, it can be done while waiting for the baton.
+
+\return The buffer which the caller must free
 */
-static json_object *write_mesh_part(
-    FILE *myFile,          /**< [in] The file handle being used in a MIF dump */
-    char const *fileName,  /**< [in] Name of the MIF file */
-    json_object *part_obj  /**< [in] The json object representing this mesh part */
+static char *serialize_mesh_parts(
+    json_object *parts,    /**< [in] The array of json objects representing this task's mesh parts */
+    size_t *len,           /**< [out] Size of the buffer in bytes */
+    size_t **ends          /**< [out] Offset of the end of each part in the buffer. Caller must free. */
 )
 {
-    json_object *part_info = json_object_new_object();
+    int i, numParts = json_object_array_length(parts);
+    char *buf = 0;
+
+    *len = 0;
+    *ends = (size_t *) malloc(numParts * sizeof(size_t));
+    for (i = 0; i < numParts; i++)
+    {
+        json_object *this_part = json_object_array_get_idx(parts, i);
+        char const *str = json_object_to_json_string_ext(this_part, JSON_C_TO_STRING_PRETTY);
+        size_t slen = strlen(str);
+        buf = (char *) realloc(buf, *len + slen + 1);
+        memcpy(buf + *len, str, slen);
+        buf[*len + slen] = '\n';
+        *len += slen + 1;
+        (*ends)[i] = *len;
+        json_object_free_printbuf(this_part);
+    }
+
+    return buf;
+}
+
+/*!
+\brief Record where each of this task's mesh parts was written
+
+Adds to \c part_infos, for each part, a tiny JSON object holding the part's ID,
+the name of the file and the offset of the end of the JSON object for the part
+in the file.
+*/
+static void add_part_infos(
+    json_object *part_infos, /**< [in] Array to which to add info on each part */
+    json_object *parts,      /**< [in] The array of json objects representing this task's mesh parts */
+    char const *fileName,    /**< [in] Name of the MIF file */
+    long long offset,        /**< [in] Offset in the file at which the serialized parts were written */
+    size_t const *ends       /**< [in] Offset of the end of each part in the serialized parts */
+)
+{
+    int i;
 
 //#warning SOMEHOW SHOULD INCLUDE OFFSETS TO EACH VARIABLE
-    /* Write the json mesh part object as an ascii string */
-    fprintf(myFile, "%s\n", json_object_to_json_string_ext(part_obj, JSON_C_TO_STRING_PRETTY));
-    json_object_free_printbuf(part_obj);
+    for (i = 0; i < json_object_array_length(parts); i++)
+    {
+        json_object *this_part = json_object_array_get_idx(parts, i);
+        json_object *part_info = json_object_new_object();
 
-    /* Form the return 'value' holding the information on where to find this part */
-    json_object_object_add(part_info, "partid",
+        /* Form the 'value' holding the information on where to find this part */
+        json_object_object_add(part_info, "partid",
 //#warning CHANGE NAME OF KEY IN JSON TO PartID
-        json_object_new_int(json_object_path_get_int(part_obj, "Mesh/ChunkID")));
-    json_object_object_add(part_info, "file",
-        json_object_new_string(fileName));
-    json_object_object_add(part_info, "offset",
-        json_object_new_double((double) ftello(myFile)));
+            json_object_new_int(json_object_path_get_int(this_part, "Mesh/ChunkID")));
+        json_object_object_add(part_info, "file",
+            json_object_new_string(fileName));
+        json_object_object_add(part_info, "offset",
+            json_object_new_double((double) (offset + ends[i])));
+        json_object_array_add(part_infos, part_info);
+    }
+}
+
+#ifdef HAVE_MPI
+/*!
+\brief Write this task's mesh parts via node-level aggregation
+
+Serializes all of this task's parts into one buffer and gathers the buffers of all
+the tasks on the node into a shared memory window with MACSIO_MIF_NodeAggGather().
+Only the node's aggregator takes part in MIF I/O and writes the node's buffer to its
+group's file in a single write. The aggregator then tells the other tasks on the node
+which file it wrote to and where so that each can compute its parts' offsets.
+*/
+static void write_node_aggregated_parts(
+    json_object *main_obj,          /**< [in] The main json object */
+    int dumpn,                      /**< [in] The number/index of this dump */
+    int numFiles,                   /**< [in] The requested file count */
+    MACSIO_MIF_ioFlags_t ioFlags,   /**< [in] MIF I/O flags */
+    json_object *part_infos         /**< [in] Array to which to add info on each of this task's parts */
+)
+{
+    int isAgg, numAggs = 0;
+    char fileName[256];
+    char *buf;
+    size_t len, myOffset, aggLen;
+    size_t *ends;
+    void *aggBuf;
+    long long where[3] = {0, 0, 0}; /* group number, file offset of node's data and file count */
+    json_object *parts = json_object_path_get_array(main_obj, "problem/parts");
+    MACSIO_MIF_nodeAgg_t *agg;
+
+    buf = serialize_mesh_parts(parts, &len, &ends);
+
+    agg = MACSIO_MIF_NodeAggInit(MACSIO_MAIN_Comm);
+    aggBuf = MACSIO_MIF_NodeAggGather(agg, buf, len, &myOffset, &aggLen);
+    free(buf);
+
+    isAgg = MACSIO_MIF_NodeAggIsAggregator(agg);
+    if (isAgg)
+    {
+        MPI_Comm aggComm = MACSIO_MIF_NodeAggComm(agg);
+        MACSIO_MIF_baton_t *bat;
+        FILE *myFile;
+        int aggRank;
+
+        MPI_Comm_size(aggComm, &numAggs);
+        MPI_Comm_rank(aggComm, &aggRank);
+        if (numFiles > numAggs)
+        {
+            if (aggRank == 0)
+                MACSIO_LOG_MSG(Info, ("Node aggregation limits file count from %d to %d nodes", numFiles, numAggs));
+            numFiles = numAggs;
+        }
+
+        bat = MACSIO_MIF_Init(numFiles, ioFlags, aggComm, dump_tag,
+            CreateMyFile, OpenMyFile, CloseMyFile, 0);
+
+        where[0] = MACSIO_MIF_RankOfGroup(bat, aggRank);
+        where[2] = MACSIO_MIF_NumGroups(bat);
+        MACSIO_UTILS_MakeOutputDirs(main_obj, dumpn, (int) where[2], aggComm);
+        MACSIO_UTILS_OutputPath(main_obj, dumpn, (int) where[0], (int) where[2],
+            fileName, sizeof(fileName), "%s_json_%05d_%03d.%s",
+            json_object_path_get_string(main_obj, "clargs/filebase"),
+            (int) where[0], dumpn,
+            json_object_path_get_string(main_obj, "clargs/fileext"));
+
+        MACSIO_MIF_RecordGroupFile(bat, dumpn, fileName);
+
+        myFile = (FILE *) MACSIO_MIF_WaitForBaton(bat, fileName, 0);
+        where[1] = (long long) ftello(myFile);
+        if (aggLen)
+            fwrite(aggBuf, 1, aggLen, myFile);
+        MACSIO_MIF_HandOffBaton(bat, myFile);
+        MACSIO_MIF_Finish(bat);
+    }
+
+    MACSIO_MIF_NodeAggRelease(agg);
+    MPI_Bcast(where, 3, MPI_LONG_LONG, 0, MACSIO_MIF_NodeAggNodeComm(agg));
+    MACSIO_MIF_NodeAggFinish(agg);
+
+    if (!isAgg)
+        MACSIO_UTILS_OutputPath(main_obj, dumpn, (int) where[0], (int) where[2],
+            fileName, sizeof(fileName), "%s_json_%05d_%03d.%s",
+            json_object_path_get_string(main_obj, "clargs/filebase"),
+            (int) where[0], dumpn,
+            json_object_path_get_string(main_obj, "clargs/fileext"));
+
+    add_part_infos(part_infos, parts, fileName, where[1] + (long long) myOffset, ends);
+    free(ends);
+}
+#endif
+
+/*!
+\brief Write this task's mesh parts to its group's shared file
+
+In SIF mode, the tasks are divided into groups by \ref MACSIO_MSF and each group
+writes one shared file. An exclusive scan of the lengths of the serialized parts over
+the group gives each task the offset of its parts in the file. The parts are then
+written by MACSIO_MSF_WriteAt(). Depending on \c --msf_cb_aggregators, each task
+writes its own parts, MACSio aggregates them to a few tasks that do large writes or
+the MPI library does.
+*/
+static void write_shared_parts(
+    json_object *main_obj,  /**< [in] The main json object */
+    int dumpn,              /**< [in] The number/index of this dump */
+    int numFiles,           /**< [in] Number of shared files */
+    json_object *part_infos /**< [in] Array to which to add info on each of this task's parts */
+)
+{
+    int rank, size;
+    char fileName[256];
+    char *buf;
+    size_t len, *ends;
+    long long offset = 0, myLen;
+    MACSIO_MSF_ioFlags_t ioFlags = {MACSIO_MSF_WRITE, 0};
+    MACSIO_MSF_baton_t *bat;
+    json_object *parts = json_object_path_get_array(main_obj, "problem/parts");
+
+    rank = json_object_path_get_int(main_obj, "parallel/mpi_rank");
+    size = json_object_path_get_int(main_obj, "parallel/mpi_size");
+    if (numFiles > size)
+        numFiles = size;
+
+    bat = MACSIO_MSF_Init(numFiles, ioFlags, MACSIO_MAIN_Comm, msf_tag, 0);
+
+    MACSIO_UTILS_OutputPath(main_obj, dumpn, MACSIO_MSF_RankOfGroup(bat, rank),
+        numFiles, fileName, sizeof(fileName), "%s_json_%05d_%03d.%s",
+        json_object_path_get_string(main_obj, "clargs/filebase"),
+        MACSIO_MSF_RankOfGroup(bat, rank),
+        dumpn,
+        json_object_path_get_string(main_obj, "clargs/fileext"));
+    MACSIO_UTILS_MakeOutputDirs(main_obj, dumpn, numFiles, MACSIO_MAIN_Comm);
+
+    MACSIO_MSF_RecordGroupFile(bat, dumpn, fileName);
+
+    buf = serialize_mesh_parts(parts, &len, &ends);
+    myLen = (long long) len;
+#ifdef HAVE_MPI
+    MPI_Exscan(&myLen, &offset, 1, MPI_LONG_LONG, MPI_SUM, MACSIO_MSF_CommOfGroup(bat));
+    if (MACSIO_MSF_RankInGroup(bat, rank) == 0) offset = 0; /* Exscan leaves it undefined */
+#endif
+
+    MACSIO_MSF_WriteAt(bat, fileName, offset, buf, myLen);
+    add_part_infos(part_infos, parts, fileName, offset, ends);
+
+    free(buf);
+    free(ends);
+    MACSIO_MSF_Finish(bat);
+}
+
+/*!
+\brief Write the root (or master) file of a dump
+
+The root file is a single JSON array of the info on every part of the dump. Each
+processor formats the elements for its own parts and an exclusive scan of their
+lengths gives each processor the offset at which they go in the file. All processors
+then write their pieces with one collective MPI-IO write. So, no processor ever holds
+the info on all parts and, unlike passing a baton around, the cost does not grow
+linearly with the processor count.
+*/
+static void write_root_file(
+    json_object *main_obj,  /**< [in] The main json object */
+    int dumpn,              /**< [in] The number/index of this dump */
+    json_object *part_infos /**< [in] Info on each of this processor's parts */
+)
+{
+    int i, rank = 0, size = 1, nparts = json_object_array_length(part_infos);
+    long long partsBefore = 0, len, offset = 0;
+    char fileName[256];
+    char *buf, *p;
+    char const **strs = (char const **) malloc(nparts * sizeof(char const *));
+    size_t *lens = (size_t *) malloc(nparts * sizeof(size_t));
+
+    rank = json_object_path_get_int(main_obj, "parallel/mpi_rank");
+    size = json_object_path_get_int(main_obj, "parallel/mpi_size");
+
+    /* Only the very first part in the file is not preceded by a comma */
+#ifdef HAVE_MPI
+    {
+        long long np = nparts;
+        MPI_Exscan(&np, &partsBefore, 1, MPI_LONG_LONG, MPI_SUM, MACSIO_MAIN_Comm);
+        if (rank == 0) partsBefore = 0; /* Exscan leaves rank 0's result undefined */
+    }
+#endif
+
+    /* Format each part once. Its string lives in its object until the object is freed. */
+    len = 6;
+    for (i = 0; i < nparts; i++)
+    {
+        strs[i] = json_object_to_json_string_ext(json_object_array_get_idx(part_infos, i),
+            JSON_C_TO_STRING_PRETTY);
+        lens[i] = strlen(strs[i]);
+        len += lens[i] + 2;
+    }
+    p = buf = (char *) malloc(len);
+    if (rank == 0) p += sprintf(p, "[\n");
+    for (i = 0; i < nparts; i++)
+    {
+        if (partsBefore + i) p += sprintf(p, ",\n");
+        memcpy(p, strs[i], lens[i]);
+        p += lens[i];
+    }
+    if (rank == size-1) p += sprintf(p, "\n]\n");
+    len = (long long) (p - buf);
+    free(strs);
+    free(lens);
+
+#ifdef HAVE_MPI
+    MPI_Exscan(&len, &offset, 1, MPI_LONG_LONG, MPI_SUM, MACSIO_MAIN_Comm);
+    if (rank == 0) offset = 0;
+#endif
+
+    /* Construct name for the root file. It goes at the top of the dump's directory. */
+    MACSIO_UTILS_OutputPath(main_obj, dumpn, -1, 1, fileName, sizeof(fileName), "%s_json_root_%03d.%s",
+        json_object_path_get_string(main_obj, "clargs/filebase"),
+        dumpn,
+        json_object_path_get_string(main_obj, "clargs/fileext"));
 
-    return part_info;
+    if (rank == 0)
+        MACSIO_UTILS_RecordOutputFiles(dumpn, fileName);
+
+#ifdef HAVE_MPI
+    {
+        MPI_File fh;
+        int mpierr;
+
+        mpierr = MPI_File_open(MACSIO_MAIN_Comm, fileName, MPI_MODE_CREATE|MPI_MODE_WRONLY,
+            MPI_INFO_NULL, &fh);
+        if (mpierr != MPI_SUCCESS)
+            MACSIO_LOG_MSG(Die, ("Unable to open root file \"%s\"", fileName));
+        MPI_File_set_size(fh, 0);
+        if (len > INT_MAX)
+            MACSIO_LOG_MSG(Die, ("Root file piece of %lld bytes is too large for one write", len));
+        MPI_File_write_at_all(fh, (MPI_Offset) offset, buf, (int) len, MPI_CHAR, MPI_STATUS_IGNORE);
+        MPI_File_close(&fh);
+    }
+#else
+    {
+        FILE *rootFile = fopen(fileName, "w");
+        if (!rootFile)
+            MACSIO_LOG_MSG(Die, ("Unable to open root file \"%s\"", fileName));
+        fwrite(buf, 1, len, rootFile);
+        fclose(rootFile);
+    }
+#endif
+
+    free(buf);
 }
 
 /*!
@@ -190,12 +511,9 @@ static json_object *write_mesh_part(
 
 This is the function MACSio main calls to do the actual dump of data with this plugin.
 
-It uses \ref MACSIO_MIF twice; once for the main dump and a second time to create the
-root (or master) file. However, in the second use, the file count is set to 1. That
-means that the root file is effectively written using serial (e.g. non-parallel) I/O.
-
-It is a useful exercise to ask how we might improve the implementation here to avoid
-writing the root file using serial I/O.
+It uses \ref MACSIO_MIF for the main dump or, in SIF mode, \ref write_shared_parts.
+The root (or master) file indexing all the parts is then written in parallel by
+\ref write_root_file.
 */
 static void main_dump(
     int argi,               /**< [in] Command-line argument index at which first plugin-specific arg appears */
@@ -207,8 +525,11 @@ static void main_dump(
     double dumpt            /**< [in] The time to be associated with this dump (like a simulation's time) */
 )
 {
-    int i, rank, numFiles;
+    int rank, numFiles, sif, mode;
     char fileName[256];
+    char *buf;
+    size_t len, *ends;
+    long long offset;
     FILE *myFile;
     MACSIO_MIF_ioFlags_t ioFlags = {MACSIO_MIF_WRITE,(unsigned int) JsonGetInt(main_obj,"clargs/exercise_scr")&0x1};
     MACSIO_MIF_baton_t *bat;
@@ -218,97 +539,158 @@ static void main_dump(
     /* process cl args */
     process_args(argi, argc, argv);
 
-    /* ensure we're in MIF mode and determine the file count */
-//#warning SIMPLIFY THIS LOGIC USING NEW JSON INTERFACE
-    json_object *parfmode_obj = json_object_path_get_array(main_obj, "clargs/parallel_file_mode");
-    if (parfmode_obj)
+    /* determine the mode and the file count */
+    mode = MACSIO_MIF_ParallelFileMode(main_obj, &numFiles);
+    if (mode == MACSIO_MIF_MODE_MIFMEM)
+        MACSIO_LOG_MSG(Die, ("miftmpl plugin doesn't support MIFMEM mode"));
+    sif = mode == MACSIO_MIF_MODE_SIF;
+
+    /* MACSio's main forks for dumps only in file-per-processor mode, in which no baton
+       is passed to other processors. Node aggregation communicates; a forked child
+       writes its own file instead. */
+    if (sif)
     {
-        json_object *modestr = json_object_array_get_idx(parfmode_obj, 0);
-        json_object *filecnt = json_object_array_get_idx(parfmode_obj, 1);
-        if (!strcmp(json_object_get_string(modestr), "SIF"))
-        {
-            MACSIO_LOG_MSG(Die, ("miftmpl plugin cannot currently handle SIF mode"));
-        }
-        else
-        {
-            numFiles = json_object_get_int(filecnt);
-        }
+        write_shared_parts(main_obj, dumpn, numFiles, part_infos);
     }
-    else
+    else if (node_agg && !MACSIO_ASYNC_IsForkedChild())
     {
-        char const * modestr = json_object_path_get_string(main_obj, "clargs/parallel_file_mode");
-        if (!strcmp(modestr, "SIF"))
-        {
-            MACSIO_LOG_MSG(Die, ("miftmpl plugin cannot currently handle SIF mode"));
-        }
-        else if (!strcmp(modestr, "MIFMAX"))
-            numFiles = json_object_path_get_int(main_obj, "parallel/mpi_size");
-        else if (!strcmp(modestr, "MIFAUTO"))
-        {
-            /* Call MACSio utility to determine optimal file count */
-        }
+#ifdef HAVE_MPI
+        write_node_aggregated_parts(main_obj, dumpn, numFiles, ioFlags, part_infos);
+#else
+        MACSIO_LOG_MSG(Die, ("miftmpl plugin node aggregation requires MPI"));
+#endif
     }
+    else
+    {
+        bat = MACSIO_MIF_Init(numFiles, ioFlags, MACSIO_MAIN_Comm, dump_tag,
+            CreateMyFile, OpenMyFile, CloseMyFile, 0);
+
+        rank = json_object_path_get_int(main_obj, "parallel/mpi_rank");
+
+        /* Construct name for the silo file */
+        MACSIO_UTILS_OutputPath(main_obj, dumpn, MACSIO_MIF_RankOfGroup(bat, rank),
+            MACSIO_MIF_NumGroups(bat), fileName, sizeof(fileName), "%s_json_%05d_%03d.%s",
+            json_object_path_get_string(main_obj, "clargs/filebase"),
+            MACSIO_MIF_RankOfGroup(bat, rank),
+            dumpn,
+            json_object_path_get_string(main_obj, "clargs/fileext"));
+
+        /* Create the directories the files go in. A forked child can only create its own. */
+        if (MACSIO_ASYNC_IsForkedChild())
+            MACSIO_UTILS_MakeParentDirs(fileName);
+        else
+            MACSIO_UTILS_MakeOutputDirs(main_obj, dumpn, MACSIO_MIF_NumGroups(bat), MACSIO_MAIN_Comm);
 
-    bat = MACSIO_MIF_Init(numFiles, ioFlags, MACSIO_MAIN_Comm, 3,
-        CreateMyFile, OpenMyFile, CloseMyFile, 0);
+        MACSIO_MIF_RecordGroupFile(bat, dumpn, fileName);
 
-    rank = json_object_path_get_int(main_obj, "parallel/mpi_rank");
+        /* Serialize the parts while the tasks before this one in the group are
+           writing so that only the write itself is on the group's critical path */
+        MACSIO_MIF_PostBaton(bat);
+        parts = json_object_path_get_array(main_obj, "problem/parts");
+        buf = serialize_mesh_parts(parts, &len, &ends);
 
-    /* Construct name for the silo file */
-    sprintf(fileName, "%s_json_%05d_%03d.%s",
-        json_object_path_get_string(main_obj, "clargs/filebase"),
-        MACSIO_MIF_RankOfGroup(bat, rank),
-        dumpn,
-        json_object_path_get_string(main_obj, "clargs/fileext"));
+        myFile = (FILE *) MACSIO_MIF_WaitForBaton(bat, fileName, 0);
 
-    MACSIO_UTILS_RecordOutputFiles(dumpn, fileName);
+        /* Write the json mesh part objects as ascii strings */
+        offset = (long long) ftello(myFile);
+        fwrite(buf, 1, len, myFile);
+        add_part_infos(part_infos, parts, fileName, offset, ends);
+        free(buf);
+        free(ends);
 
-    myFile = (FILE *) MACSIO_MIF_WaitForBaton(bat, fileName, 0);
+        /* Hand off the baton to the next processor. This winds up closing
+         * the file so that the next processor that opens it can be assured
+         * of getting a consistent and up to date view of the file's contents. */
+        MACSIO_MIF_HandOffBaton(bat, myFile);
 
-    parts = json_object_path_get_array(main_obj, "problem/parts");
-    for (i = 0; i < json_object_array_length(parts); i++)
+        /* We're done using MACSIO_MIF for these files, so finish it off */
+        MACSIO_MIF_Finish(bat);
+    }
+
+    /* The root file involves all processors. A forked child cannot write it. So, it
+       hands its part infos back to its parent to write it in finish_forked_dump. */
+    if (MACSIO_ASYNC_IsForkedChild())
     {
-        json_object *this_part = json_object_array_get_idx(parts, i);
-        json_object_array_add(part_infos, write_mesh_part(myFile, fileName, this_part));
+        MACSIO_ASYNC_SetForkedChildResult(part_infos);
+        return;
     }
 
-    /* Hand off the baton to the next processor. This winds up closing
-     * the file so that the next processor that opens it can be assured
-     * of getting a consistent and up to date view of the file's contents. */
-    MACSIO_MIF_HandOffBaton(bat, myFile);
+    write_root_file(main_obj, dumpn, part_infos);
 
-    /* We're done using MACSIO_MIF for these files, so finish it off */
-    MACSIO_MIF_Finish(bat);
+    /* decriment ref-count (and free) part_infos */
+    json_object_put(part_infos);
+}
 
-    /* Use MACSIO_MIF a second time to manage writing of the master/root
-       file contents. This winds up being serial I/O but also means we
-       never collect all info on all parts to any single processor. */
-//#warning THERE IS A BETTER WAY TO DO USING LOOP OF NON-BLOCKING RECIEVES
-    bat = MACSIO_MIF_Init(1, ioFlags, MACSIO_MAIN_Comm, 5,
-        CreateMyFile, OpenMyFile, CloseMyFile, 0);
+/*!
+\brief Write the root file of a dump done by forked children
 
-    /* Construct name for the silo file */
-    sprintf(fileName, "%s_json_root_%03d.%s",
-        json_object_path_get_string(main_obj, "clargs/filebase"),
-        dumpn,
-        json_object_path_get_string(main_obj, "clargs/fileext"));
+The parent of each child does this with the part infos its child returned from main_dump.
+*/
+static void finish_forked_dump(
+    json_object *main_obj,  /**< [in] The main json object */
+    int dumpn,              /**< [in] The number/index of the dump */
+    json_object *part_infos /**< [in] Info on each of this processor's parts (0 if the child failed) */
+)
+{
+    json_object *no_parts = 0;
+
+    if (!part_infos)
+        part_infos = no_parts = json_object_new_array();
 
-    MACSIO_UTILS_RecordOutputFiles(dumpn, fileName);
+    write_root_file(main_obj, dumpn, part_infos);
 
+    json_object_put(no_parts);
+}
+
+/*!
+\brief Trickle dump implementation for this plugin
+
+Each processor appends its small trickle record as a single line of JSON text
+to its group's trickle file. The same files are appended to by every trickle
+dump.
+*/
+static void main_trickle(
+    int argi,                 /**< [in] Command-line argument index at which first plugin-specific arg appears */
+    int argc,                 /**< [in] argc from main */
+    char **argv,              /**< [in] argv from main */
+    json_object *main_obj,    /**< [in] The main json object */
+    json_object *trickle_obj, /**< [in] This processor's trickle record */
+    int trickn,               /**< [in] The number/index of this trickle dump starting from 0 */
+    double trickt             /**< [in] The time to be associated with this trickle dump */
+)
+{
+    int rank, numFiles, mode;
+    char fileName[256];
+    FILE *myFile;
+    MACSIO_MIF_ioFlags_t ioFlags = {MACSIO_MIF_WRITE, 0};
+    MACSIO_MIF_baton_t *bat;
+
+    mode = MACSIO_MIF_ParallelFileMode(main_obj, &numFiles);
+    if (mode == MACSIO_MIF_MODE_SIF)
+        MACSIO_LOG_MSG(Die, ("miftmpl plugin cannot currently handle SIF mode for trickle dumps"));
+    else if (mode == MACSIO_MIF_MODE_MIFMEM)
+        MACSIO_LOG_MSG(Die, ("miftmpl plugin doesn't support MIFMEM mode"));
+
+    bat = MACSIO_MIF_Init(numFiles, ioFlags, MACSIO_MAIN_Comm, trickle_tag,
+        CreateMyTrickleFile, OpenMyFile, CloseMyFile, &trickn);
+
+    rank = json_object_path_get_int(main_obj, "parallel/mpi_rank");
+
+    MACSIO_UTILS_OutputPath(main_obj, MACSIO_UTILS_ALL_DUMPS, MACSIO_MIF_RankOfGroup(bat, rank),
+        MACSIO_MIF_NumGroups(bat), fileName, sizeof(fileName), "%s_json_trickle_%05d.%s",
+        json_object_path_get_string(main_obj, "clargs/filebase"),
+        MACSIO_MIF_RankOfGroup(bat, rank),
+        json_object_path_get_string(main_obj, "clargs/fileext"));
 
-    /* Wait for MACSIO_MIF to give this processor exclusive access */
     myFile = (FILE *) MACSIO_MIF_WaitForBaton(bat, fileName, 0);
 
-//#warning FIX THE STRING THAT WE PRODUCE HERE SO ITS A SINGLE JSON ARRAY OBJECT
-    /* This processor's work on the file is just to write its part_infos */
-    fprintf(myFile, "%s\n", json_object_to_json_string_ext(part_infos, JSON_C_TO_STRING_PRETTY));
+    fprintf(myFile, "{\"TrickleNum\":%d,\"Time\":%g,\"Record\":%s}\n", trickn, trickt,
+        json_object_to_json_string_ext(trickle_obj, JSON_C_TO_STRING_PLAIN));
+    json_object_free_printbuf(trickle_obj);
 
     MACSIO_MIF_HandOffBaton(bat, myFile);
 
     MACSIO_MIF_Finish(bat);
-
-    /* decriment ref-count (and free) part_infos */
-    json_object_put(part_infos);
 }
 
 /*!
@@ -324,6 +706,8 @@ static int register_this_interface()
 {
     MACSIO_IFACE_Handle_t iface;
 
+    memset(&iface, 0, sizeof(iface));
+
     if (strlen(iface_name) >= MACSIO_IFACE_MAX_NAME)
         MACSIO_LOG_MSG(Die, ("Interface name \"%s\" too long", iface_name));
 
@@ -331,8 +715,16 @@ static int register_this_interface()
     strcpy(iface.name, iface_name);
     strcpy(iface.ext, iface_ext);
     iface.dumpFunc = main_dump;
+    iface.trickleFunc = main_trickle;
+    iface.dumpFuncForkable = 1;
+    iface.forkedDumpFinishFunc = finish_forked_dump;
     iface.processArgsFunc = process_args;
 
+    /* Trickle dumps may be done while a burst dump is in flight */
+    dump_tag = MACSIO_MIF_AllocTag("miftmpl dump");
+    trickle_tag = MACSIO_MIF_AllocTag("miftmpl trickle");
+    msf_tag = MACSIO_MIF_AllocTag("miftmpl msf");
+
     /* Register this plugin */
     if (!MACSIO_IFACE_Register(&iface))
         MACSIO_LOG_MSG(Die, ("Failed to register interface \"%s\"", iface_name));
@@ -64,6 +64,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 /* the name you want to assign to the interface */
 static char const *iface_name = "pdb";
 static char const *iface_ext = "pdb";
+static int mif_tag;
 
 static int process_args(int argi, int argc, char *argv[])
 {
@@ -134,20 +135,22 @@ static void main_dump_mif(json_object *main_obj, int numFiles, int dumpn, double
         JsonGetInt(main_obj, "clargs/exercise_scr")&0x1};
 
 //#warning DIFFERENT MPI TAGS FOR DIFFERENT PLUGINS AND CONTEXTS
-    MACSIO_MIF_baton_t *bat = MACSIO_MIF_Init(numFiles, ioFlags, MACSIO_MAIN_Comm, 3,
+    MACSIO_MIF_baton_t *bat = MACSIO_MIF_Init(numFiles, ioFlags, MACSIO_MAIN_Comm, mif_tag,
         CreatePDBFile, OpenPDBFile, ClosePDBFile, 0);
 
     rank = json_object_path_get_int(main_obj, "parallel/mpi_rank");
     size = json_object_path_get_int(main_obj, "parallel/mpi_size");
 
     /* Construct name for the silo file */
-    sprintf(fileName, "%s_pdb_%05d_%03d.%s",
+    MACSIO_UTILS_OutputPath(main_obj, dumpn, MACSIO_MIF_RankOfGroup(bat, rank),
+        MACSIO_MIF_NumGroups(bat), fileName, sizeof(fileName), "%s_pdb_%05d_%03d.%s",
         json_object_path_get_string(main_obj, "clargs/filebase"),
         MACSIO_MIF_RankOfGroup(bat, rank),
         dumpn,
         json_object_path_get_string(main_obj, "clargs/fileext"));
+    MACSIO_UTILS_MakeOutputDirs(main_obj, dumpn, MACSIO_MIF_NumGroups(bat), MACSIO_MAIN_Comm);
 
-    MACSIO_UTILS_RecordOutputFiles(dumpn, fileName);
+    MACSIO_MIF_RecordGroupFile(bat, dumpn, fileName);
 
     pdbfile = (PDBfile*) MACSIO_MIF_WaitForBaton(bat, fileName, 0);
 
@@ -182,7 +185,7 @@ static void main_dump_mif(json_object *main_obj, int numFiles, int dumpn, double
 static void main_dump(int argi, int argc, char **argv, json_object *main_obj,
     int dumpn, double dumpt)
 {
-    int rank, size, numFiles;
+    int numFiles;
 
     /* Without this barrier, I get strange behavior with Silo's MACSIO_MIF interface */
 #ifdef HAVE_MPI
@@ -192,45 +195,26 @@ static void main_dump(int argi, int argc, char **argv, json_object *main_obj,
     /* process cl args */
     process_args(argi, argc, argv);
 
-    rank = json_object_path_get_int(main_obj, "parallel/mpi_rank");
-    size = json_object_path_get_int(main_obj, "parallel/mpi_size");
-
-//#warning MOVE TO A FUNCTION
     /* ensure we're in MIF mode and determine the file count */
-    json_object *parfmode_obj = json_object_path_get_array(main_obj, "clargs/parallel_file_mode");
-    if (parfmode_obj)
+    switch (MACSIO_MIF_ParallelFileMode(main_obj, &numFiles))
     {
-        json_object *modestr = json_object_array_get_idx(parfmode_obj, 0);
-        json_object *filecnt = json_object_array_get_idx(parfmode_obj, 1);
-//#warning ERRORS NEED TO GO TO LOG FILES AND ERROR BEHAVIOR NEEDS TO BE HONORED
-        if (!strcmp(json_object_get_string(modestr), "SIF"))
-        {
+        case MACSIO_MIF_MODE_SIF:
             MACSIO_LOG_MSG(Die, ("PDB plugin cannot handle SIF mode."));
-        }
-        else
-        {
-            numFiles = json_object_get_int(filecnt);
-            main_dump_mif(main_obj, numFiles, dumpn, dumpt);
-        }
-    }
-    else
-    {
-        char const * modestr = json_object_path_get_string(main_obj, "clargs/parallel_file_mode");
-        if (!strcmp(modestr, "MIFMAX"))
-            numFiles = json_object_path_get_int(main_obj, "parallel/mpi_size");
-        else if (!strcmp(modestr, "MIFAUTO"))
-        {
-            /* Call utility to determine optimal file count */
-//#warning ADD UTILIT TO DETERMINE OPTIMAL FILE COUNT
-        }
-        main_dump_mif(main_obj, numFiles, dumpn, dumpt);
+            break;
+        case MACSIO_MIF_MODE_MIFMEM:
+            MACSIO_LOG_MSG(Die, ("PDB plugin cannot handle MIFMEM mode."));
+            break;
     }
+
+    main_dump_mif(main_obj, numFiles, dumpn, dumpt);
 }
 
 static int register_this_interface()
 {
     MACSIO_IFACE_Handle_t iface;
 
+    memset(&iface, 0, sizeof(iface));
+
     if (strlen(iface_name) >= MACSIO_IFACE_MAX_NAME)
         MACSIO_LOG_MSG(Die, ("Interface name \"%s\" too long", iface_name));
 
@@ -242,6 +226,8 @@ static int register_this_interface()
     iface.dumpFunc = main_dump;
     iface.processArgsFunc = process_args;
 
+    mif_tag = MACSIO_MIF_AllocTag("pdb mif");
+
     /* Register this plugin */
     if (!MACSIO_IFACE_Register(&iface))
         MACSIO_LOG_MSG(Die, ("Failed to register interface \"%s\"", iface_name));
@@ -262,6 +262,7 @@ static int StringToDriver(const char *str)
 /* the name you want to assign to the interface */
 static char const *iface_name = "silo";
 static char const *iface_ext = "silo";
+static int mif_tag;
 
 static const char *filename;
 static int has_mesh = 0;
@@ -581,7 +582,9 @@ static void WriteMultiXXXObjects(json_object *main_obj, DBfile *siloFile, int du
         else
         {
 //#warning USE SILO NAMESCHEMES INSTEAD
-            sprintf(blockNames[i], "%s_silo_%05d_%03d.%s:/domain_%07d/mesh",
+            /* Other files are named relative to the root file's directory */
+            MACSIO_UTILS_RelativeOutputPath(main_obj, 0, groupRank, MACSIO_MIF_NumGroups(bat),
+                blockNames[i], 1024, "%s_silo_%05d_%03d.%s:/domain_%07d/mesh",
                 JsonGetStr(main_obj, "clargs/filebase"),
                 groupRank, dumpn,
                 JsonGetStr(main_obj, "clargs/fileext"),
@@ -611,7 +614,8 @@ static void WriteMultiXXXObjects(json_object *main_obj, DBfile *siloFile, int du
             else
             {
 //#warning USE SILO NAMESCHEMES INSTEAD
-                sprintf(blockNames[i], "%s_silo_%05d_%03d.%s:/domain_%07d/%s",
+                MACSIO_UTILS_RelativeOutputPath(main_obj, 0, groupRank, MACSIO_MIF_NumGroups(bat),
+                    blockNames[i], 1024, "%s_silo_%05d_%03d.%s:/domain_%07d/%s",
                     JsonGetStr(main_obj, "clargs/filebase"),
                     groupRank,
                     dumpn,
@@ -703,7 +707,7 @@ static void main_dump(int argi, int argc, char **argv, json_object *main_obj, in
 {
     DBfile *siloFile;
     int numGroups = -1;
-    int rank, size;
+    int rank;
     char fileName[256];
     MACSIO_MIF_baton_t *bat;
     MACSIO_MIF_ioFlags_t ioFlags = {MACSIO_MIF_WRITE,
@@ -719,57 +723,33 @@ static void main_dump(int argi, int argc, char **argv, json_object *main_obj, in
     process_args(argi, argc, argv);
 
     rank = JsonGetInt(main_obj, "parallel/mpi_rank");
-    size = JsonGetInt(main_obj, "parallel/mpi_size");
 
-//#warning MOVE TO A FUNCTION
     /* ensure we're in MIF mode and determine the file count */
-    json_object *parfmode_obj = JsonGetObj(main_obj, "clargs/parallel_file_mode");
-    if (parfmode_obj)
+    switch (MACSIO_MIF_ParallelFileMode(main_obj, &numGroups))
     {
-        json_object *modestr = json_object_array_get_idx(parfmode_obj, 0);
-        json_object *filecnt = json_object_array_get_idx(parfmode_obj, 1);
-        if (modestr && !strcmp(json_object_get_string(modestr), "SIF"))
-        {
+        case MACSIO_MIF_MODE_SIF:
             MACSIO_LOG_MSG(Die, ("Silo plugin doesn't support SIF mode"));
-        }
-        else if (modestr && strcmp(json_object_get_string(modestr), "MIF"))
-        {
-            MACSIO_LOG_MSG(Warn, ("Ignoring non-standard MIF mode"));
-        }
-        if (filecnt)
-            numGroups = json_object_get_int(filecnt);
-        else
-            numGroups = size;
-    }
-    else
-    {
-        char const * modestr = JsonGetStr(main_obj, "clargs/parallel_file_mode");
-        if (!strcmp(modestr, "SIF"))
-        {
-            MACSIO_LOG_MSG(Die, ("Silo plugin doesn't support SIF mode"));
-        }
-        else if (!strcmp(modestr, "MIFMAX"))
-            numGroups = JsonGetInt(main_obj, "parallel/mpi_size");
-        else if (!strcmp(modestr, "MIFAUTO"))
-        {
-            /* Call utility to determine optimal file count */
-//#warning ADD UTILIT TO DETERMINE OPTIMAL FILE COUNT
-        }
+            break;
+        case MACSIO_MIF_MODE_MIFMEM:
+            MACSIO_LOG_MSG(Die, ("Silo plugin doesn't support MIFMEM mode"));
+            break;
     }
 
     /* Initialize MACSIO_MIF, pass a pointer to the driver type as the user data. */
-    bat = MACSIO_MIF_Init(numGroups, ioFlags, MACSIO_MAIN_Comm, 1,
+    bat = MACSIO_MIF_Init(numGroups, ioFlags, MACSIO_MAIN_Comm, mif_tag,
         CreateSiloFile, OpenSiloFile, CloseSiloFile, &driver);
 
     /* Construct name for the silo file */
 //#warning CHANGE NAMING SCHEME SO LS WORKS BETTER
-    sprintf(fileName, "%s_silo_%05d_%03d.%s",
+    MACSIO_UTILS_OutputPath(main_obj, dumpn, MACSIO_MIF_RankOfGroup(bat, rank),
+        MACSIO_MIF_NumGroups(bat), fileName, sizeof(fileName), "%s_silo_%05d_%03d.%s",
         JsonGetStr(main_obj, "clargs/filebase"),
         MACSIO_MIF_RankOfGroup(bat, rank),
         dumpn,
         JsonGetStr(main_obj, "clargs/fileext"));
+    MACSIO_UTILS_MakeOutputDirs(main_obj, dumpn, MACSIO_MIF_NumGroups(bat), MACSIO_MAIN_Comm);
 
-    MACSIO_UTILS_RecordOutputFiles(dumpn, fileName);
+    MACSIO_MIF_RecordGroupFile(bat, dumpn, fileName);
 
     /* Wait for write access to the file. All processors call this.
      * Some processors (the first in each group) return immediately
@@ -1031,6 +1011,8 @@ static int register_this_interface()
 {
     MACSIO_IFACE_Handle_t iface;
 
+    memset(&iface, 0, sizeof(iface));
+
     if (strlen(iface_name) >= MACSIO_IFACE_MAX_NAME)
         MACSIO_LOG_MSG(Die, ("Interface name \"%s\" too long",iface_name));
 
@@ -1043,6 +1025,8 @@ static int register_this_interface()
     iface.loadFunc = main_load;
     iface.processArgsFunc = process_args;
 
+    mif_tag = MACSIO_MIF_AllocTag("silo mif");
+
     if (!MACSIO_IFACE_Register(&iface))
         MACSIO_LOG_MSG(Die, ("Failed to register interface \"%s\"", iface_name));
 
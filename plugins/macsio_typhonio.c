@@ -31,6 +31,8 @@
 
 static char const *iface_name = "typhonio";
 static char const *iface_ext = "h5";
+static int mif_tag;
+static int msf_tag;
 static char *filename;
 
 static int no_collective = 0; /**< Controls whether collective I/O will be enabled in TyphonIO */
@@ -534,20 +536,22 @@ static void main_dump_mif(
 
 //#warning SET FILE AND DATASET PROPERTIES
 //#warning DIFFERENT MPI TAGS FOR DIFFERENT PLUGINS AND CONTEXTS
-    MACSIO_MIF_baton_t *bat = MACSIO_MIF_Init(numFiles, ioFlags, MACSIO_MAIN_Comm, 1,
+    MACSIO_MIF_baton_t *bat = MACSIO_MIF_Init(numFiles, ioFlags, MACSIO_MAIN_Comm, mif_tag,
                               CreateTyphonIOFile, OpenTyphonIOFile, CloseTyphonIOFile, &userData);
 
     rank = json_object_path_get_int(main_obj, "parallel/mpi_rank");
     size = json_object_path_get_int(main_obj, "parallel/mpi_size");
 
     /* Construct name for the typhonio file */
-    sprintf(fileName, "%s_typhonio_%05d_%03d.%s",
+    MACSIO_UTILS_OutputPath(main_obj, dumpn, MACSIO_MIF_RankOfGroup(bat, rank),
+            MACSIO_MIF_NumGroups(bat), fileName, sizeof(fileName), "%s_typhonio_%05d_%03d.%s",
             json_object_path_get_string(main_obj, "clargs/filebase"),
             MACSIO_MIF_RankOfGroup(bat, rank),
             dumpn,
             "h5");//json_object_path_get_string(main_obj, "clargs/fileext"));
+    MACSIO_UTILS_MakeOutputDirs(main_obj, dumpn, MACSIO_MIF_NumGroups(bat), MACSIO_MAIN_Comm);
 
-    MACSIO_UTILS_RecordOutputFiles(dumpn, fileName);
+    MACSIO_MIF_RecordGroupFile(bat, dumpn, fileName);
 
     tioFile_ptr = (TIO_t *) MACSIO_MIF_WaitForBaton(bat, fileName, 0);
     tioFile = *tioFile_ptr;
@@ -1111,21 +1115,23 @@ static void main_dump_msf(
     group_data_t userData;
     MACSIO_MSF_ioFlags_t ioFlags = {MACSIO_MSF_WRITE, JsonGetInt(main_obj, "clargs/exercise_scr") & 0x1};
 
-    MACSIO_MSF_baton_t *bat = MACSIO_MSF_Init(numFiles, ioFlags, MACSIO_MAIN_Comm, 1, &userData);
+    MACSIO_MSF_baton_t *bat = MACSIO_MSF_Init(numFiles, ioFlags, MACSIO_MAIN_Comm, msf_tag, &userData);
 
     rank = json_object_path_get_int(main_obj, "parallel/mpi_rank");
     size = json_object_path_get_int(main_obj, "parallel/mpi_size");
 
     /* Construct name for the typhonio file */
-    sprintf(fileName, "%s_typhonio_%05d_%03d.%s",
+    MACSIO_UTILS_OutputPath(main_obj, dumpn, MACSIO_MSF_RankOfGroup(bat, rank),
+            numFiles, fileName, sizeof(fileName), "%s_typhonio_%05d_%03d.%s",
             json_object_path_get_string(main_obj, "clargs/filebase"),
             MACSIO_MSF_RankOfGroup(bat, rank),
             dumpn,
             "h5");//json_object_path_get_string(main_obj, "clargs/fileext"));
+    MACSIO_UTILS_MakeOutputDirs(main_obj, dumpn, numFiles, MACSIO_MAIN_Comm);
 
     sprintf(stateName, "state0");
 
-    MACSIO_UTILS_RecordOutputFiles(dumpn, fileName);
+    MACSIO_MSF_RecordGroupFile(bat, dumpn, fileName);
 
     /* Create */
     //MPI_Comm *groupComm = (MPI_Comm*)userData;
@@ -1707,12 +1713,15 @@ static void main_dump_sif(
     sprintf(state_name, "state0");
 
     /* Construct name for the HDF5 file */
-    sprintf(fileName, "%s_typhonio_%03d.%s",
+    MACSIO_UTILS_OutputPath(main_obj, dumpn, 0, 1, fileName, sizeof(fileName), "%s_typhonio_%03d.%s",
             json_object_path_get_string(main_obj, "clargs/filebase"),
             file_suffix,
             "h5"); //json_object_path_get_string(main_obj, "clargs/fileext"));
+    MACSIO_UTILS_MakeOutputDirs(main_obj, dumpn, 1, MACSIO_MAIN_Comm);
 
-    MACSIO_UTILS_RecordOutputFiles(dumpn, fileName);
+    /* Only one task records the shared file for size accounting */
+    if (MACSIO_MAIN_Rank == 0)
+        MACSIO_UTILS_RecordOutputFiles(dumpn, fileName);
 
     TIO_Call( TIO_Create(fileName, &tiofile_id, TIO_ACC_REPLACE, "MACSio",
         "1.0", date, fileName, MACSIO_MAIN_Comm, mpiInfo, MACSIO_MAIN_Rank),
@@ -1760,60 +1769,33 @@ static void main_dump(
     int dumpn,              /**< [in] The number/index of this dump */
     double dumpt)           /**< [in] The time to be associated with this dump (like a simulation's time) */
 {
-    int rank, size, numFiles;
+    int numFiles, mode;
     /* Without this barrier, I get strange behavior with Silo's MACSIO_MIF interface */
     //mpi_errno = MPI_Barrier(MACSIO_MAIN_Comm);
 
     /* process cl args */
     process_args(argi, argc, argv);
 
-    rank = json_object_path_get_int(main_obj, "parallel/mpi_rank");
-    size = json_object_path_get_int(main_obj, "parallel/mpi_size");
-
     /* Decide which method to pass control to for MIF or SIF mode */
-    json_object *parfmode_obj = json_object_path_get_array(main_obj, "clargs/parallel_file_mode");
-    if (parfmode_obj) {
-        json_object *modestr = json_object_array_get_idx(parfmode_obj, 0);
-        json_object *filecnt = json_object_array_get_idx(parfmode_obj, 1);
-
-        if (!strcmp(json_object_get_string(modestr), "SIF")) {
-            float avg_num_parts = json_object_path_get_double(main_obj, "clargs/avg_num_parts");
-            if (avg_num_parts == (float ((int) avg_num_parts))){
-                if (json_object_get_int(filecnt) > 1){
-                    main_dump_msf(main_obj, json_object_get_int(filecnt), dumpn, dumpt);
-                } else {
-                    main_dump_sif(main_obj, dumpn, dumpt);
-                }
+    mode = MACSIO_MIF_ParallelFileMode(main_obj, &numFiles);
+    if (mode == MACSIO_MIF_MODE_MIFMEM)
+        MACSIO_LOG_MSG(Die, ("TyphonIO plugin doesn't support MIFMEM mode"));
+    else if (mode == MACSIO_MIF_MODE_SIF) {
+        float avg_num_parts = json_object_path_get_double(main_obj, "clargs/avg_num_parts");
+        if (avg_num_parts == (float ((int) avg_num_parts))){
+            if (numFiles > 1){
+                main_dump_msf(main_obj, numFiles, dumpn, dumpt);
             } else {
-                // CURRENTLY, SIF CAN WORK ONLY ON WHOLE PART COUNTS
-                MACSIO_LOG_MSG(Die, ("TyphonIO plugin cannot currently handle SIF mode where "
-                                     "there are different numbers of parts on each MPI rank. "
-                                     "Set --avg_num_parts to an integral value." ));
-            }
-        }
-        else {
-            numFiles = json_object_get_int(filecnt);
-            main_dump_mif(main_obj, numFiles, dumpn, dumpt);
-        }
-    } else {
-        char const * modestr = json_object_path_get_string(main_obj, "clargs/parallel_file_mode");
-        if (!strcmp(modestr, "SIF")) {
-            float avg_num_parts = json_object_path_get_double(main_obj, "clargs/avg_num_parts");
-            if (avg_num_parts == (float ((int) avg_num_parts)))
                 main_dump_sif(main_obj, dumpn, dumpt);
-            else {
-                // CURRENTLY, SIF CAN WORK ONLY ON WHOLE PART COUNTS
-                MACSIO_LOG_MSG(Die, ("TyphonIO plugin cannot currently handle SIF mode where "
-                                     "there are different numbers of parts on each MPI rank. "
-                                     "Set --avg_num_parts to an integral value." ));
             }
+        } else {
+            // CURRENTLY, SIF CAN WORK ONLY ON WHOLE PART COUNTS
+            MACSIO_LOG_MSG(Die, ("TyphonIO plugin cannot currently handle SIF mode where "
+                                 "there are different numbers of parts on each MPI rank. "
+                                 "Set --avg_num_parts to an integral value." ));
         }
-        else if (!strcmp(modestr, "MIFMAX"))
-            numFiles = json_object_path_get_int(main_obj, "parallel/mpi_size");
-        else if (!strcmp(modestr, "MIFAUTO")) {
-            /* Call utility to determine optimal file count */
-            // ADD UTILIT TO DETERMINE OPTIMAL FILE COUNT
-        }
+    }
+    else {
         main_dump_mif(main_obj, numFiles, dumpn, dumpt);
     }
 }
@@ -1831,6 +1813,8 @@ static int register_this_interface()
 {
     MACSIO_IFACE_Handle_t iface;
 
+    memset(&iface, 0, sizeof(iface));
+
     if (strlen(iface_name) >= MACSIO_IFACE_MAX_NAME)
         MACSIO_LOG_MSG(Die, ("Interface name \"%s\" too long", iface_name));
 
@@ -1840,6 +1824,9 @@ static int register_this_interface()
     iface.dumpFunc = main_dump;
     iface.processArgsFunc = process_args;
 
+    mif_tag = MACSIO_MIF_AllocTag("typhonio mif");
+    msf_tag = MACSIO_MIF_AllocTag("typhonio msf");
+
     /* Register this plugin */
     if (!MACSIO_IFACE_Register(&iface))
         MACSIO_LOG_MSG(Die, ("Failed to register interface \"%s\"", iface_name));